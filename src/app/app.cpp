@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,7 @@
 #include "app/check_update.h"
 #include "app/cli/app_options.h"
 #include "app/cli/cli_processor.h"
+#include "app/cli/cli_service.h"
 #include "app/cli/default_cli_delegate.h"
 #include "app/cli/preview_cli_delegate.h"
 #include "app/color_spaces.h"
@@ -248,6 +249,7 @@ App::App(AppMod* mod)
   , m_legacy(nullptr)
   , m_isGui(false)
   , m_isShell(false)
+  , m_isService(false)
 #ifdef ENABLE_UI
   , m_backupIndicator(nullptr)
 #endif
@@ -269,6 +271,7 @@ int App::initialize(const AppOptions& options)
   m_isGui = false;
 #endif
   m_isShell = options.startShell();
+  m_isService = options.startService();
   m_coreModules = std::make_unique<CoreModules>();
 
 #if LAF_WINDOWS
@@ -562,6 +565,12 @@ void App::run()
   }
 #endif  // ENABLE_SCRIPTING
 
+  // Start the headless service to process CLI jobs.
+  if (m_isService) {
+    CliService service;
+    service.run(context(), std::cin, std::cout);
+  }
+
   // ----------------------------------------------------------------------
 
 #ifdef ENABLE_SCRIPTING
@@ -767,7 +776,13 @@ void App::updateDisplayTitleBar()
   if (docView) {
     // Prepend the document's filename.
     title += docView->document()->name();
-    if (docView->document()->isReadOnly()) {
+    if (docView->document()->isLoading()) {
+      title += " [Loading]";
+    }
+    else if (docView->document()->isLoadingFailed()) {
+      title += " [Incomplete]";
+    }
+    else if (docView->document()->isReadOnly()) {
       title += " [Read-Only]";
     }
     title += " - ";
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -570,6 +570,7 @@ bool AppMenus::rebuildRecentList()
                recent->recentFiles().end());
   if (!files.empty()) {
     Params params;
+    params.set("progressive", "true");
     for (const auto& fn : files) {
       params.set("filename", fn.c_str());
 
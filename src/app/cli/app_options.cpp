@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
   , m_startUI(true)
   , m_startShell(false)
+  , m_startService(false)
   , m_previewCLI(false)
   , m_showHelp(false)
   , m_showVersion(false)
@@ -29,6 +30,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
 #endif
   , m_batch(m_po.add("batch").mnemonic('b').description("Do not start the UI"))
+  , m_service(m_po.add("service").description("Do not start the UI, process jobs with\nCLI arguments (in JSON format) from stdin"))
   , m_preview(m_po.add("preview").mnemonic('p').description("Do not execute actions, just print what will be\ndone"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given sprite with other format"))
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Change the palette of the last given sprite"))
@@ -96,11 +98,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
 #ifdef ENABLE_SCRIPTING
     m_startShell = m_po.enabled(m_shell);
 #endif
+    m_startService = m_po.enabled(m_service);
     m_previewCLI = m_po.enabled(m_preview);
     m_showHelp = m_po.enabled(m_help);
     m_showVersion = m_po.enabled(m_version);
 
     if (m_startShell ||
+        m_startService ||
         m_showHelp ||
         m_showVersion ||
         m_po.enabled(m_batch)) {
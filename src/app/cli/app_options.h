@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -36,6 +36,7 @@ public:
 
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startService() const { return m_startService; }
   bool previewCLI() const { return m_previewCLI; }
   bool showHelp() const { return m_showHelp; }
   bool showVersion() const { return m_showVersion; }
@@ -106,6 +107,7 @@ private:
   base::ProgramOptions m_po;
   bool m_startUI;
   bool m_startShell;
+  bool m_startService;
   bool m_previewCLI;
   bool m_showHelp;
   bool m_showVersion;
@@ -115,6 +117,7 @@ private:
   Option& m_shell;
 #endif
   Option& m_batch;
+  Option& m_service;
   Option& m_preview;
   Option& m_saveAs;
   Option& m_palette;
@@ -0,0 +1,128 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/cli_doc_cache.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "base/fs.h"
+#include "base/time.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace app {
+
+namespace {
+
+// Max number of documents kept between jobs
+const std::size_t kMaxCachedDocs = 16;
+
+} // anonymous namespace
+
+CliDocCache::CliDocCache()
+{
+}
+
+CliDocCache::~CliDocCache()
+{
+  clear();
+}
+
+Doc* CliDocCache::take(const std::string& filename, const bool oneFrame)
+{
+  auto it = std::find_if(
+    m_docs.begin(), m_docs.end(),
+    [&filename, oneFrame](const Entry& entry){
+      return (entry.filename == filename &&
+              entry.oneFrame == oneFrame);
+    });
+  if (it == m_docs.end())
+    return nullptr;
+
+  Entry entry = *it;
+  m_docs.erase(it);
+
+  // The file was modified on disk
+  if (entry.stamp.empty() ||
+      entry.stamp != fileStamp(filename)) {
+    closeDoc(entry.doc);
+    return nullptr;
+  }
+  return entry.doc;
+}
+
+void CliDocCache::markAsReusable(Doc* doc,
+                                 const std::string& filename,
+                                 const bool oneFrame)
+{
+  m_reusable.push_back(Entry{ doc, filename, fileStamp(filename), oneFrame });
+}
+
+void CliDocCache::collect(Context* ctx, const bool reuse)
+{
+  const std::vector<Doc*> docs(ctx->documents().begin(),
+                               ctx->documents().end());
+  for (Doc* doc : docs) {
+    auto it = std::find_if(
+      m_reusable.begin(), m_reusable.end(),
+      [doc](const Entry& entry){ return entry.doc == doc; });
+
+    if (reuse &&
+        it != m_reusable.end() &&
+        !it->stamp.empty() &&
+        !doc->isModified() &&
+        doc->filename() == it->filename) {
+      doc->setContext(nullptr);
+      m_docs.insert(m_docs.begin(), *it);
+    }
+    else {
+      closeDoc(doc);
+    }
+  }
+  m_reusable.clear();
+
+  while (m_docs.size() > kMaxCachedDocs) {
+    closeDoc(m_docs.back().doc);
+    m_docs.pop_back();
+  }
+}
+
+void CliDocCache::clear()
+{
+  for (Entry& entry : m_docs)
+    closeDoc(entry.doc);
+  m_docs.clear();
+  m_reusable.clear();
+}
+
+// static
+std::string CliDocCache::fileStamp(const std::string& filename)
+{
+  if (!base::is_file(filename))
+    return std::string();
+
+  const base::Time t = base::get_modification_time(filename);
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "%04d%02d%02d%02d%02d%02d %zu",
+                t.year, t.month, t.day,
+                t.hour, t.minute, t.second,
+                base::file_size(filename));
+  return buf;
+}
+
+// static
+void CliDocCache::closeDoc(Doc* doc)
+{
+  doc->close();
+  delete doc;
+}
+
+} // namespace app
@@ -0,0 +1,62 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_CLI_DOC_CACHE_H_INCLUDED
+#define APP_CLI_CLI_DOC_CACHE_H_INCLUDED
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class Context;
+  class Doc;
+
+  // Keeps the documents loaded by the CLI between jobs of the service
+  // mode (see CliService), so the same file doesn't need to be
+  // decoded again if it wasn't modified (in memory or on disk).
+  class CliDocCache {
+  public:
+    CliDocCache();
+    ~CliDocCache();
+
+    // Returns the cached document of the given file (it's removed
+    // from the cache), or nullptr if it's not cached or the file was
+    // modified since it was loaded.
+    Doc* take(const std::string& filename, const bool oneFrame);
+
+    // Marks the given document (just loaded from "filename" or taken
+    // from the cache) as a candidate to be cached when the job ends.
+    void markAsReusable(Doc* doc,
+                        const std::string& filename,
+                        const bool oneFrame);
+
+    // Removes all documents from the context at the end of a job.
+    // Unmodified documents marked as reusable are cached (if "reuse"
+    // is true), the rest are closed.
+    void collect(Context* ctx, const bool reuse);
+
+    void clear();
+
+  private:
+    struct Entry {
+      Doc* doc;
+      std::string filename;
+      std::string stamp;        // Modification time/size of the file
+      bool oneFrame;
+    };
+
+    static std::string fileStamp(const std::string& filename);
+    static void closeDoc(Doc* doc);
+
+    std::vector<Entry> m_docs;     // Most recently used first
+    std::vector<Entry> m_reusable; // Marked in the current job
+  };
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 
 #include "app/cli/app_options.h"
 #include "app/cli/cli_delegate.h"
+#include "app/cli/cli_doc_cache.h"
 #include "app/commands/commands.h"
 #include "app/commands/params.h"
 #include "app/console.h"
@@ -175,6 +176,7 @@ CliProcessor::CliProcessor(CliDelegate* delegate,
   : m_delegate(delegate)
   , m_options(options)
   , m_exporter(nullptr)
+  , m_docCache(nullptr)
 {
   if (options.hasExporterParams())
     m_exporter.reset(new DocExporter);
@@ -651,17 +653,31 @@ bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 
   Doc* oldDoc = ctx->activeDocument();
 
-  m_batch.open(ctx,
-               cof.filename,
-               cof.oneFrame);
+  // Reuse the document loaded in a previous job of the service mode
+  Doc* cachedDoc = (m_docCache ? m_docCache->take(cof.filename, cof.oneFrame): nullptr);
+  bool oneFile;
+  if (cachedDoc) {
+    cachedDoc->setContext(ctx);
+    ctx->setActiveDocument(cachedDoc);
 
-  // Mark used file names as "already processed" so we don't try to
-  // open then again
-  for (const auto& usedFn : m_batch.usedFiles()) {
-    auto fn = base::normalize_path(usedFn);
-    m_usedFiles.insert(fn);
+    m_usedFiles.insert(cof.filename);
+    os::instance()->markCliFileAsProcessed(cof.filename);
+    oneFile = true;
+  }
+  else {
+    m_batch.open(ctx,
+                 cof.filename,
+                 cof.oneFrame);
+
+    // Mark used file names as "already processed" so we don't try to
+    // open then again
+    for (const auto& usedFn : m_batch.usedFiles()) {
+      auto fn = base::normalize_path(usedFn);
+      m_usedFiles.insert(fn);
 
-    os::instance()->markCliFileAsProcessed(fn);
+      os::instance()->markCliFileAsProcessed(fn);
+    }
+    oneFile = (m_batch.usedFiles().size() == 1);
   }
 
   Doc* doc = ctx->activeDocument();
@@ -672,6 +688,11 @@ bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 
   cof.document = doc;
 
+  // Documents loaded from a sequence of files, or with layers made
+  // visible (without undo information), cannot be reused.
+  if (doc && m_docCache && oneFile && !cof.allLayers)
+    m_docCache->markAsReusable(doc, cof.filename, cof.oneFrame);
+
   if (doc) {
     // Show all layers
     if (cof.allLayers) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,6 +27,7 @@ namespace doc {
 namespace app {
 
   class AppOptions;
+  class CliDocCache;
   class Context;
   class DocExporter;
 
@@ -36,6 +37,10 @@ namespace app {
                  const AppOptions& options);
     int process(Context* ctx);
 
+    // Documents are taken from/marked as reusable in the given cache
+    // (used in the service mode, see CliService).
+    void setDocCache(CliDocCache* cache) { m_docCache = cache; }
+
     // Public so it can be tested
     static void FilterLayers(const doc::Sprite* sprite,
                              // By value because these vectors will be modified inside
@@ -60,6 +65,7 @@ namespace app {
     CliDelegate* m_delegate;
     const AppOptions& m_options;
     std::unique_ptr<DocExporter> m_exporter;
+    CliDocCache* m_docCache;
 
     // Files already used in the CLI processing (e.g. when used to
     // load a sequence of files) so we don't ask for them again.
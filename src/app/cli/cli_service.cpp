@@ -0,0 +1,125 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/cli_service.h"
+
+#include "app/cli/app_options.h"
+#include "app/cli/cli_processor.h"
+#include "app/cli/default_cli_delegate.h"
+
+#include "json11.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+// Captures the text printed in std::cout in the job output (the
+// app::Console and the script print() function use std::cout too
+// when there is no UI)
+class RedirectCout {
+public:
+  RedirectCout(std::streambuf* buf)
+    : m_old(std::cout.rdbuf(buf)) { }
+  ~RedirectCout() { std::cout.rdbuf(m_old); }
+private:
+  std::streambuf* m_old;
+};
+
+} // anonymous namespace
+
+CliService::CliService()
+{
+}
+
+void CliService::run(Context* ctx, std::istream& in, std::ostream& out)
+{
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty())
+      continue;
+
+    out << processJob(ctx, line) << std::endl;
+  }
+  m_docCache.clear();
+}
+
+std::string CliService::processJob(Context* ctx, const std::string& line)
+{
+  json11::Json::object response;
+
+  std::string err;
+  const json11::Json request = json11::Json::parse(line, err);
+  if (!err.empty() || !request.is_object()) {
+    response["error"] = "invalid JSON job: " + (err.empty() ? line: err);
+    return json11::Json(response).dump();
+  }
+
+  response["id"] = request["id"];
+
+  // Jobs are always processed as in batch mode
+  std::vector<std::string> args = { "aseprite", "--batch" };
+  for (const auto& arg : request["args"].array_items()) {
+    if (!arg.is_string()) {
+      response["error"] = "all \"args\" must be strings";
+      return json11::Json(response).dump();
+    }
+    args.push_back(arg.string_value());
+  }
+
+  std::vector<const char*> argv;
+  for (const auto& arg : args)
+    argv.push_back(arg.c_str());
+
+  std::ostringstream output;
+  int code = 0;
+  bool reuse = true;
+  {
+    RedirectCout redirect(output.rdbuf());
+    try {
+      AppOptions options(int(argv.size()), &argv[0]);
+
+      // Jobs cannot read from stdin (it's where the service reads
+      // the next jobs)
+      if (options.startShell() || options.startService())
+        throw std::runtime_error("--shell and --service cannot be used in jobs");
+
+#ifdef ENABLE_SCRIPTING
+      // Scripts can modify documents without modifying their undo
+      // history, so we don't reuse documents of this job.
+      for (const auto& value : options.values()) {
+        if (value.option() == &options.script())
+          reuse = false;
+      }
+#endif
+
+      DefaultCliDelegate delegate;
+      CliProcessor cli(&delegate, options);
+      cli.setDocCache(&m_docCache);
+      code = cli.process(ctx);
+    }
+    catch (const std::exception& ex) {
+      response["error"] = ex.what();
+      code = -1;
+      reuse = false;
+    }
+  }
+  m_docCache.collect(ctx, reuse);
+
+  response["code"] = code;
+  response["output"] = output.str();
+  return json11::Json(response).dump();
+}
+
+} // namespace app
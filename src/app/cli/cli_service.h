@@ -0,0 +1,53 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_CLI_SERVICE_H_INCLUDED
+#define APP_CLI_CLI_SERVICE_H_INCLUDED
+#pragma once
+
+#include "app/cli/cli_doc_cache.h"
+
+#include <iosfwd>
+#include <string>
+
+namespace app {
+
+  class Context;
+
+  // Headless service mode (--service): processes CLI jobs from stdin
+  // in the same process, so the app is initialized just once and the
+  // loaded documents are kept between jobs (see CliDocCache).
+  //
+  // Each job is one line with a JSON object, e.g.:
+  //
+  //   { "id": 1, "args": [ "sprite.aseprite", "--sheet", "sheet.png" ] }
+  //
+  // where "args" are the same command line arguments used in batch
+  // mode, and "id" (optional) is any value to identify the response.
+  // For each job, one line with a JSON object is written to stdout:
+  //
+  //   { "id": 1, "code": 0, "output": "..." }
+  //
+  // "output" is the text that the job printed (e.g. --list-layers,
+  // errors loading files in app::Console, or script print() calls),
+  // and "error" is included if the job couldn't be processed. Text
+  // written directly to the C stdout (e.g. io.write() in scripts) is
+  // not captured. The service ends when stdin is closed.
+  class CliService {
+  public:
+    CliService();
+
+    void run(Context* ctx, std::istream& in, std::ostream& out);
+
+  private:
+    std::string processJob(Context* ctx, const std::string& line);
+
+    CliDocCache m_docCache;
+  };
+
+} // namespace app
+
+#endif
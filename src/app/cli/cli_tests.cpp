@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2019  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -8,10 +8,23 @@
 #include "tests/app_test.h"
 
 #include "app/cli/app_options.h"
+#include "app/cli/cli_doc_cache.h"
 #include "app/cli/cli_processor.h"
+#include "app/cli/cli_service.h"
+#include "app/context.h"
+#include "app/doc.h"
 #include "app/doc_exporter.h"
+#include "app/file/file.h"
+#include "base/fs.h"
+#include "ver/info.h"
+
+#include "json11.hpp"
 
 #include <initializer_list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
 using namespace app;
 
@@ -93,3 +106,169 @@ TEST(Cli, Version)
   p.process(nullptr);
   EXPECT_TRUE(d.versionWasShown());
 }
+
+TEST(Cli, Service)
+{
+  auto a = args({ "--service" });
+  EXPECT_TRUE(a->startService());
+  EXPECT_FALSE(a->startUI());
+
+  auto b = args({ "--batch" });
+  EXPECT_FALSE(b->startService());
+}
+
+// Runs the given jobs in the service and returns the parsed replies
+static std::vector<json11::Json> run_service(Context* ctx,
+                                             CliService& service,
+                                             const std::string& jobs)
+{
+  std::istringstream in(jobs);
+  std::ostringstream out;
+  service.run(ctx, in, out);
+
+  std::vector<json11::Json> replies;
+  std::istringstream lines(out.str());
+  std::string line, err;
+  while (std::getline(lines, line)) {
+    replies.push_back(json11::Json::parse(line, err));
+    EXPECT_TRUE(err.empty()) << line;
+  }
+  return replies;
+}
+
+TEST(CliService, OneReplyPerJob)
+{
+  Context ctx;
+  CliService service;
+  auto replies = run_service(
+    &ctx, service,
+    "{ \"id\": 1, \"args\": [ \"--version\" ] }\n"
+    "\n"
+    "{ \"id\": \"second\", \"args\": [ \"--version\" ] }\n"
+    "{ \"args\": [ ] }\n");
+
+  const std::string version =
+    std::string(get_app_name()) + " " + get_app_version() + "\n";
+
+  ASSERT_EQ(3, replies.size());
+  EXPECT_EQ(1, replies[0]["id"].int_value());
+  EXPECT_EQ(0, replies[0]["code"].int_value());
+  EXPECT_EQ(version, replies[0]["output"].string_value());
+  EXPECT_TRUE(replies[0]["error"].is_null());
+
+  EXPECT_EQ("second", replies[1]["id"].string_value());
+  EXPECT_EQ(version, replies[1]["output"].string_value());
+
+  EXPECT_TRUE(replies[2]["id"].is_null());
+  EXPECT_EQ(0, replies[2]["code"].int_value());
+  EXPECT_EQ("", replies[2]["output"].string_value());
+}
+
+TEST(CliService, ErrorReplies)
+{
+  Context ctx;
+  CliService service;
+  auto replies = run_service(
+    &ctx, service,
+    "this is not json\n"
+    "[ \"--version\" ]\n"
+    "{ \"id\": 3, \"args\": [ \"--version\", 4 ] }\n"
+    "{ \"id\": 5, \"args\": [ \"--version\" ] }\n");
+
+  ASSERT_EQ(4, replies.size());
+  for (int i=0; i<3; ++i) {
+    EXPECT_FALSE(replies[i]["error"].string_value().empty());
+    EXPECT_TRUE(replies[i]["output"].is_null());
+  }
+  EXPECT_EQ(3, replies[2]["id"].int_value());
+
+  // The service continues working after errors
+  EXPECT_EQ(5, replies[3]["id"].int_value());
+  EXPECT_TRUE(replies[3]["error"].is_null());
+  EXPECT_EQ(0, replies[3]["code"].int_value());
+}
+
+static void save_test_sprite(Context* ctx, const std::string& fn, int w, int h)
+{
+  std::unique_ptr<Doc> doc(
+    ctx->documents().add(w, h, doc::ColorMode::RGB));
+  doc->setFilename(fn);
+  EXPECT_EQ(0, save_document(ctx, doc.get()));
+  doc->close();
+}
+
+// Simulates a job that loads the given file
+static Doc* load_job_doc(Context* ctx, CliDocCache& cache, const std::string& fn)
+{
+  Doc* doc = cache.take(fn, false);
+  if (doc)
+    doc->setContext(ctx);
+  else
+    doc = load_document(ctx, fn);
+  if (doc)
+    cache.markAsReusable(doc, fn, false);
+  return doc;
+}
+
+TEST(CliDocCache, ReuseUnmodifiedFile)
+{
+  Context ctx;
+  const std::string fn = "_cli_doc_cache_reuse.aseprite";
+  save_test_sprite(&ctx, fn, 8, 8);
+  {
+    CliDocCache cache;
+    Doc* doc = load_job_doc(&ctx, cache, fn);
+    ASSERT_TRUE(doc != nullptr);
+    cache.collect(&ctx, true);
+    EXPECT_TRUE(ctx.documents().empty());
+
+    // The same document is used in the next job
+    EXPECT_EQ(doc, load_job_doc(&ctx, cache, fn));
+    EXPECT_EQ(1, ctx.documents().size());
+    cache.collect(&ctx, true);
+
+    // Other kind of load (--oneframe) doesn't reuse it
+    EXPECT_EQ(nullptr, cache.take(fn, true));
+    EXPECT_EQ(doc, cache.take(fn, false));
+    doc->close();
+    delete doc;
+  }
+  base::delete_file(fn);
+}
+
+TEST(CliDocCache, ReloadModifiedFile)
+{
+  Context ctx;
+  const std::string fn = "_cli_doc_cache_modified.aseprite";
+  save_test_sprite(&ctx, fn, 8, 8);
+  {
+    CliDocCache cache;
+    Doc* doc = load_job_doc(&ctx, cache, fn);
+    ASSERT_TRUE(doc != nullptr);
+    cache.collect(&ctx, true);
+
+    // The file is modified on disk (a different size)
+    save_test_sprite(&ctx, fn, 64, 64);
+
+    doc = load_job_doc(&ctx, cache, fn);
+    ASSERT_TRUE(doc != nullptr);
+    EXPECT_EQ(64, doc->sprite()->width());
+    cache.collect(&ctx, true);
+  }
+  base::delete_file(fn);
+}
+
+TEST(CliDocCache, DontReuseDocsOfFailedJobs)
+{
+  Context ctx;
+  const std::string fn = "_cli_doc_cache_failed.aseprite";
+  save_test_sprite(&ctx, fn, 8, 8);
+  {
+    CliDocCache cache;
+    ASSERT_TRUE(load_job_doc(&ctx, cache, fn) != nullptr);
+    cache.collect(&ctx, false);
+    EXPECT_TRUE(ctx.documents().empty());
+    EXPECT_EQ(nullptr, cache.take(fn, false));
+  }
+  base::delete_file(fn);
+}
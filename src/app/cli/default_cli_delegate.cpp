@@ -123,6 +123,10 @@ void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 {
   LOG("APP: Exporting sheet...\n");
 
+  // The generated sprite sheet is not used, so the texture can be
+  // encoded directly to the file by bands.
+  exporter.setStreamTexture(true);
+
   base::task_token token;
   std::unique_ptr<Doc> spriteSheet(
     exporter.exportSheet(ctx, token));
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -89,6 +90,21 @@ size_t Cmd::memSize() const
   return onMemSize();
 }
 
+void Cmd::compressData()
+{
+  onCompressData();
+}
+
+void Cmd::swapOutData()
+{
+  onSwapOutData();
+}
+
+bool Cmd::isCompressingData() const
+{
+  return onIsCompressingData();
+}
+
 void Cmd::onExecute()
 {
   // Do nothing
@@ -119,4 +135,19 @@ size_t Cmd::onMemSize() const {
   return sizeof(*this);
 }
 
+void Cmd::onCompressData()
+{
+  // Do nothing
+}
+
+void Cmd::onSwapOutData()
+{
+  // Do nothing
+}
+
+bool Cmd::onIsCompressingData() const
+{
+  return false;
+}
+
 } // namespace app
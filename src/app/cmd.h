@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -32,6 +33,18 @@ namespace app {
     std::string label() const;
     size_t memSize() const;
 
+    // Reduce the memory used by the undo data of this cmd when its
+    // undo state is far from the current one. compressData() starts
+    // compressing the data in a background thread, swapOutData()
+    // moves the already compressed data to a temporary file. The data
+    // is restored automatically when the cmd is undone/redone.
+    void compressData();
+    void swapOutData();
+
+    // Returns true if the data is still being compressed in the
+    // background (i.e. memSize() can change at any moment).
+    bool isCompressingData() const;
+
     Context* context() const { return m_ctx; }
 
   protected:
@@ -41,6 +54,9 @@ namespace app {
     virtual void onFireNotifications();
     virtual std::string onLabel() const;
     virtual size_t onMemSize() const;
+    virtual void onCompressData();
+    virtual void onSwapOutData();
+    virtual bool onIsCompressingData() const;
 
   private:
     Context* m_ctx;
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -11,8 +12,10 @@
 #include "app/cmd/clear_image.h"
 
 #include "app/doc.h"
+#include "app/util/buffer_region.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
+#include "gfx/region.h"
 
 namespace app {
 namespace cmd {
@@ -29,8 +32,8 @@ void ClearImage::onExecute()
 {
   Image* image = this->image();
 
-  ASSERT(!m_copy);
-  m_copy.reset(Image::createCopy(image));
+  save_image_region_in_buffer(gfx::Region(image->bounds()), image,
+                              gfx::Point(0, 0), m_buffer.data());
   clear_image(image, m_color);
 
   image->incrementVersion();
@@ -40,11 +43,17 @@ void ClearImage::onUndo()
 {
   Image* image = this->image();
 
-  copy_image(image, m_copy.get());
-  m_copy.reset();
+  swap_image_region_with_buffer(gfx::Region(image->bounds()), image,
+                                m_buffer.data());
 
   image->incrementVersion();
 }
 
+void ClearImage::onRedo()
+{
+  // The buffer contains the cleared pixels
+  onUndo();
+}
+
 } // namespace cmd
 } // namespace app
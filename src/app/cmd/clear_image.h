@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,8 +11,8 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/undo_buffer.h"
 #include "doc/color.h"
-#include "doc/image_ref.h"
 
 namespace app {
 namespace cmd {
@@ -25,12 +26,24 @@ namespace cmd {
   protected:
     void onExecute() override;
     void onUndo() override;
+    void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + (m_copy ? m_copy->getMemSize(): 0);
+      return sizeof(*this) + m_buffer.memSize();
+    }
+    void onCompressData() override {
+      m_buffer.compress();
+    }
+    void onSwapOutData() override {
+      m_buffer.swapOut();
+    }
+    bool onIsCompressingData() const override {
+      return m_buffer.isCompressing();
     }
 
   private:
-    ImageRef m_copy;
+    // Original pixels of the image (or the cleared pixels when the
+    // cmd is undone)
+    UndoBuffer m_buffer;
     color_t m_color;
   };
 
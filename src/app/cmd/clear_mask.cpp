@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 
 #include "app/cmd/clear_cel.h"
 #include "app/doc.h"
+#include "app/util/buffer_region.h"
 #include "doc/algorithm/fill_selection.h"
 #include "doc/cel.h"
 #include "doc/image_impl.h"
@@ -20,6 +21,7 @@
 #include "doc/layer_tilemap.h"
 #include "doc/mask.h"
 #include "doc/primitives.h"
+#include "gfx/region.h"
 
 namespace app {
 namespace cmd {
@@ -36,7 +38,7 @@ ClearMask::ClearMask(Cel* cel)
   if (!doc->isMaskVisible()) {
     m_seq.add(new cmd::ClearCel(cel));
 
-    // In this case m_copy will be nullptr, so the clear()/restore()
+    // In this case m_cropBounds will be empty, so the clear()/swap()
     // member functions will have no effect.
     return;
   }
@@ -67,9 +69,10 @@ ClearMask::ClearMask(Cel* cel)
     return;
 
   cropBounds.offset(-imageBounds.origin());
-  m_cropPos = cropBounds.origin();
+  m_cropBounds = cropBounds;
 
-  m_copy.reset(crop_image(image, cropBounds, m_bgcolor));
+  save_image_region_in_buffer(gfx::Region(m_cropBounds), image,
+                              gfx::Point(0, 0), m_buffer.data());
 }
 
 void ClearMask::onExecute()
@@ -80,19 +83,20 @@ void ClearMask::onExecute()
 
 void ClearMask::onUndo()
 {
-  restore();
+  swap();
   m_seq.undo();
 }
 
 void ClearMask::onRedo()
 {
   m_seq.redo();
-  clear();
+  // The buffer contains the cleared pixels
+  swap();
 }
 
 void ClearMask::clear()
 {
-  if (!m_copy)
+  if (m_cropBounds.isEmpty())
     return;
 
   Cel* cel = this->cel();
@@ -108,16 +112,15 @@ void ClearMask::clear()
     (cel->image()->isTilemap() ? &grid: nullptr));
 }
 
-void ClearMask::restore()
+void ClearMask::swap()
 {
-  if (!m_copy)
+  if (m_cropBounds.isEmpty())
     return;
 
   Cel* cel = this->cel();
-  copy_image(cel->image(),
-             m_copy.get(),
-             m_cropPos.x,
-             m_cropPos.y);
+  swap_image_region_with_buffer(gfx::Region(m_cropBounds),
+                                cel->image(),
+                                m_buffer.data());
 }
 
 } // namespace cmd
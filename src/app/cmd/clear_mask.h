@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,7 +13,8 @@
 #include "app/cmd/with_cel.h"
 #include "app/cmd/with_image.h"
 #include "app/cmd_sequence.h"
-#include "doc/image_ref.h"
+#include "app/undo_buffer.h"
+#include "doc/color.h"
 #include "gfx/rect.h"
 
 #include <memory>
@@ -32,17 +33,30 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_seq.memSize() +
-        (m_copy ? m_copy->getMemSize(): 0);
+      return sizeof(*this) + m_seq.memSize() + m_buffer.memSize();
+    }
+    void onCompressData() override {
+      m_seq.compressData();
+      m_buffer.compress();
+    }
+    void onSwapOutData() override {
+      m_seq.swapOutData();
+      m_buffer.swapOut();
+    }
+    bool onIsCompressingData() const override {
+      return (m_seq.isCompressingData() ||
+              m_buffer.isCompressing());
     }
 
   private:
     void clear();
-    void restore();
+    void swap();
 
     CmdSequence m_seq;
-    ImageRef m_copy;
-    gfx::Point m_cropPos;
+    // Original pixels of m_cropBounds (or the cleared pixels when the
+    // cmd is undone)
+    UndoBuffer m_buffer;
+    gfx::Rect m_cropBounds;
     color_t m_bgcolor;
   };
 
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,10 +12,12 @@
 #include "app/cmd/clear_rect.h"
 
 #include "app/doc.h"
+#include "app/util/buffer_region.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/primitives.h"
+#include "gfx/region.h"
 
 namespace app {
 namespace cmd {
@@ -29,15 +32,12 @@ ClearRect::ClearRect(Cel* cel, const gfx::Rect& bounds)
   if (!image)
     return;
 
-  m_offsetX = bounds.x - cel->x();
-  m_offsetY = bounds.y - cel->y();
-
-  gfx::Rect bounds2 =
+  m_bounds =
     image->bounds().createIntersection(
       gfx::Rect(
-        m_offsetX, m_offsetY,
+        bounds.x - cel->x(), bounds.y - cel->y(),
         bounds.w, bounds.h));
-  if (bounds.isEmpty())
+  if (m_bounds.isEmpty())
     return;
 
   m_dstImage.reset(new WithImage(image));
@@ -45,8 +45,8 @@ ClearRect::ClearRect(Cel* cel, const gfx::Rect& bounds)
   Doc* doc = static_cast<Doc*>(cel->document());
   m_bgcolor = doc->bgColor(cel->layer());
 
-  m_copy.reset(crop_image(image,
-      bounds2.x, bounds2.y, bounds2.w, bounds2.h, m_bgcolor));
+  save_image_region_in_buffer(gfx::Region(m_bounds), image,
+                              gfx::Point(0, 0), m_buffer.data());
 }
 
 void ClearRect::onExecute()
@@ -59,29 +59,28 @@ void ClearRect::onExecute()
 void ClearRect::onUndo()
 {
   if (m_dstImage)
-    restore();
+    swap();
   m_seq.undo();
 }
 
 void ClearRect::onRedo()
 {
   m_seq.redo();
+  // The buffer contains the cleared pixels
   if (m_dstImage)
-    clear();
+    swap();
 }
 
 void ClearRect::clear()
 {
-  fill_rect(m_dstImage->image(),
-            m_offsetX, m_offsetY,
-            m_offsetX + m_copy->width() - 1,
-            m_offsetY + m_copy->height() - 1,
-            m_bgcolor);
+  fill_rect(m_dstImage->image(), m_bounds, m_bgcolor);
 }
 
-void ClearRect::restore()
+void ClearRect::swap()
 {
-  copy_image(m_dstImage->image(), m_copy.get(), m_offsetX, m_offsetY);
+  swap_image_region_with_buffer(gfx::Region(m_bounds),
+                                m_dstImage->image(),
+                                m_buffer.data());
 }
 
 } // namespace cmd
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,8 +12,9 @@
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
 #include "app/cmd_sequence.h"
-#include "doc/image_ref.h"
-#include "gfx/fwd.h"
+#include "app/undo_buffer.h"
+#include "doc/color.h"
+#include "gfx/rect.h"
 
 #include <memory>
 
@@ -33,18 +35,28 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_seq.memSize() +
-        (m_copy ? m_copy->getMemSize(): 0);
+      return sizeof(*this) + m_seq.memSize() + m_buffer.memSize();
+    }
+    void onCompressData() override {
+      m_buffer.compress();
+    }
+    void onSwapOutData() override {
+      m_buffer.swapOut();
+    }
+    bool onIsCompressingData() const override {
+      return m_buffer.isCompressing();
     }
 
   private:
     void clear();
-    void restore();
+    void swap();
 
     CmdSequence m_seq;
     std::unique_ptr<WithImage> m_dstImage;
-    ImageRef m_copy;
-    int m_offsetX, m_offsetY;
+    // Original pixels of m_bounds (or the cleared pixels when the cmd
+    // is undone)
+    UndoBuffer m_buffer;
+    gfx::Rect m_bounds;
     color_t m_bgcolor;
   };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -16,10 +16,14 @@
 #include "app/doc.h"
 #include "doc/cels_range.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/sprite.h"
 #include "os/color_space.h"
 #include "os/system.h"
 
+#include <utility>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -37,37 +41,76 @@ static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
   }
 
   if (spec.colorMode() == doc::ColorMode::RGB) {
-    for (int y=0; y<spec.height(); ++y) {
-      conversion->convertRgba((uint32_t*)dstImage->getPixelAddress(0, y),
-                              (const uint32_t*)srcImage->getPixelAddress(0, y),
-                              spec.width());
-    }
+    doc::parallel_for(
+      spec.height(),
+      [&spec, srcImage, &dstImage, conversion](const int y){
+        conversion->convertRgba((uint32_t*)dstImage->getPixelAddress(0, y),
+                                (const uint32_t*)srcImage->getPixelAddress(0, y),
+                                spec.width());
+      });
   }
   else if (spec.colorMode() == doc::ColorMode::GRAYSCALE) {
     // TODO create a set of functions to create pixel format
     // conversions (this should be available when we add new kind of
     // pixel formats).
-    std::vector<uint8_t> buf(spec.width()*spec.height());
 
-    auto it = buf.begin();
-    for (int y=0; y<spec.height(); ++y) {
-      auto srcPtr = (const uint16_t*)srcImage->getPixelAddress(0, y);
-      for (int x=0; x<spec.width(); ++x, ++srcPtr, ++it)
-        *it = doc::graya_getv(*srcPtr);
-    }
+    // Convert all gray levels once
+    uint8_t levels[256];
+    for (int v=0; v<256; ++v)
+      levels[v] = v;
+    conversion->convertGray(levels, levels, 256);
+
+    doc::parallel_for(
+      spec.height(),
+      [&spec, srcImage, &dstImage, &levels](const int y){
+        auto srcPtr = (const uint16_t*)srcImage->getPixelAddress(0, y);
+        auto dstPtr = (uint16_t*)dstImage->getPixelAddress(0, y);
+        for (int x=0; x<spec.width(); ++x, ++dstPtr, ++srcPtr) {
+          *dstPtr = doc::graya(levels[doc::graya_getv(*srcPtr)],
+                               doc::graya_geta(*srcPtr));
+        }
+      });
+  }
 
-    conversion->convertGray(&buf[0], &buf[0], spec.width()*spec.height());
+  return dstImage;
+}
 
-    it = buf.begin();
-    for (int y=0; y<spec.height(); ++y) {
-      auto srcPtr = (const uint16_t*)srcImage->getPixelAddress(0, y);
-      auto dstPtr = (uint16_t*)dstImage->getPixelAddress(0, y);
-      for (int x=0; x<spec.width(); ++x, ++dstPtr, ++srcPtr, ++it)
-        *dstPtr = doc::graya(*it, doc::graya_geta(*srcPtr));
-    }
+static void convert_palette_color_space(const doc::Palette* srcPal,
+                                        doc::Palette* dstPal,
+                                        os::ColorSpaceConversion* conversion)
+{
+  for (int i=0; i<srcPal->size(); ++i) {
+    color_t oldCol = srcPal->entry(i);
+    color_t newCol = oldCol;
+    conversion->convertRgba((uint32_t*)&newCol,
+                            (const uint32_t*)&oldCol, 1);
+    dstPal->setEntry(i, newCol);
   }
+}
 
-  return dstImage;
+// Converts the images of all cels in parallel (cels are
+// independent). Returns the pairs of old/new images in the same
+// order of sprite->uniqueCels().
+static std::vector<std::pair<ImageRef, ImageRef>>
+convert_cel_images_color_space(const doc::Sprite* sprite,
+                               const gfx::ColorSpaceRef& newCS,
+                               os::ColorSpaceConversion* conversion)
+{
+  std::vector<std::pair<ImageRef, ImageRef>> images;
+  for (Cel* cel : sprite->uniqueCels()) {
+    ImageRef oldImage = cel->imageRef();
+    if (oldImage->pixelFormat() != IMAGE_TILEMAP)
+      images.emplace_back(oldImage, nullptr);
+  }
+
+  doc::parallel_for(
+    int(images.size()),
+    [&images, &newCS, conversion](const int i){
+      images[i].second = convert_image_color_space(
+        images[i].first.get(), newCS, conversion);
+    });
+
+  return images;
 }
 
 void convert_color_profile(doc::Sprite* sprite,
@@ -86,14 +129,9 @@ void convert_color_profile(doc::Sprite* sprite,
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
-        sprite->replaceImage(old_image->id(), new_image);
-      }
+    for (const auto& images :
+           convert_cel_images_color_space(sprite, newCS, conversion.get())) {
+      sprite->replaceImage(images.first->id(), images.second);
     }
   }
 
@@ -102,14 +140,7 @@ void convert_color_profile(doc::Sprite* sprite,
     if (sprite->pixelFormat() != doc::IMAGE_GRAYSCALE) {
       for (auto& pal : sprite->getPalettes()) {
         Palette newPal(pal->frame(), pal->size());
-
-        for (int i=0; i<pal->size(); ++i) {
-          color_t oldCol = pal->entry(i);
-          color_t newCol = pal->entry(i);
-          conversion->convertRgba((uint32_t*)&newCol,
-                                  (const uint32_t*)&oldCol, 1);
-          newPal.setEntry(i, newCol);
-        }
+        convert_palette_color_space(pal, &newPal, conversion.get());
 
         if (*pal != newPal)
           sprite->setPalette(&newPal, false);
@@ -149,16 +180,9 @@ void convert_color_profile(doc::Image* image,
         break;
       }
 
-      case doc::IMAGE_INDEXED: {
-        for (int i=0; i<palette->size(); ++i) {
-          color_t oldCol, newCol;
-          oldCol = newCol = palette->entry(i);
-          conversion->convertRgba((uint32_t*)&newCol,
-                                  (const uint32_t*)&oldCol, 1);
-          palette->setEntry(i, newCol);
-        }
+      case doc::IMAGE_INDEXED:
+        convert_palette_color_space(palette, palette, conversion.get());
         break;
-      }
     }
   }
 }
@@ -181,14 +205,9 @@ ConvertColorProfile::ConvertColorProfile(doc::Sprite* sprite, const gfx::ColorSp
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
-        m_seq.add(new cmd::ReplaceImage(sprite, old_image, new_image));
-      }
+    for (const auto& images :
+           convert_cel_images_color_space(sprite, newCS, conversion.get())) {
+      m_seq.add(new cmd::ReplaceImage(sprite, images.first, images.second));
     }
   }
 
@@ -197,14 +216,7 @@ ConvertColorProfile::ConvertColorProfile(doc::Sprite* sprite, const gfx::ColorSp
     if (sprite->pixelFormat() != doc::IMAGE_GRAYSCALE) {
       for (auto& pal : sprite->getPalettes()) {
         Palette newPal(pal->frame(), pal->size());
-
-        for (int i=0; i<pal->size(); ++i) {
-          color_t oldCol = pal->entry(i);
-          color_t newCol = pal->entry(i);
-          conversion->convertRgba((uint32_t*)&newCol,
-                                  (const uint32_t*)&oldCol, 1);
-          newPal.setEntry(i, newCol);
-        }
+        convert_palette_color_space(pal, &newPal, conversion.get());
 
         if (*pal != newPal)
           m_seq.add(new cmd::SetPalette(sprite, pal->frame(), &newPal));
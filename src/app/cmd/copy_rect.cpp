@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +14,7 @@
 #include "doc/image.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace app {
 namespace cmd {
@@ -26,12 +28,13 @@ CopyRect::CopyRect(Image* dst, const Image* src, const gfx::Clip& clip)
         src->width(), src->height()))
     return;
 
-  // Fill m_data with "src" data
+  // Fill m_buffer with "src" data
 
   int lineSize = src->getRowStrideSize(m_clip.size.w);
-  m_data.resize(lineSize * m_clip.size.h);
+  base::buffer& data = m_buffer.data();
+  data.resize(lineSize * m_clip.size.h);
 
-  auto it = m_data.begin();
+  auto it = data.begin();
   for (int v=0; v<m_clip.size.h; ++v) {
     uint8_t* addr = src->getPixelAddress(
       m_clip.dst.x, m_clip.dst.y+v);
@@ -65,7 +68,7 @@ void CopyRect::swap()
   int lineSize = this->lineSize();
   std::vector<uint8_t> tmp(lineSize);
 
-  auto it = m_data.begin();
+  auto it = m_buffer.data().begin();
   for (int v=0; v<m_clip.size.h; ++v) {
     uint8_t* addr = image->getPixelAddress(
       m_clip.dst.x, m_clip.dst.y+v);
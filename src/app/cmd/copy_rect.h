@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,10 +11,9 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/undo_buffer.h"
 #include "gfx/clip.h"
 
-#include <vector>
-
 namespace doc {
   class Image;
 }
@@ -32,7 +32,16 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_data.size();
+      return sizeof(*this) + m_buffer.memSize();
+    }
+    void onCompressData() override {
+      m_buffer.compress();
+    }
+    void onSwapOutData() override {
+      m_buffer.swapOut();
+    }
+    bool onIsCompressingData() const override {
+      return m_buffer.isCompressing();
     }
 
   private:
@@ -40,7 +49,7 @@ namespace cmd {
     int lineSize();
 
     gfx::Clip m_clip;
-    std::vector<uint8_t> m_data;
+    UndoBuffer m_buffer;
   };
 
 } // namespace cmd
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -35,15 +35,18 @@ ReplaceImage::ReplaceImage(Sprite* sprite, const ImageRef& oldImage, const Image
 
 void ReplaceImage::onExecute()
 {
-  // Save old image in m_copy. We cannot keep an ImageRef to this
-  // image, because there are other undo branches that could try to
-  // modify/re-add this same image ID
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
-  m_copy.reset(Image::createCopy(oldImage.get()));
 
   replaceImage(m_oldImageId, m_newImage);
   m_newImage.reset();
+
+  // Save old image in m_copy. We cannot keep an ImageRef to this
+  // image, because there are other undo branches that could try to
+  // modify/re-add this same image ID. If nobody else references the
+  // old image, its pixels are moved to the copy (without copying
+  // them).
+  m_copy.reset(Image::createCopy(std::move(oldImage)));
 }
 
 void ReplaceImage::onUndo()
@@ -54,7 +57,7 @@ void ReplaceImage::onUndo()
   m_copy->setId(m_oldImageId);
 
   replaceImage(m_newImageId, m_copy);
-  m_copy.reset(Image::createCopy(newImage.get()));
+  m_copy.reset(Image::createCopy(std::move(newImage)));
 }
 
 void ReplaceImage::onRedo()
@@ -65,7 +68,7 @@ void ReplaceImage::onRedo()
   m_copy->setId(m_newImageId);
 
   replaceImage(m_oldImageId, m_copy);
-  m_copy.reset(Image::createCopy(oldImage.get()));
+  m_copy.reset(Image::createCopy(std::move(oldImage)));
 }
 
 void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
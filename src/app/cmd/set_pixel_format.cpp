@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,12 +22,19 @@
 #include "doc/document.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "doc/tilesets.h"
 #include "render/quantization.h"
 #include "render/task_delegate.h"
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -35,35 +42,67 @@ using namespace doc;
 
 namespace {
 
-class SuperDelegate : public render::TaskDelegate {
+// Image to convert (a cel image or a tile)
+struct ConvertItem {
+  ImageRef oldImage;
+  frame_t frame;
+  bool isBackground;
+  ImageRef newImage;
+};
+
+// Combines the progress of all images that are being converted in
+// parallel. It's thread-safe, calls to the given delegate are
+// serialized.
+class SuperDelegate {
 public:
   SuperDelegate(int nimages, render::TaskDelegate* delegate)
-    : m_nimages(nimages)
-    , m_curImage(0)
+    : m_progress(nimages, 0.0)
+    , m_total(0.0)
     , m_delegate(delegate) {
   }
 
-  void notifyTaskProgress(double progress) override {
+  void notifyImageProgress(int i, double progress) {
+    std::lock_guard lock(m_mutex);
+    m_total += progress - m_progress[i];
+    m_progress[i] = progress;
     if (m_delegate)
-      m_delegate->notifyTaskProgress(
-        (progress + m_curImage) / m_nimages);
+      m_delegate->notifyTaskProgress(m_total / m_progress.size());
   }
 
-  bool continueTask() override {
+  bool continueTask() {
+    std::lock_guard lock(m_mutex);
     if (m_delegate)
       return m_delegate->continueTask();
     else
       return true;
   }
 
-  void nextImage() {
-    ++m_curImage;
+private:
+  std::mutex m_mutex;
+  std::vector<double> m_progress;
+  double m_total;
+  render::TaskDelegate* m_delegate;
+};
+
+// Delegate for the conversion of one image.
+class ImageDelegate : public render::TaskDelegate {
+public:
+  ImageDelegate(SuperDelegate* superDel, int i)
+    : m_superDel(superDel)
+    , m_i(i) {
+  }
+
+  void notifyTaskProgress(double progress) override {
+    m_superDel->notifyImageProgress(m_i, progress);
+  }
+
+  bool continueTask() override {
+    return m_superDel->continueTask();
   }
 
 private:
-  int m_nimages;
-  int m_curImage;
-  TaskDelegate* m_delegate;
+  SuperDelegate* m_superDel;
+  int m_i;
 };
 
 } // anonymous namespace
@@ -81,39 +120,14 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   if (sprite->pixelFormat() == newFormat)
     return;
 
-  // Calculate the number of images to convert just to show a proper
-  // progress bar.
-  tile_index nimages = 0;
-  for (Cel* cel : sprite->uniqueCels())
-    if (!cel->layer()->isTilemap())
-      ++nimages;
-  if (sprite->hasTilesets()) {
-    for (Tileset* tileset : *sprite->tilesets()) {
-      if (tileset)
-        nimages += tileset->size();
-    }
-  }
-
-  SuperDelegate superDel(nimages, delegate);
-
-  // Convert cel images
+  // Collect all images to convert (cel images and tiles)
+  std::vector<ConvertItem> items;
   for (Cel* cel : sprite->uniqueCels()) {
-    if (cel->layer()->isTilemap())
-      continue;
-
-    ImageRef oldImage = cel->imageRef();
-    convertImage(sprite, dithering,
-                 oldImage,
-                 cel->frame(),
-                 cel->layer()->isBackground(),
-                 mapAlgorithm,
-                 toGray,
-                 &superDel);
-
-    superDel.nextImage();
+    if (!cel->layer()->isTilemap())
+      items.push_back({ cel->imageRef(),
+                        cel->frame(),
+                        cel->layer()->isBackground() });
   }
-
-  // Convert tileset images
   if (sprite->hasTilesets()) {
     for (Tileset* tileset : *sprite->tilesets()) {
       if (!tileset)
@@ -122,19 +136,51 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
       for (tile_index i=0; i<tileset->size(); ++i) {
         ImageRef oldImage = tileset->get(i);
         if (oldImage) {
-          convertImage(sprite, dithering,
-                       oldImage,
-                       0,     // TODO select a frame or generate other tilesets?
-                       false, // TODO is background? it depends of the layer where this tileset is used
-                       mapAlgorithm,
-                       toGray,
-                       &superDel);
+          items.push_back({ oldImage,
+                            0,        // TODO select a frame or generate other tilesets?
+                            false }); // TODO is background? it depends of the layer where this tileset is used
         }
-        superDel.nextImage();
       }
     }
   }
 
+  // Convert the images in parallel. Each worker takes the next image
+  // to convert and uses its own RgbMap (RgbMaps cache best fit
+  // colors lazily, so they cannot be shared between threads).
+  SuperDelegate superDel(int(items.size()), delegate);
+  std::atomic<int> next(0);
+  parallel_for(
+    std::min(parallel_concurrency(), int(items.size())),
+    [this, sprite, &dithering, mapAlgorithm, toGray,
+     &items, &next, &superDel](int){
+      std::unique_ptr<RgbMap> rgbmap;
+      if (m_newFormat == IMAGE_INDEXED)
+        rgbmap = Sprite::createRgbMap(mapAlgorithm);
+
+      for (int i=next++; i<int(items.size()); i=next++) {
+        if (!superDel.continueTask())
+          break;
+
+        ConvertItem& item = items[i];
+        ImageDelegate imageDel(&superDel, i);
+        item.newImage = convertImage(sprite, dithering,
+                                     item.oldImage,
+                                     item.frame,
+                                     item.isBackground,
+                                     rgbmap.get(),
+                                     toGray,
+                                     &imageDel);
+        superDel.notifyImageProgress(i, 1.0);
+      }
+    });
+
+  // Add the cmds in the same order of the images (so the undo
+  // history doesn't depend on the conversion order).
+  for (const ConvertItem& item : items) {
+    if (item.newImage)
+      m_seq.add(new cmd::ReplaceImage(sprite, item.oldImage, item.newImage));
+  }
+
   // Set all cels opacity to 100% if we are converting to indexed.
   // TODO remove this
   if (newFormat == IMAGE_INDEXED) {
@@ -201,24 +247,23 @@ void SetPixelFormat::setFormat(PixelFormat format)
   doc->notify_observers<DocEvent&>(&DocObserver::onPixelFormatChanged, ev);
 }
 
-void SetPixelFormat::convertImage(doc::Sprite* sprite,
-                                  const render::Dithering& dithering,
-                                  const doc::ImageRef& oldImage,
-                                  const doc::frame_t frame,
-                                  const bool isBackground,
-                                  const doc::RgbMapAlgorithm mapAlgorithm,
-                                  doc::rgba_to_graya_func toGray,
-                                  render::TaskDelegate* delegate)
+ImageRef SetPixelFormat::convertImage(const doc::Sprite* sprite,
+                                      const render::Dithering& dithering,
+                                      const doc::ImageRef& oldImage,
+                                      const doc::frame_t frame,
+                                      const bool isBackground,
+                                      doc::RgbMap* rgbmap,
+                                      doc::rgba_to_graya_func toGray,
+                                      render::TaskDelegate* delegate) const
 {
   ASSERT(oldImage);
   ASSERT(oldImage->pixelFormat() != IMAGE_TILEMAP);
 
   // Making the RGBMap for Image->INDEXDED conversion.
-  // TODO: this is needed only when newImage
-  RgbMap* rgbmap;
   int newMaskIndex = (isBackground ? -1 : 0);
   if (m_newFormat == IMAGE_INDEXED) {
-    rgbmap = sprite->rgbMap(frame, sprite->rgbMapForSprite(), mapAlgorithm);
+    ASSERT(rgbmap);
+    sprite->regenerateRgbMap(rgbmap, frame, sprite->rgbMapForSprite());
     if (m_oldFormat == IMAGE_INDEXED)
       newMaskIndex = sprite->transparentColor();
     else
@@ -227,7 +272,7 @@ void SetPixelFormat::convertImage(doc::Sprite* sprite,
   else {
     rgbmap = nullptr;
   }
-  ImageRef newImage(
+  return ImageRef(
     render::convert_pixel_format
     (oldImage.get(), nullptr, m_newFormat,
      dithering,
@@ -237,8 +282,6 @@ void SetPixelFormat::convertImage(doc::Sprite* sprite,
      newMaskIndex,
      toGray,
      delegate));
-
-  m_seq.add(new cmd::ReplaceImage(sprite, oldImage, newImage));
 }
 
 } // namespace cmd
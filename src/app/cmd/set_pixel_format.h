@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "doc/rgbmap_algorithm.h"
 
 namespace doc {
+  class RgbMap;
   class Sprite;
 }
 
@@ -49,14 +50,14 @@ namespace cmd {
 
   private:
     void setFormat(doc::PixelFormat format);
-    void convertImage(doc::Sprite* sprite,
-                      const render::Dithering& dithering,
-                      const doc::ImageRef& oldImage,
-                      const doc::frame_t frame,
-                      const bool isBackground,
-                      const doc::RgbMapAlgorithm mapAlgorithm,
-                      doc::rgba_to_graya_func toGray,
-                      render::TaskDelegate* delegate);
+    doc::ImageRef convertImage(const doc::Sprite* sprite,
+                               const render::Dithering& dithering,
+                               const doc::ImageRef& oldImage,
+                               const doc::frame_t frame,
+                               const bool isBackground,
+                               doc::RgbMap* rgbmap,
+                               doc::rgba_to_graya_func toGray,
+                               render::TaskDelegate* delegate) const;
 
     doc::PixelFormat m_oldFormat;
     doc::PixelFormat m_newFormat;
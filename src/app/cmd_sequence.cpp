@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -80,6 +80,27 @@ size_t CmdSequence::onMemSize() const
   return size;
 }
 
+void CmdSequence::onCompressData()
+{
+  for (Cmd* cmd : m_cmds)
+    cmd->compressData();
+}
+
+void CmdSequence::onSwapOutData()
+{
+  for (Cmd* cmd : m_cmds)
+    cmd->swapOutData();
+}
+
+bool CmdSequence::onIsCompressingData() const
+{
+  for (const Cmd* cmd : m_cmds) {
+    if (cmd->isCompressingData())
+      return true;
+  }
+  return false;
+}
+
 void CmdSequence::executeAndAdd(Cmd* cmd)
 {
   addAndExecute(context(), cmd);
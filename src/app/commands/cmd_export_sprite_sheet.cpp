@@ -259,6 +259,11 @@ Doc* generate_sprite_sheet_from_params(
   if (listTags) exporter.setListTags(true);
   if (listSlices) exporter.setListSlices(true);
 
+  // If the generated texture is not going to be opened, we can
+  // stream it directly to the file.
+  if (saveData && !params.openGenerated())
+    exporter.setStreamTexture(true);
+
   // We have to call exportSheet() while RestoreVisibleLayers is still
   // alive. In this way we can export selected layers correctly if
   // that option (kSelectedLayers) is selected.
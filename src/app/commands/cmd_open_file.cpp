@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -78,6 +78,7 @@ OpenFileCommand::OpenFileCommand()
   : Command(CommandId::OpenFile(), CmdRecordableFlag)
   , m_repeatCheckbox(false)
   , m_oneFrame(false)
+  , m_progressive(false)
   , m_seqDecision(gen::SequenceDecision::ASK)
 {
 }
@@ -88,6 +89,7 @@ void OpenFileCommand::onLoadParams(const Params& params)
   m_folder = params.get("folder"); // Initial folder
   m_repeatCheckbox = params.get_as<bool>("repeat_checkbox");
   m_oneFrame = params.get_as<bool>("oneframe");
+  m_progressive = params.get_as<bool>("progressive");
 
   std::string sequence = params.get("sequence");
   if (m_oneFrame ||
@@ -175,6 +177,12 @@ void OpenFileCommand::onExecute(Context* context)
   if (m_oneFrame)
     flags |= FILE_LOAD_ONE_FRAME;
 
+  // Show big files as soon as possible, while their cel images are
+  // loaded in background (only when the user opens files from the
+  // UI, other callers need all the pixels after the command ends)
+  if (m_progressive && context->isUIAvailable())
+    flags |= FILE_LOAD_PROGRESSIVE;
+
   std::string filename;
   while (!filenames.empty()) {
     filename = filenames[0];
@@ -250,6 +258,11 @@ void OpenFileCommand::onExecute(Context* context)
           }
         }
 
+        // Continue loading the cel images in background (the
+        // document is read-only until they are ready)
+        if (auto decoder = fop->releaseCelImagesDecoder())
+          doc->loadCelImagesInBackground(std::move(decoder));
+
         doc->setContext(context);
       }
       else if (!fop->isStop())
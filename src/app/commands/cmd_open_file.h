@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2021  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -38,6 +38,7 @@ namespace app {
     std::string m_folder;
     bool m_repeatCheckbox;
     bool m_oneFrame;
+    bool m_progressive;
     base::paths m_usedFiles;
     gen::SequenceDecision m_seqDecision;
   };
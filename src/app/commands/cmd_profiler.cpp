@@ -0,0 +1,91 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/commands/command.h"
+#include "app/commands/params.h"
+#include "app/file_selector.h"
+#include "app/i18n/strings.h"
+#include "fmt/format.h"
+#include "prof/prof.h"
+#include "ui/alert.h"
+#include "ui/manager.h"
+
+namespace app {
+
+// Shows/hides the frame-time graph, or saves the events recorded by
+// the profiler in the Chrome trace format (save=true).
+class ProfilerCommand : public Command {
+public:
+  ProfilerCommand();
+
+protected:
+  bool onNeedsParams() const override { return true; }
+  void onLoadParams(const Params& params) override;
+  void onExecute(Context* context) override;
+  bool onChecked(Context* context) override;
+  std::string onGetFriendlyName() const override;
+
+private:
+  bool m_save;
+};
+
+ProfilerCommand::ProfilerCommand()
+  : Command(CommandId::Profiler(), CmdUIOnlyFlag)
+  , m_save(false)
+{
+}
+
+void ProfilerCommand::onLoadParams(const Params& params)
+{
+  m_save = params.get_as<bool>("save");
+}
+
+void ProfilerCommand::onExecute(Context* context)
+{
+  ui::Manager* manager = ui::Manager::getDefault();
+  if (!manager)
+    return;
+
+  if (!m_save) {
+    manager->setShowFrameTimes(!manager->showFrameTimes());
+    return;
+  }
+
+  base::paths exts = { "json" };
+  base::paths selFilename;
+  if (!app::show_file_selector(Strings::commands_Profiler_Save(), "",
+                               exts, FileSelectorType::Save, selFilename))
+    return;
+
+  const std::string filename = selFilename.front();
+  if (!prof::save_chrome_trace(filename))
+    ui::Alert::show(fmt::format(Strings::alerts_error_saving_file(), filename));
+}
+
+bool ProfilerCommand::onChecked(Context* context)
+{
+  ui::Manager* manager = ui::Manager::getDefault();
+  return (!m_save && manager && manager->showFrameTimes());
+}
+
+std::string ProfilerCommand::onGetFriendlyName() const
+{
+  if (m_save)
+    return Strings::commands_Profiler_Save();
+  else
+    return Strings::commands_Profiler();
+}
+
+Command* CommandFactory::createProfilerCommand()
+{
+  return new ProfilerCommand;
+}
+
+} // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -201,6 +201,25 @@ void SaveFileBaseCommand::saveDocumentInBackground(
   const ResizeOnTheFly resizeOnTheFly,
   const gfx::PointF& scale)
 {
+  // We cannot save the sprite until all its cel images are loaded
+  if (document->isLoading()) {
+#ifdef ENABLE_UI
+    if (context->isUIAvailable())
+      ui::Alert::show(Strings::alerts_cannot_save_while_loading());
+#endif
+    return;
+  }
+
+  // We cannot save a sprite with cel images that couldn't be loaded
+  // (we would replace the original file with empty cels)
+  if (document->isLoadingFailed()) {
+#ifdef ENABLE_UI
+    if (context->isUIAvailable())
+      ui::Alert::show(Strings::alerts_cannot_save_incomplete_sprite());
+#endif
+    return;
+  }
+
 #ifdef ENABLE_UI
   // If the document is read only, we cannot save it directly (we have
   // to use File > Save As)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -132,6 +132,7 @@ FOR_EACH_COMMAND(PasteText)
 FOR_EACH_COMMAND(PixelPerfectMode)
 FOR_EACH_COMMAND(PlayAnimation)
 FOR_EACH_COMMAND(PlayPreviewAnimation)
+FOR_EACH_COMMAND(Profiler)
 FOR_EACH_COMMAND(Refresh)
 FOR_EACH_COMMAND(Register)
 FOR_EACH_COMMAND(RemoveFrame)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,6 +24,7 @@
 
 #include <cstdarg>
 #include <cstdio>
+#include <iostream>
 #include <memory>
 
 #define TRACE_CON(...) // TRACEARGS(__VA_ARGS__)
@@ -248,9 +249,10 @@ void Console::printf(const char* format, ...)
   std::string msg = base::string_vprintf(format, ap);
   va_end(ap);
 
+  // Printed in std::cout (instead of stdout) so the output can be
+  // captured with std::cout.rdbuf() (e.g. in CliService jobs).
   if (!m_withUI) {
-    fputs(msg.c_str(), stdout);
-    fflush(stdout);
+    std::cout << msg << std::flush;
     return;
   }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,16 +14,21 @@
 #include "app/app.h"
 #include "app/color_target.h"
 #include "app/color_utils.h"
+#include "app/console.h"
 #include "app/context.h"
 #include "app/context.h"
 #include "app/doc_api.h"
 #include "app/doc_event.h"
 #include "app/doc_observer.h"
 #include "app/doc_undo.h"
+#include "app/file/file.h"
 #include "app/file/format_options.h"
 #include "app/flatten.h"
 #include "app/pref/preferences.h"
+#include "app/task.h"
 #include "app/util/cel_ops.h"
+#include "base/chrono.h"
+#include "base/log.h"
 #include "base/memory.h"
 #include "doc/cel.h"
 #include "doc/layer.h"
@@ -36,10 +41,13 @@
 #include "doc/tag.h"
 #include "os/system.h"
 #include "os/window.h"
+#include "render/onionskin_cache.h"
 #include "ui/system.h"
 
 #include <limits>
 #include <map>
+#include <utility>
+#include <vector>
 
 #define DOC_TRACE(...) // TRACEARGS
 
@@ -48,6 +56,10 @@ namespace app {
 using namespace base;
 using namespace doc;
 
+// Decoded cel images are put in the sprite (and the UI is updated)
+// each this number of seconds.
+static const double kCelImagesLoadingPeriod = 0.1;
+
 Doc::Doc(Sprite* sprite)
   : m_ctx(nullptr)
   , m_flags(kMaskVisible)
@@ -71,6 +83,17 @@ Doc::Doc(Sprite* sprite)
 Doc::~Doc()
 {
   DOC_TRACE("DOC: Deleting", this);
+
+  // Stop loading cel images (the decoder references our cels)
+  if (m_loadingTask) {
+    m_loadingTask->cancel();
+    m_loadingTask->wait();
+  }
+
+  // Discard the cached onionskin frames of the sprite
+  if (sprite())
+    render::OnionskinCache::instance()->remove(sprite()->id());
+
   removeFromContext();
 }
 
@@ -353,7 +376,7 @@ void Doc::markAsReadOnly()
 
 bool Doc::isReadOnly() const
 {
-  return (m_flags & kReadOnly ? true: false);
+  return (m_flags & (kReadOnly | kLoading | kLoadingFailed) ? true: false);
 }
 
 void Doc::removeReadOnlyMark()
@@ -363,6 +386,109 @@ void Doc::removeReadOnlyMark()
   m_flags &= ~kReadOnly;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Progressive loading
+
+void Doc::loadCelImagesInBackground(std::unique_ptr<CelImagesDecoder>&& decoder)
+{
+  ASSERT(!m_loadingTask);
+  DOC_TRACE("DOC: Loading cel images in background", this);
+
+  m_celImagesDecoder = std::move(decoder);
+  m_loadingTask = std::make_unique<Task>();
+  m_flags |= kLoading;
+
+  const ObjectId docId = id();
+  m_loadingTask->run(
+    [this, docId](base::task_token& token){
+      std::vector<std::pair<Cel*, ImageRef>> images;
+
+      // Replaces the empty images of the decoded cels. The document
+      // is locked just to swap the images (to avoid blocking the UI).
+      auto setImages = [this, docId, &images, &token]() -> bool {
+        while (!writeLock(100)) {
+          if (token.canceled())
+            return false;
+        }
+        for (auto& [cel, image] : images)
+          cel->data()->setImage(image, cel->layer());
+        unlock();
+        images.clear();
+
+        ui::execute_from_ui_thread([docId]{
+          if (auto doc = doc::get<Doc>(docId))
+            doc->notifyGeneralUpdate();
+        });
+        return true;
+      };
+
+      std::string errors;
+      try {
+        base::Chrono chrono;
+        Cel* cel;
+        ImageRef image;
+        while (!token.canceled() &&
+               m_celImagesDecoder->decodeNext(cel, image)) {
+          images.emplace_back(cel, image);
+          token.set_progress(m_celImagesDecoder->progress());
+
+          if (chrono.elapsed() >= kCelImagesLoadingPeriod) {
+            if (!setImages())
+              return;
+            chrono.reset();
+          }
+        }
+      }
+      catch (const std::exception& ex) {
+        LOG(ERROR, "DOC: Error loading cel images: %s\n", ex.what());
+        errors = ex.what();
+      }
+      if (errors.empty())
+        errors = m_celImagesDecoder->errors();
+
+      if (token.canceled() || !setImages())
+        return;
+
+      ui::execute_from_ui_thread([docId, errors]{
+        if (auto doc = doc::get<Doc>(docId))
+          doc->onCelImagesLoaded(errors);
+      });
+    });
+}
+
+bool Doc::isLoading() const
+{
+  return (m_flags & kLoading ? true: false);
+}
+
+bool Doc::isLoadingFailed() const
+{
+  return (m_flags & kLoadingFailed ? true: false);
+}
+
+void Doc::onCelImagesLoaded(const std::string& errors)
+{
+  DOC_TRACE("DOC: Cel images loaded", this);
+
+  m_flags &= ~kLoading;
+  if (!errors.empty()) {
+    m_flags |= kLoadingFailed;
+
+    Console console;
+    console.printf("Error loading cel images of %s:\n%s\n",
+                   name().c_str(), errors.c_str());
+  }
+
+  // Close the file now (the task doesn't use the decoder anymore)
+  m_celImagesDecoder.reset();
+
+  notifyGeneralUpdate();
+#ifdef ENABLE_UI
+  if (App::instance()->isGui())
+    App::instance()->updateDisplayTitleBar();
+#endif
+}
+
 //////////////////////////////////////////////////////////////////////
 // Loaded options from file
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -44,9 +44,11 @@ namespace gfx {
 
 namespace app {
 
+  class CelImagesDecoder;
   class Context;
   class DocApi;
   class DocUndo;
+  class Task;
   class Transaction;
 
   using namespace doc;
@@ -66,6 +68,8 @@ namespace app {
       kInhibitBackup    = 4, // Inhibit the backup process
       kFullyBackedUp    = 8, // Full backup was done
       kReadOnly         = 16,// This document is read-only
+      kLoading          = 32,// Cel images are being loaded in background
+      kLoadingFailed    = 64,// Some cel images couldn't be loaded
     };
   public:
     Doc(Sprite* sprite);
@@ -156,10 +160,30 @@ namespace app {
     //      data. If in the future we want to add the possibility to
     //      mark a regular file as read-only, this flag'll need a new
     //      name.
+    //
+    // A document is read-only too while its cel images are being
+    // loaded (see isLoading()), or if they couldn't be loaded (see
+    // isLoadingFailed()).
     void markAsReadOnly();
     bool isReadOnly() const;
     void removeReadOnlyMark();
 
+    //////////////////////////////////////////////////////////////////////
+    // Progressive loading
+
+    // Decodes the remaining cel images of a document loaded with
+    // FILE_LOAD_PROGRESSIVE in a background thread. Cels are
+    // displayed with empty images until their real images are ready.
+    void loadCelImagesInBackground(std::unique_ptr<CelImagesDecoder>&& decoder);
+
+    // Returns true if the cel images are still being loaded.
+    bool isLoading() const;
+
+    // Returns true if some cel images couldn't be loaded (e.g. the
+    // file is truncated or corrupted). The document cannot be saved
+    // as it would replace the original file with empty cels.
+    bool isLoadingFailed() const;
+
     //////////////////////////////////////////////////////////////////////
     // Loaded options from file
 
@@ -242,6 +266,7 @@ namespace app {
   private:
     void removeFromContext();
     void updateOSColorSpace(bool appWideSignal);
+    void onCelImagesLoaded(const std::string& errors);
 
     // The document is in the collection of documents of this context.
     Context* m_ctx;
@@ -279,6 +304,10 @@ namespace app {
     // Last used color space to render a sprite.
     os::ColorSpaceRef m_osColorSpace;
 
+    // Background task to load cel images (progressive loading).
+    std::unique_ptr<CelImagesDecoder> m_celImagesDecoder;
+    std::unique_ptr<Task> m_loadingTask;
+
     DISABLE_COPYING(Doc);
   };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,8 +16,9 @@
 #include "app/context.h"
 #include "app/doc.h"
 #include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
 #include "app/filename_formatter.h"
-#include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
 #include "app/util/autocrop.h"
 #include "base/convert_to.h"
@@ -25,6 +26,7 @@
 #include "base/fstream_path.h"
 #include "base/replace_string.h"
 #include "base/string.h"
+#include "dio/detect_format.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
@@ -153,6 +155,7 @@ public:
          Sprite* sprite,
          const ImageRef& image,
          SelectedLayers* selLayers,
+         const SelectedLayers* visibleLayers,
          frame_t frame,
          const Tag* tag,
          const std::string& filename,
@@ -162,6 +165,7 @@ public:
     m_sprite(sprite),
     m_image(image),
     m_selLayers(selLayers),
+    m_visibleLayers(visibleLayers),
     m_frame(frame),
     m_tag(tag),
     m_filename(filename),
@@ -253,13 +257,12 @@ public:
     return render;
   }
 
+  // This can be called from a background thread (to render bands of
+  // the texture), so the layers to render are given to the
+  // render::Render instead of changing the visibility of the layers.
   void renderSample(doc::Image* dst, int x, int y, bool extrude) const {
-    RestoreVisibleLayers layersVisibility;
-    if (m_selLayers)
-      layersVisibility.showSelectedLayers(m_sprite,
-                                          *m_selLayers);
-
     render::Render render;
+    render.setVisibleLayers(m_visibleLayers);
 
     // 1) We cannot use the Preferences because this is called from a non-UI thread
     // 2) We should use the new blend mode always when we're saving files
@@ -314,6 +317,7 @@ private:
   // (e.g. like a Tileset tile image) this can be != nullptr.
   ImageRef m_image;
   SelectedLayers* m_selLayers;
+  const SelectedLayers* m_visibleLayers;
   frame_t m_frame;
   const Tag* m_tag;
   std::string m_filename;
@@ -623,6 +627,7 @@ void DocExporter::reset()
   m_listTags = false;
   m_listLayers = false;
   m_listSlices = false;
+  m_streamTexture = false;
   m_documents.clear();
 }
 
@@ -682,18 +687,25 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
     return nullptr;
   token.set_progress(0.4f);
 
-  // 3) Create and render the texture.
+  // 3) Create and render the texture. If we can stream the
+  // texture, it will be rendered by bands when it's saved.
+  const bool streamTexture = (m_streamTexture && canStreamTexture());
   std::unique_ptr<Doc> textureDocument(
-    createEmptyTexture(samples, token));
+    createEmptyTexture(samples, !streamTexture, token));
   if (token.canceled())
     return nullptr;
   token.set_progress(0.6f);
 
   Sprite* texture = textureDocument->sprite();
-  Image* textureImage = texture->root()->firstLayer()
-    ->cel(frame_t(0))->image();
+  if (streamTexture) {
+    convertSamplesPixelFormat(ctx, samples, texture->pixelFormat());
+  }
+  else {
+    Image* textureImage = texture->root()->firstLayer()
+      ->cel(frame_t(0))->image();
 
-  renderTexture(ctx, samples, textureImage, token);
+    renderTexture(ctx, samples, textureImage, token);
+  }
   if (token.canceled())
     return nullptr;
   token.set_progress(0.8f);
@@ -712,7 +724,16 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   if (!m_textureFilename.empty()) {
     DX_TRACE("DX: exportSheet", m_textureFilename);
     textureDocument->setFilename(m_textureFilename.c_str());
-    int ret = save_document(ctx, textureDocument.get());
+
+    FileOp::RenderRowsFunc renderRows;
+    if (streamTexture) {
+      renderRows = [this, &samples](Image* dst, const frame_t,
+                                    const gfx::Rect& area) {
+        renderTextureRows(samples, dst, area);
+      };
+    }
+
+    int ret = save_document(ctx, textureDocument.get(), renderRows);
     if (ret == 0)
       textureDocument->markAsSaved();
   }
@@ -894,6 +915,11 @@ void DocExporter::captureSamples(Samples& samples,
     const Tag* tag = item.tag;
     int frames = item.frames();
 
+    if (item.selLayers) {
+      item.visibleLayers = std::make_unique<SelectedLayers>(*item.selLayers);
+      item.visibleLayers->propagateSelection();
+    }
+
     DX_TRACE("DX: - Item:", doc->filename(),
              "Frames:", frames,
              "Layer:", layer ? layer->name(): "-",
@@ -966,6 +992,7 @@ void DocExporter::captureSamples(Samples& samples,
          item.splitGrid ? sprite->gridBounds().size():
                           sprite->size()),
         doc, sprite, item.image, item.selLayers.get(),
+        item.visibleLayers.get(),
         frame, innerTag, filename,
         m_innerPadding, m_extrude);
       Cel* cel = nullptr;
@@ -1177,6 +1204,7 @@ gfx::Size DocExporter::calculateSheetSize(const Samples& samples,
 }
 
 Doc* DocExporter::createEmptyTexture(const Samples& samples,
+                                     const bool withImage,
                                      base::task_token& token) const
 {
   ColorMode colorMode = ColorMode::INDEXED;
@@ -1226,15 +1254,22 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples,
   if (token.canceled())
     return nullptr;
 
-  std::unique_ptr<Sprite> sprite(
-    Sprite::MakeStdSprite(
-      ImageSpec(colorMode,
-                std::max(textureSize.w, m_textureWidth),
-                std::max(textureSize.h, m_textureHeight),
-                transparentColor,
-                (colorSpace ? colorSpace: gfx::ColorSpace::MakeNone())),
-      maxColors,
-      m_docBuf));
+  const ImageSpec spec(colorMode,
+                       std::max(textureSize.w, m_textureWidth),
+                       std::max(textureSize.h, m_textureHeight),
+                       transparentColor,
+                       (colorSpace ? colorSpace: gfx::ColorSpace::MakeNone()));
+
+  std::unique_ptr<Sprite> sprite;
+  if (withImage) {
+    sprite.reset(Sprite::MakeStdSprite(spec, maxColors, m_docBuf));
+  }
+  // Texture without pixels (only one empty layer) when it's going to
+  // be streamed directly to the file.
+  else {
+    sprite = std::make_unique<Sprite>(spec, maxColors);
+    sprite->root()->addLayer(new LayerImage(sprite.get()));
+  }
 
   if (palette)
     sprite->setPalette(palette, false);
@@ -1245,6 +1280,45 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples,
   return document.release();
 }
 
+bool DocExporter::canStreamTexture() const
+{
+  if (m_textureFilename.empty())
+    return false;
+
+  const FileFormat* format =
+    FileFormatsManager::instance()->getFileFormat(
+      dio::detect_format_by_file_extension(m_textureFilename));
+
+  return (format &&
+          format->support(FILE_SUPPORT_SEQUENCES) &&
+          format->support(FILE_ENCODE_SCANLINES));
+}
+
+void DocExporter::convertSamplesPixelFormat(Context* ctx,
+                                            const Samples& samples,
+                                            const doc::PixelFormat pixelFormat) const
+{
+  for (const auto& sample : samples) {
+    if (sample.isLinked() ||
+        sample.isDuplicated() ||
+        sample.isEmpty())
+      continue;
+
+    // Make the sprite compatible with the texture so the render()
+    // works correctly.
+    if (sample.sprite()->pixelFormat() != pixelFormat) {
+      cmd::SetPixelFormat(
+        sample.sprite(),
+        pixelFormat,
+        render::Dithering(),
+        Sprite::DefaultRgbMapAlgorithm(), // TODO add rgbmap algorithm preference
+        nullptr, // toGray is not needed because the texture is Indexed or RGB
+        nullptr) // TODO add a delegate to show progress
+        .execute(ctx);
+    }
+  }
+}
+
 void DocExporter::renderTexture(Context* ctx,
                                 const Samples& samples,
                                 Image* textureImage,
@@ -1252,6 +1326,8 @@ void DocExporter::renderTexture(Context* ctx,
 {
   textureImage->clear(textureImage->maskColor());
 
+  convertSamplesPixelFormat(ctx, samples, textureImage->pixelFormat());
+
   int i = 0;
   for (const auto& sample : samples) {
     if (token.canceled())
@@ -1265,19 +1341,6 @@ void DocExporter::renderTexture(Context* ctx,
       continue;
     }
 
-    // Make the sprite compatible with the texture so the render()
-    // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
-      cmd::SetPixelFormat(
-        sample.sprite(),
-        textureImage->pixelFormat(),
-        render::Dithering(),
-        Sprite::DefaultRgbMapAlgorithm(), // TODO add rgbmap algorithm preference
-        nullptr, // toGray is not needed because the texture is Indexed or RGB
-        nullptr) // TODO add a delegate to show progress
-        .execute(ctx);
-    }
-
     sample.renderSample(
       textureImage,
       sample.inTextureBounds().x+m_innerPadding,
@@ -1287,6 +1350,32 @@ void DocExporter::renderTexture(Context* ctx,
   }
 }
 
+// Renders the given "area" of the texture in "dst" (which is a band
+// of rows of the whole texture).
+void DocExporter::renderTextureRows(const Samples& samples,
+                                    Image* dst,
+                                    const gfx::Rect& area) const
+{
+  dst->clear(dst->maskColor());
+
+  for (const auto& sample : samples) {
+    if (sample.isLinked() ||
+        sample.isDuplicated() ||
+        sample.isEmpty())
+      continue;
+
+    const gfx::Rect& bounds = sample.inTextureBounds();
+    if (!bounds.intersects(area))
+      continue;
+
+    sample.renderSample(
+      dst,
+      bounds.x+m_innerPadding-area.x,
+      bounds.y+m_innerPadding-area.y,
+      m_extrude);
+  }
+}
+
 void DocExporter::trimTexture(const Samples& samples,
                               doc::Sprite* texture) const
 {
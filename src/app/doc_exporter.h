@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "doc/image_buffer.h"
 #include "doc/object_id.h"
 #include "doc/object_version.h"
+#include "doc/pixel_format.h"
 #include "gfx/fwd.h"
 #include "gfx/rect.h"
 
@@ -79,6 +80,13 @@ namespace app {
     void setListLayers(bool value) { m_listLayers = value; }
     void setListSlices(bool value) { m_listSlices = value; }
 
+    // If it's true, the texture is rendered and encoded by bands of
+    // rows directly to the texture file (when the file format
+    // supports it) instead of rendering the whole texture in memory.
+    // In this case the Doc returned by exportSheet() doesn't contain
+    // the texture pixels.
+    void setStreamTexture(bool value) { m_streamTexture = value; }
+
     void addImage(
       Doc* doc,
       const doc::ImageRef& image);
@@ -119,11 +127,19 @@ namespace app {
     gfx::Size calculateSheetSize(const Samples& samples,
                                  base::task_token& token) const;
     Doc* createEmptyTexture(const Samples& samples,
+                            const bool withImage,
                             base::task_token& token) const;
+    bool canStreamTexture() const;
+    void convertSamplesPixelFormat(Context* ctx,
+                                   const Samples& samples,
+                                   const doc::PixelFormat pixelFormat) const;
     void renderTexture(Context* ctx,
                        const Samples& samples,
                        doc::Image* textureImage,
                        base::task_token& token) const;
+    void renderTextureRows(const Samples& samples,
+                           doc::Image* dst,
+                           const gfx::Rect& area) const;
     void trimTexture(const Samples& samples, doc::Sprite* texture) const;
     void createDataFile(const Samples& samples, std::ostream& os, doc::Sprite* texture);
 
@@ -132,6 +148,9 @@ namespace app {
       Doc* doc = nullptr;
       const doc::Tag* tag = nullptr;
       std::unique_ptr<doc::SelectedLayers> selLayers;
+      // "selLayers" with its parents/children (see
+      // SelectedLayers::propagateSelection()) given to the render
+      std::unique_ptr<doc::SelectedLayers> visibleLayers;
       std::unique_ptr<doc::SelectedFrames> selFrames;
       bool splitGrid = false;
       doc::ImageRef image;
@@ -181,6 +200,7 @@ namespace app {
     bool m_listTags;
     bool m_listLayers;
     bool m_listSlices;
+    bool m_streamTexture;
     Items m_documents;
 
     // Buffers used
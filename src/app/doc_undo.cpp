@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,6 +23,7 @@
 #include "undo/undo_history.h"
 #include "undo/undo_state.h"
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -31,6 +32,15 @@
 
 namespace app {
 
+// Number of undo states behind the current one where we start
+// compressing the undo data (so the most recent states can be
+// undone/redone without decompressing anything).
+static const int kCompressStatesBehind = 8;
+
+// Number of undo states behind the current one where we move the
+// compressed undo data to the swap file.
+static const int kSwapOutStatesBehind = 64;
+
 DocUndo::DocUndo()
   : m_undoHistory(this)
 {
@@ -64,6 +74,12 @@ void DocUndo::add(CmdTransaction* cmd)
   m_undoHistory.add(cmd);
   m_totalUndoSize += cmd->memSize();
 
+  if (App::instance())
+    reduceOldStatesMemory();
+
+  // Some old states could be compressed since the last time
+  updateCompressingStatesSize();
+
   notify_observers(&DocUndoObserver::onAddUndoState, this);
   notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
 
@@ -110,11 +126,12 @@ void DocUndo::undo()
   {
     const undo::UndoState* state = nextUndo();
     ASSERT(state);
-    const Cmd* cmd = STATE_CMD(state);
-    m_totalUndoSize -= cmd->memSize();
+    // The undo data of the state could be decompressed
+    removeStateSize(state);
     m_undoHistory.undo();
-    m_totalUndoSize += cmd->memSize();
+    addStateSize(state);
   }
+  updateCompressingStatesSize();
   // This notification could execute a script that modifies the sprite
   // again (e.g. a script that is listening the "change" event, check
   // the SpriteEvents class). If the sprite is modified, the "cmd" is
@@ -132,11 +149,12 @@ void DocUndo::redo()
   {
     const undo::UndoState* state = nextRedo();
     ASSERT(state);
-    const Cmd* cmd = STATE_CMD(state);
-    m_totalUndoSize -= cmd->memSize();
+    // The undo data of the state could be decompressed
+    removeStateSize(state);
     m_undoHistory.redo();
-    m_totalUndoSize += cmd->memSize();
+    addStateSize(state);
   }
+  updateCompressingStatesSize();
   notify_observers(&DocUndoObserver::onCurrentUndoStateChange, this);
   if (m_totalUndoSize != oldSize)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
@@ -290,14 +308,90 @@ void DocUndo::moveToState(const undo::UndoState* state)
 
   // Recalculate the total undo size
   size_t oldSize = m_totalUndoSize;
+  calcTotalUndoSize();
+  if (m_totalUndoSize != oldSize)
+    notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
+}
+
+void DocUndo::calcTotalUndoSize()
+{
   m_totalUndoSize = 0;
+  m_compressingStates.clear();
   const undo::UndoState* s = m_undoHistory.firstState();
   while (s) {
-    m_totalUndoSize += STATE_CMD(s)->memSize();
+    addStateSize(s);
     s = s->next();
   }
-  if (m_totalUndoSize != oldSize)
-    notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
+}
+
+// Adds the current size of the given state to the total undo size
+// (and keeps track of it if it's being compressed).
+void DocUndo::addStateSize(const undo::UndoState* state)
+{
+  const Cmd* cmd = STATE_CMD(state);
+  // Check the compression before getting the size, so if it
+  // finishes in the middle we track an already reduced size.
+  const bool compressing = cmd->isCompressingData();
+  const size_t size = cmd->memSize();
+  m_totalUndoSize += size;
+  if (compressing)
+    m_compressingStates.push_back(std::make_pair(state, size));
+}
+
+// Removes from the total undo size the same size that was added for
+// the given state (before its size is modified or it's deleted).
+void DocUndo::removeStateSize(const undo::UndoState* state)
+{
+  auto it = std::find_if(
+    m_compressingStates.begin(), m_compressingStates.end(),
+    [state](const auto& pair){ return pair.first == state; });
+  if (it != m_compressingStates.end()) {
+    m_totalUndoSize -= it->second;
+    m_compressingStates.erase(it);
+  }
+  else {
+    m_totalUndoSize -= STATE_CMD(state)->memSize();
+  }
+}
+
+// Updates the total undo size with the result of the background
+// compressions (only states being compressed can change their size
+// without our intervention).
+void DocUndo::updateCompressingStatesSize()
+{
+  const auto states = std::move(m_compressingStates);
+  m_compressingStates.clear();
+  for (const auto& pair : states) {
+    m_totalUndoSize -= pair.second;
+    addStateSize(pair.first);
+  }
+}
+
+// Compresses/swaps out the undo data of the states that are
+// kCompressStatesBehind/kSwapOutStatesBehind before the current
+// one. As each new state passes through these positions, we don't
+// need to iterate the whole history.
+void DocUndo::reduceOldStatesMemory()
+{
+  auto& pref = App::instance()->preferences().undo;
+  const bool compress = pref.compressOldStates();
+  const bool swapOut = (compress && pref.swapOldStatesToDisk());
+  if (!compress)
+    return;
+
+  const undo::UndoState* state = currentState();
+  for (int i=0; state && i<=kSwapOutStatesBehind; ++i, state=state->prev()) {
+    if (i == kCompressStatesBehind) {
+      removeStateSize(state);
+      STATE_CMD(state)->compressData();
+      addStateSize(state);
+    }
+    else if (i == kSwapOutStatesBehind && swapOut) {
+      removeStateSize(state);
+      STATE_CMD(state)->swapOutData();
+      addStateSize(state);
+    }
+  }
 }
 
 const undo::UndoState* DocUndo::nextUndo() const
@@ -317,14 +411,13 @@ const undo::UndoState* DocUndo::nextRedo() const
 void DocUndo::onDeleteUndoState(undo::UndoState* state)
 {
   ASSERT(state);
-  Cmd* cmd = STATE_CMD(state);
 
   UNDO_TRACE("UNDO: Deleting undo state <%s> of %s from %s\n",
-             cmd->label().c_str(),
-             base::get_pretty_memory_size(cmd->memSize()).c_str(),
+             STATE_CMD(state)->label().c_str(),
+             base::get_pretty_memory_size(STATE_CMD(state)->memSize()).c_str(),
              base::get_pretty_memory_size(m_totalUndoSize).c_str());
 
-  m_totalUndoSize -= cmd->memSize();
+  removeStateSize(state);
   notify_observers(&DocUndoObserver::onDeleteUndoState, this, state);
 
   // Mark this document as impossible to match the version on disk
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,8 @@
 
 #include <iosfwd>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace app {
   using namespace doc;
@@ -103,6 +105,11 @@ namespace app {
   private:
     const undo::UndoState* nextUndo() const;
     const undo::UndoState* nextRedo() const;
+    void calcTotalUndoSize();
+    void addStateSize(const undo::UndoState* state);
+    void removeStateSize(const undo::UndoState* state);
+    void updateCompressingStatesSize();
+    void reduceOldStatesMemory();
 
     // undo::UndoHistoryDelegate impl
     void onDeleteUndoState(undo::UndoState* state) override;
@@ -112,6 +119,11 @@ namespace app {
     Context* m_ctx = nullptr;
     size_t m_totalUndoSize = 0;
 
+    // States with undo data being compressed in the background, and
+    // the size of each one that is included in m_totalUndoSize (their
+    // memSize() changes when the compression finishes).
+    std::vector<std::pair<const undo::UndoState*, size_t>> m_compressingStates;
+
     // True when we are undoing/redoing. Used to avoid adding new undo
     // information when we are moving through the undo history.
     bool m_undoing = false;
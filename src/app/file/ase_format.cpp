@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "base/exception.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/log.h"
 #include "base/mem_utils.h"
 #include "dio/aseprite_common.h"
 #include "dio/aseprite_decoder.h"
@@ -32,6 +33,7 @@
 
 #include <cstdio>
 #include <deque>
+#include <memory>
 #include <variant>
 
 #define ASEFILE_TRACE(...) // TRACE(__VA_ARGS__)
@@ -42,11 +44,18 @@ using namespace base;
 
 namespace {
 
+// Files smaller than this are decoded completely even if the
+// FILE_LOAD_PROGRESSIVE flag is used (they are loaded fast enough).
+const std::size_t kMinProgressiveFileSize = 16*1024*1024;
+
 class DecodeDelegate : public dio::DecodeDelegate {
 public:
   DecodeDelegate(FileOp* fop)
     : m_fop(fop)
-    , m_sprite(nullptr) {
+    , m_sprite(nullptr)
+    , m_decodeCelImagesLater(
+        fop->isProgressive() &&
+        base::file_size(fop->filename()) >= kMinProgressiveFileSize) {
   }
   ~DecodeDelegate() { }
 
@@ -70,6 +79,10 @@ public:
     return m_fop->isOneFrame();
   }
 
+  bool decodeCelImagesLater() override {
+    return m_decodeCelImagesLater;
+  }
+
   doc::color_t defaultSliceColor() override {
     auto color = m_fop->config().defaultSliceColor;
     return doc::rgba(color.getRed(),
@@ -91,6 +104,53 @@ public:
 private:
   FileOp* m_fop;
   doc::Sprite* m_sprite;
+  bool m_decodeCelImagesLater;
+};
+
+// Delegate used to decode cel images when the FileOp is not
+// available anymore (errors are logged and kept to be reported
+// later).
+class LogDecodeDelegate : public dio::DecodeDelegate {
+public:
+  void error(const std::string& msg) override {
+    LOG(ERROR, "ASE: %s\n", msg.c_str());
+    m_errors += msg;
+    m_errors.push_back('\n');
+  }
+  const std::string& errors() const { return m_errors; }
+private:
+  std::string m_errors;
+};
+
+// Decodes the cel images skipped by the dio::AsepriteDecoder in a
+// progressive load. It keeps the file open until it's destroyed.
+class AseCelImagesDecoder : public CelImagesDecoder {
+public:
+  AseCelImagesDecoder(const FileHandle& handle,
+                      std::unique_ptr<dio::AsepriteDecoder>&& decoder)
+    : m_handle(handle)
+    , m_fileInterface(handle.get())
+    , m_decoder(std::move(decoder)) {
+    m_decoder->initialize(&m_delegate, &m_fileInterface);
+  }
+
+  bool decodeNext(doc::Cel*& cel, doc::ImageRef& image) override {
+    return m_decoder->decodeNextCelImage(cel, image);
+  }
+
+  double progress() const override {
+    return m_decoder->pendingCelImagesProgress();
+  }
+
+  std::string errors() const override {
+    return m_delegate.errors();
+  }
+
+private:
+  LogDecodeDelegate m_delegate;
+  FileHandle m_handle;
+  dio::StdioFileInterface m_fileInterface;
+  std::unique_ptr<dio::AsepriteDecoder> m_decoder;
 };
 
 class ScanlinesGen {
@@ -287,14 +347,20 @@ bool AseFormat::onLoad(FileOp* fop)
   dio::StdioFileInterface fileInterface(handle.get());
 
   DecodeDelegate delegate(fop);
-  dio::AsepriteDecoder decoder;
-  decoder.initialize(&delegate, &fileInterface);
-  if (!decoder.decode())
+  auto decoder = std::make_unique<dio::AsepriteDecoder>();
+  decoder->initialize(&delegate, &fileInterface);
+  if (!decoder->decode())
     return false;
 
   Sprite* sprite = delegate.sprite();
   fop->createDocument(sprite);
 
+  // Cel images will be decoded later (progressive load)
+  if (decoder->hasPendingCelImages() && !fop->isStop()) {
+    fop->setCelImagesDecoder(
+      std::make_unique<AseCelImagesDecoder>(handle, std::move(decoder)));
+  }
+
   if (sprite->colorSpace() != nullptr &&
       sprite->colorSpace()->type() != gfx::ColorSpace::None) {
     fop->setEmbeddedColorProfile();
@@ -75,7 +75,8 @@ class BmpFormat : public FileFormat {
       FILE_SUPPORT_GRAY |
       FILE_SUPPORT_INDEXED |
       FILE_SUPPORT_SEQUENCES |
-      FILE_ENCODE_ABSTRACT_IMAGE;
+      FILE_ENCODE_ABSTRACT_IMAGE |
+      FILE_ENCODE_SCANLINES;
   }
 
   bool onLoad(FileOp* fop) override;
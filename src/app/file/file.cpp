@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -33,6 +33,7 @@
 #include "app/ui/status_bar.h"
 #include "base/fs.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "dio/detect_format.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/doc.h"
@@ -50,9 +51,24 @@
 #include <algorithm>
 #include <cstring>
 #include <cstdarg>
+#include <future>
+#include <memory>
 
 namespace app {
 
+// Approximate size of each band of rows rendered when a sequence
+// image is streamed to the encoder.
+static constexpr int kStreamingBandBytes = 4*1024*1024;
+
+// Only one thread renders the next band of the streamed images in
+// the background (while the encoder processes the current band). It's
+// created the first time it's needed and reused for all images.
+static base::thread_pool& streaming_pool()
+{
+  static base::thread_pool pool(1);
+  return pool;
+}
+
 using namespace base;
 
 class FileOp::FileAbstractImageImpl : public FileAbstractImage {
@@ -67,6 +83,17 @@ public:
     ASSERT(m_doc && m_sprite);
   }
 
+  ~FileAbstractImageImpl() {
+    // Wait the background render of the next band (it uses this
+    // object), ignoring its errors.
+    try {
+      waitNextBand();
+    }
+    catch (...) {
+      // Do nothing
+    }
+  }
+
   void setSpecSize(const gfx::Size& fullCanvasSize,
                    const gfx::Size& frameSize) {
     if (m_supportAnimation) {
@@ -140,11 +167,60 @@ public:
     return m_sprite->getPalettes();
   }
 
+  // Prepares the given frame to be streamed band by band to the
+  // encoder through getScanline(), so the whole frame is never
+  // rendered in memory. While the encoder processes one band, the
+  // next band is rendered in a background thread (see
+  // streaming_pool()).
+  void setStreamingFrame(const doc::frame_t frame,
+                         const gfx::Rect& frameBounds,
+                         const RenderRowsFunc& renderRows) {
+    ASSERT(!needResize());
+    waitNextBand();
+
+    m_streamFrame = frame;
+    m_streamBounds = frameBounds;
+    m_streamRender = renderRows;
+    m_bandHeight = std::clamp(kStreamingBandBytes / (4*std::max(1, m_spec.width())),
+                              1, std::max(1, m_spec.height()));
+    m_band.y = -1;
+    m_nextBand.y = -1;
+    if (m_band.image &&
+        (m_band.image->width() != m_spec.width() ||
+         m_band.image->height() != m_bandHeight)) {
+      m_band.image.reset();
+      m_nextBand.image.reset();
+    }
+    m_tmpScaledImage.reset();
+  }
+
+  void finishStreaming() {
+    waitNextBand();
+    m_streamRender = nullptr;
+    m_band = Band();
+    m_nextBand = Band();
+  }
+
+  bool isStreaming() const {
+    return (m_streamRender != nullptr);
+  }
+
+  bool needResize() const {
+    return (m_scale != gfx::PointF(1.0, 1.0));
+  }
+
   const doc::ImageRef getScaledImage() const override {
+    // Encoders that need the whole image don't have the
+    // FILE_ENCODE_SCANLINES flag, so they are never streamed.
+    ASSERT(!isStreaming());
     return m_tmpScaledImage;
   }
 
   const uint8_t* getScanline(int y) const override {
+    if (isStreaming()) {
+      const Band& band = bandForRow(y);
+      return band.image->getPixelAddress(0, y - band.y);
+    }
     return m_tmpScaledImage->getPixelAddress(0, y);
   }
 
@@ -188,8 +264,55 @@ public:
   }
 
 private:
-  bool needResize() const {
-    return (m_scale != gfx::PointF(1.0, 1.0));
+  struct Band {
+    doc::ImageRef image;
+    int y = -1;                 // First row of the band (-1 if it's empty)
+  };
+
+  const Band& bandForRow(const int y) const {
+    if (m_band.y >= 0 &&
+        y >= m_band.y && y < m_band.y+m_bandHeight)
+      return m_band;
+
+    const int bandY = y - (y % m_bandHeight);
+    // Some encoders (e.g. BMP) save the rows from bottom to top
+    const bool forward = (m_band.y < 0 || bandY > m_band.y);
+
+    waitNextBand();
+    if (m_nextBand.y == bandY)
+      std::swap(m_band, m_nextBand);
+    else
+      renderBand(m_band, bandY);
+
+    const int nextY = bandY + (forward ? m_bandHeight: -m_bandHeight);
+    if (nextY >= 0 && nextY < m_spec.height()) {
+      auto task = std::make_shared<std::packaged_task<void()>>(
+        [this, nextY]{ renderBand(m_nextBand, nextY); });
+      m_nextBandFuture = task->get_future();
+      streaming_pool().execute([task]{ (*task)(); });
+    }
+    return m_band;
+  }
+
+  void renderBand(Band& band, const int y) const {
+    if (!band.image) {
+      doc::ImageSpec spec = m_spec;
+      spec.setSize(m_spec.width(), m_bandHeight);
+      band.image.reset(doc::Image::create(spec));
+    }
+    band.y = -1;
+    m_streamRender(
+      band.image.get(), m_streamFrame,
+      gfx::Rect(m_streamBounds.x,
+                m_streamBounds.y + y,
+                m_streamBounds.w,
+                std::min(m_bandHeight, m_spec.height() - y)));
+    band.y = y;
+  }
+
+  void waitNextBand() const {
+    if (m_nextBandFuture.valid())
+      m_nextBandFuture.get();   // Rethrows exceptions from the render
   }
 
   const Doc* m_doc;
@@ -200,6 +323,15 @@ private:
   doc::ImageRef m_tmpScaledImage = nullptr;
   mutable doc::ImageRef m_tmpUnscaledRender = nullptr;
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
+
+  // Data to stream the image by bands (see setStreamingFrame())
+  RenderRowsFunc m_streamRender;
+  doc::frame_t m_streamFrame = 0;
+  gfx::Rect m_streamBounds;
+  int m_bandHeight = 1;
+  mutable Band m_band;
+  mutable Band m_nextBand;
+  mutable std::future<void> m_nextBandFuture;
 };
 
 base::paths get_readable_extensions()
@@ -252,7 +384,8 @@ Doc* load_document(Context* context, const std::string& filename)
   return document;
 }
 
-int save_document(Context* context, Doc* document)
+int save_document(Context* context, Doc* document,
+                  const FileOp::RenderRowsFunc& renderRows)
 {
   std::unique_ptr<FileOp> fop(
     FileOp::createSaveDocumentOperation(
@@ -264,6 +397,9 @@ int save_document(Context* context, Doc* document)
   if (!fop)
     return -1;
 
+  if (renderRows)
+    fop->setRenderRowsFunc(renderRows);
+
   // Operate in this same thread
   fop->operate();
   fop->done();
@@ -518,6 +654,10 @@ FileOp* FileOp::createLoadDocumentOperation(Context* context,
   if (flags & FILE_LOAD_CREATE_PALETTE)
     fop->m_createPaletteFromRgba = true;
 
+  // Sequences are loaded file by file (without progressive load)
+  if ((flags & FILE_LOAD_PROGRESSIVE) && !fop->isSequence())
+    fop->m_progressive = true;
+
   // Does data file exist?
   if (flags & FILE_LOAD_DATA_FILE) {
     std::string dataFilename = base::replace_extension(filename, "aseprite-data");
@@ -1004,10 +1144,18 @@ void FileOp::operate(IFileOpProgress* progress)
 
       Sprite* sprite = m_document->sprite();
 
+      // Formats that encode row by row don't need the whole frame in
+      // memory, we can render and encode it by bands.
+      const bool streaming = canStreamSequenceRows();
+      if (streaming)
+        makeAbstractImage();
+
       // Create a temporary bitmap
-      m_seq.image.reset(Image::create(sprite->pixelFormat(),
-                                      m_roi.fileCanvasSize().w,
-                                      m_roi.fileCanvasSize().h));
+      if (!streaming) {
+        m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                        m_roi.fileCanvasSize().w,
+                                        m_roi.fileCanvasSize().h));
+      }
 
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
@@ -1016,6 +1164,17 @@ void FileOp::operate(IFileOpProgress* progress)
       render::Render render;
       render.setNewBlend(m_config.newBlend);
 
+      RenderRowsFunc renderRows = m_renderRows;
+      if (!renderRows) {
+        renderRows = [sprite, newBlend=m_config.newBlend]
+          (doc::Image* dst, const frame_t frame, const gfx::Rect& area){
+            render::Render render;
+            render.setNewBlend(newBlend);
+            render.renderSprite(dst, sprite, frame,
+                                gfx::Clip(gfx::Point(0, 0), area));
+          };
+      }
+
       frame_t outputFrame = 0;
       for (frame_t frame : m_roi.selectedFrames()) {
         gfx::Rect bounds = m_roi.frameBounds(frame);
@@ -1027,10 +1186,20 @@ void FileOp::operate(IFileOpProgress* progress)
                                        bounds.size());
         }
 
+        if (streaming) {
+          // The frame will be rendered by bands when the encoder asks
+          // for each scanline.
+          m_abstractImage->setStreamingFrame(frame, bounds, renderRows);
+        }
         // Render the (unscaled) sequenced image.
-        render.renderSprite(
-          m_seq.image.get(), sprite, frame,
-          gfx::Clip(gfx::Point(0, 0), bounds));
+        else if (m_renderRows) {
+          m_renderRows(m_seq.image.get(), frame, bounds);
+        }
+        else {
+          render.renderSprite(
+            m_seq.image.get(), sprite, frame,
+            gfx::Clip(gfx::Point(0, 0), bounds));
+        }
 
         bool save = true;
 
@@ -1063,6 +1232,9 @@ void FileOp::operate(IFileOpProgress* progress)
         ++outputFrame;
       }
 
+      if (streaming)
+        m_abstractImage->finishStreaming();
+
       m_filename = *m_seq.filename_list.begin();
 
       // Destroy the image
@@ -1164,6 +1336,8 @@ void FileOp::postLoad()
         sprite->pixelFormat() == IMAGE_RGB &&
         sprite->getPalettes().size() <= 1 &&
         sprite->palette(frame_t(0))->isBlack()) {
+      decodeCelImagesNow();
+
       std::shared_ptr<Palette> palette(
         render::create_palette_from_sprite(
           sprite, frame_t(0), sprite->lastFrame(), true,
@@ -1248,8 +1422,10 @@ void FileOp::postLoad()
     case app::gen::ColorProfileBehavior::CONVERT: {
       // Convert to the working color profile
       auto gfxCS = m_config.workingCS;
-      if (!gfxCS->nearlyEqual(*spriteCS))
+      if (!gfxCS->nearlyEqual(*spriteCS)) {
+        decodeCelImagesNow();
         cmd::convert_color_profile(sprite, gfxCS);
+      }
       break;
     }
 
@@ -1408,15 +1584,28 @@ FileAbstractImage* FileOp::abstractImageToSave()
 
   makeAbstractImage();
 
-  // Use sequenceImageToSave() to fill the current image
+  // Use sequenceImageToSave() to fill the current image (if we are
+  // streaming the rows, the image is rendered on demand)
   if (m_format->support(FILE_SUPPORT_SEQUENCES)) {
-    m_abstractImage->setUnscaledImageToSave(m_seq.frame++,
-                                            m_seq.image);
+    if (m_abstractImage->isStreaming())
+      ++m_seq.frame;
+    else
+      m_abstractImage->setUnscaledImageToSave(m_seq.frame++,
+                                              m_seq.image);
   }
 
   return m_abstractImage.get();
 }
 
+bool FileOp::canStreamSequenceRows() const
+{
+  // We need the whole image to check if it's empty, and resizing on
+  // the fly is done from a full unscaled frame.
+  return (m_format->support(FILE_ENCODE_SCANLINES) &&
+          !m_ignoreEmpty &&
+          !(m_abstractImage && m_abstractImage->needResize()));
+}
+
 void FileOp::setOnTheFlyScale(const gfx::PointF& scale)
 {
   makeAbstractImage();
@@ -1524,6 +1713,7 @@ FileOp::FileOp(FileOpType type,
   , m_done(false)
   , m_stop(false)
   , m_oneframe(false)
+  , m_progressive(false)
   , m_createPaletteFromRgba(false)
   , m_ignoreEmpty(false)
   , m_embeddedColorProfile(false)
@@ -1548,6 +1738,35 @@ FileOp::FileOp(FileOpType type,
   m_seq.flags = 0;
 }
 
+void FileOp::setCelImagesDecoder(std::unique_ptr<CelImagesDecoder>&& decoder)
+{
+  ASSERT(m_progressive);
+  m_celImagesDecoder = std::move(decoder);
+}
+
+// Decodes the pending cel images in this same thread (used when the
+// post-load process needs the real pixels of the sprite).
+void FileOp::decodeCelImagesNow()
+{
+  if (!m_celImagesDecoder)
+    return;
+
+  try {
+    Cel* cel;
+    ImageRef image;
+    while (m_celImagesDecoder->decodeNext(cel, image))
+      cel->data()->setImage(image, cel->layer());
+
+    const std::string errors = m_celImagesDecoder->errors();
+    if (!errors.empty())
+      setError("Error loading cel images:\n%s", errors.c_str());
+  }
+  catch (const std::exception& ex) {
+    setError("Error loading cel images: %s\n", ex.what());
+  }
+  m_celImagesDecoder.reset();
+}
+
 void FileOp::prepareForSequence()
 {
   m_seq.palette = new Palette(frame_t(0), 256);
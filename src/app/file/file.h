@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,6 +22,7 @@
 #include "os/color_space.h"
 
 #include <cstdio>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -34,6 +35,7 @@
 #define FILE_LOAD_ONE_FRAME             0x00000010
 #define FILE_LOAD_DATA_FILE             0x00000020
 #define FILE_LOAD_CREATE_PALETTE        0x00000040
+#define FILE_LOAD_PROGRESSIVE           0x00000080
 
 namespace doc {
   class Tag;
@@ -144,6 +146,27 @@ namespace app {
                              doc::Image* dst) const = 0;
   };
 
+  // Decodes the cel images that a file format skipped to load the
+  // sprite structure as soon as possible (with the
+  // FILE_LOAD_PROGRESSIVE flag). Cels are created with empty images
+  // and this can decode the real images later (e.g. in a background
+  // thread, see Doc::loadCelImagesInBackground()).
+  class CelImagesDecoder {
+  public:
+    virtual ~CelImagesDecoder() { }
+
+    // Decodes the image of the next cel. Returns false when there
+    // are no more images to decode.
+    virtual bool decodeNext(doc::Cel*& cel, doc::ImageRef& image) = 0;
+
+    // Returns the progress of the whole decoding (1.0 is ready).
+    virtual double progress() const = 0;
+
+    // Returns the errors found decoding images (e.g. corrupted or
+    // truncated data), or an empty string if there are no errors.
+    virtual std::string errors() const = 0;
+  };
+
   // Structure to load & save files.
   //
   // TODO This class do to many things. There should be a previous
@@ -165,10 +188,18 @@ namespace app {
 
     static bool checkIfFormatSupportResizeOnTheFly(const std::string& filename);
 
+    // Renders the given "area" (in sprite coordinates) of the
+    // "frame" to save into "dst". It can be called from a
+    // background thread while the encoder is processing other rows.
+    using RenderRowsFunc = std::function<void(doc::Image* dst,
+                                              const doc::frame_t frame,
+                                              const gfx::Rect& area)>;
+
     ~FileOp();
 
     bool isSequence() const { return !m_seq.filename_list.empty(); }
     bool isOneFrame() const { return m_oneframe; }
+    bool isProgressive() const { return m_progressive; }
     bool preserveColorProfile() const { return m_config.preserveColorProfile; }
     const FileFormat* fileFormat() const { return m_format; }
 
@@ -184,6 +215,13 @@ namespace app {
 
     const FileOpROI& roi() const { return m_roi; }
 
+    // Cel images that weren't decoded yet (when the file was loaded
+    // with FILE_LOAD_PROGRESSIVE), nullptr if all images are ready.
+    void setCelImagesDecoder(std::unique_ptr<CelImagesDecoder>&& decoder);
+    std::unique_ptr<CelImagesDecoder> releaseCelImagesDecoder() {
+      return std::move(m_celImagesDecoder);
+    }
+
     // Creates a new document with the given sprite.
     void createDocument(Sprite* spr);
     void operate(IFileOpProgress* progress = nullptr);
@@ -276,6 +314,14 @@ namespace app {
 
     void getFilenameList(base::paths& output) const;
 
+    // Replaces the default sprite render used to save sequences
+    // (e.g. to save a sprite sheet texture without rendering the
+    // whole texture in memory first). The document sprite pixels are
+    // not used in this case, only its spec and palette.
+    void setRenderRowsFunc(const RenderRowsFunc& func) {
+      m_renderRows = func;
+    }
+
     void setEmbeddedColorProfile() { m_embeddedColorProfile = true; }
     bool hasEmbeddedColorProfile() const { return m_embeddedColorProfile; }
 
@@ -312,6 +358,8 @@ namespace app {
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
+    bool m_progressive;         // Load the sprite structure first
+                                // and decode cel images later.
     bool m_createPaletteFromRgba;
     bool m_ignoreEmpty;
 
@@ -347,7 +395,13 @@ namespace app {
     class FileAbstractImageImpl;
     std::unique_ptr<FileAbstractImageImpl> m_abstractImage;
 
+    RenderRowsFunc m_renderRows;
+
+    std::unique_ptr<CelImagesDecoder> m_celImagesDecoder;
+
     void prepareForSequence();
+    void decodeCelImagesNow();
+    bool canStreamSequenceRows() const;
     void makeAbstractImage();
     void makeDirectories();
   };
@@ -358,7 +412,8 @@ namespace app {
 
   // High-level routines to load/save documents.
   Doc* load_document(Context* context, const std::string& filename);
-  int save_document(Context* context, Doc* document);
+  int save_document(Context* context, Doc* document,
+                    const FileOp::RenderRowsFunc& renderRows = nullptr);
 
   // Returns true if the given filename contains a file extension that
   // can be used to save only static images (i.e. animations are saved
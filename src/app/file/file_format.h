@@ -32,6 +32,7 @@
 #define FILE_SUPPORT_PALETTE_WITH_ALPHA 0x00004000
 #define FILE_ENCODE_ABSTRACT_IMAGE      0x00008000 // Use the new FileAbstractImage
 #define FILE_GIF_ANI_LIMITATIONS        0x00010000
+#define FILE_ENCODE_SCANLINES           0x00020000 // Only uses FileAbstractImage::getScanline()
 
 namespace app {
 
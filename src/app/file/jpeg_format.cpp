@@ -65,7 +65,8 @@ class JpegFormat : public FileFormat {
       FILE_SUPPORT_GRAY |
       FILE_SUPPORT_SEQUENCES |
       FILE_SUPPORT_GET_FORMAT_OPTIONS |
-      FILE_ENCODE_ABSTRACT_IMAGE;
+      FILE_ENCODE_ABSTRACT_IMAGE |
+      FILE_ENCODE_SCANLINES;
   }
 
   bool onLoad(FileOp* fop) override;
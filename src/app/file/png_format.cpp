@@ -16,14 +16,20 @@
 #include "app/file/format_options.h"
 #include "app/file/png_format.h"
 #include "app/file/png_options.h"
+#include "base/exception.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "gfx/color_space.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "png.h"
+#include "zlib.h"
 
 #define PNG_TRACE(...) // TRACE
 
@@ -55,7 +61,8 @@ class PngFormat : public FileFormat {
       FILE_SUPPORT_INDEXED |
       FILE_SUPPORT_SEQUENCES |
       FILE_SUPPORT_PALETTE_WITH_ALPHA |
-      FILE_ENCODE_ABSTRACT_IMAGE;
+      FILE_ENCODE_ABSTRACT_IMAGE |
+      FILE_ENCODE_SCANLINES;
   }
 
   bool onLoad(FileOp* fop) override;
@@ -523,6 +530,355 @@ gfx::ColorSpaceRef PngFormat::loadColorSpace(png_structp png_ptr, png_infop info
 
 #ifdef ENABLE_SAVE
 
+namespace {
+
+// Converts the "src" scanline of the "y" row to the PNG "dst" row
+// with the given PNG "color_type".
+void convert_row_to_png(const int color_type,
+                        const ColorMode colorMode,
+                        const FileOp* fop,
+                        const uint8_t* src,
+                        uint8_t* dst_address,
+                        const png_uint_32 width,
+                        const png_uint_32 y,
+                        const png_uint_32 height)
+{
+  if (color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+    unsigned int x, c, a;
+    bool opaque = true;
+
+    if (colorMode == ColorMode::RGB) {
+      auto src_address = (const uint32_t*)src;
+
+      for (x=0; x<width; ++x) {
+        c = *(src_address++);
+        a = rgba_geta(c);
+
+        if (opaque) {
+          if (a < 255)
+            opaque = false;
+          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+            a = 254;
+        }
+
+        *(dst_address++) = rgba_getr(c);
+        *(dst_address++) = rgba_getg(c);
+        *(dst_address++) = rgba_getb(c);
+        *(dst_address++) = a;
+      }
+    }
+    // In case that we are converting an indexed image to RGB just
+    // to convert one pixel with alpha=254.
+    else if (colorMode == ColorMode::INDEXED) {
+      auto src_address = (const uint8_t*)src;
+      unsigned int x, c;
+      int r, g, b, a;
+      bool opaque = true;
+
+      for (x=0; x<width; ++x) {
+        c = *(src_address++);
+        fop->sequenceGetColor(c, &r, &g, &b);
+        fop->sequenceGetAlpha(c, &a);
+
+        if (opaque) {
+          if (a < 255)
+            opaque = false;
+          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+            a = 254;
+        }
+
+        *(dst_address++) = r;
+        *(dst_address++) = g;
+        *(dst_address++) = b;
+        *(dst_address++) = a;
+      }
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_RGB) {
+    auto src_address = (const uint32_t*)src;
+    unsigned int x, c;
+
+    for (x=0; x<width; ++x) {
+      c = *(src_address++);
+      *(dst_address++) = rgba_getr(c);
+      *(dst_address++) = rgba_getg(c);
+      *(dst_address++) = rgba_getb(c);
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+    auto src_address = (const uint16_t*)src;
+    unsigned int x, c, a;
+    bool opaque = true;
+
+    for (x=0; x<width; x++) {
+      c = *(src_address++);
+      a = graya_geta(c);
+
+      if (opaque) {
+        if (a < 255)
+          opaque = false;
+        else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+          a = 254;
+      }
+
+      *(dst_address++) = graya_getv(c);
+      *(dst_address++) = a;
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_GRAY) {
+    auto src_address = (const uint16_t*)src;
+    unsigned int x, c;
+
+    for (x=0; x<width; ++x) {
+      c = *(src_address++);
+      *(dst_address++) = graya_getv(c);
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_PALETTE) {
+    auto src_address = (const uint8_t*)src;
+    unsigned int x;
+
+    for (x=0; x<width; ++x)
+      *(dst_address++) = *(src_address++);
+  }
+}
+
+// Images with less bytes than this are encoded with libpng in the
+// calling thread.
+const size_t kParallelMinBytes = 1024*1024;
+
+// Each IDAT segment compresses approximately this number of
+// filtered bytes in its own thread.
+const size_t kSegmentBytes = 256*1024;
+
+// The previous 32KB of filtered data (the whole deflate window) is
+// used as the dictionary of each segment, so the compression ratio
+// is almost the same as compressing the whole stream at once.
+const size_t kDictionaryBytes = 32*1024;
+
+enum {
+  kFilterNone,
+  kFilterSub,
+  kFilterUp,
+  kFilterAvg,
+  kFilterPaeth,
+  kFilters
+};
+
+inline uint8_t paeth_predictor(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+  else
+    return c;
+}
+
+// Filters the given "row" (using "prev" as the previous row) with
+// the given PNG filter "type". Returns the sum of absolute
+// differences of the filtered bytes (the same heuristic that libpng
+// uses to select a filter).
+size_t filter_png_row(const int type,
+                      const uint8_t* row,
+                      const uint8_t* prev,
+                      uint8_t* dst,
+                      const size_t rowbytes,
+                      const size_t bpp)
+{
+  size_t sum = 0;
+  for (size_t x=0; x<rowbytes; ++x) {
+    const int a = (x >= bpp ? row[x-bpp]: 0);
+    const int b = prev[x];
+    const int c = (x >= bpp ? prev[x-bpp]: 0);
+    uint8_t v = row[x];
+    switch (type) {
+      case kFilterSub:   v -= a; break;
+      case kFilterUp:    v -= b; break;
+      case kFilterAvg:   v -= (a + b) >> 1; break;
+      case kFilterPaeth: v -= paeth_predictor(a, b, c); break;
+    }
+    dst[x] = v;
+    sum += (v < 128 ? v: 256 - v);
+  }
+  return sum;
+}
+
+struct PngSegment {
+  std::vector<uint8_t> data;   // Raw deflate data
+  uLong adler = 0;             // Adler-32 of the uncompressed data
+  size_t length = 0;           // Uncompressed length
+};
+
+// Writes the IDAT chunks compressing row segments in parallel. The
+// zlib stream is the concatenation of raw deflate segments (each one
+// ends in a byte boundary with Z_SYNC_FLUSH) with a combined
+// Adler-32 checksum at the end.
+void write_png_idat_in_parallel(png_structp png,
+                                FileOp* fop,
+                                const FileAbstractImage* img,
+                                const int color_type,
+                                const png_uint_32 width,
+                                const png_uint_32 height)
+{
+  const ColorMode colorMode = img->spec().colorMode();
+  size_t bpp = 1;
+  switch (color_type) {
+    case PNG_COLOR_TYPE_RGB_ALPHA:  bpp = 4; break;
+    case PNG_COLOR_TYPE_RGB:        bpp = 3; break;
+    case PNG_COLOR_TYPE_GRAY_ALPHA: bpp = 2; break;
+  }
+  size_t srcbpp = 1;
+  switch (colorMode) {
+    case ColorMode::RGB:       srcbpp = 4; break;
+    case ColorMode::GRAYSCALE: srcbpp = 2; break;
+  }
+
+  const size_t rowbytes = width * bpp;
+  const size_t srcRowbytes = width * srcbpp;
+  const size_t filteredRowbytes = rowbytes + 1;
+  const int segmentRows = std::max<int>(1, kSegmentBytes / filteredRowbytes);
+  const int dictRows = std::min<int>(
+    height, (kDictionaryBytes + filteredRowbytes - 1) / filteredRowbytes);
+  const int segments = (height + segmentRows - 1) / segmentRows;
+  const int batchSize = 2*doc::parallel_concurrency();
+
+  // libpng only uses the "None" filter for indexed images.
+  const bool allFilters = (color_type != PNG_COLOR_TYPE_PALETTE);
+
+  std::vector<uint8_t> rawRows;
+  std::vector<PngSegment> batch;
+  std::vector<uint8_t> idat;
+  idat.reserve(kSegmentBytes);
+  idat.push_back(0x78);   // Deflate with 32K window
+  idat.push_back(0x9C);   // Default compression
+  uLong adler = adler32(0L, Z_NULL, 0);
+
+  for (int s0=0; s0<segments; s0+=batchSize) {
+    const int s1 = std::min(s0+batchSize, segments);
+
+    // Copy the scanlines of this batch of segments (plus the rows
+    // needed for the dictionary and filter of the first segment) as
+    // FileAbstractImage::getScanline() cannot be called from other
+    // threads.
+    const int y0 = std::max<int>(0, s0*segmentRows - dictRows - 1);
+    const int y1 = std::min<int>(height, s1*segmentRows);
+    rawRows.resize((y1 - y0) * srcRowbytes);
+    for (int y=y0; y<y1; ++y) {
+      std::copy(img->getScanline(y),
+                img->getScanline(y) + srcRowbytes,
+                rawRows.begin() + (y - y0)*srcRowbytes);
+    }
+
+    batch.clear();
+    batch.resize(s1 - s0);
+
+    doc::parallel_for(
+      s1 - s0,
+      [&](const int i){
+        const int segment = s0 + i;
+        const int segY0 = segment*segmentRows;
+        const int segY1 = std::min<int>(height, segY0 + segmentRows);
+        const int dictY0 = std::max<int>(0, segY0 - dictRows);
+        const int convY0 = std::max<int>(0, dictY0 - 1);
+
+        // Convert rows to the PNG format
+        std::vector<uint8_t> conv((segY1 - convY0) * rowbytes);
+        for (int y=convY0; y<segY1; ++y) {
+          convert_row_to_png(color_type, colorMode, fop,
+                             &rawRows[(y - y0)*srcRowbytes],
+                             &conv[(y - convY0)*rowbytes],
+                             width, y, height);
+        }
+
+        // Filter rows
+        std::vector<uint8_t> zeros(rowbytes, 0);
+        std::vector<uint8_t> filtered((segY1 - dictY0) * filteredRowbytes);
+        std::vector<uint8_t> tmp(allFilters ? rowbytes: 0);
+        for (int y=dictY0; y<segY1; ++y) {
+          const uint8_t* row = &conv[(y - convY0)*rowbytes];
+          const uint8_t* prev = (y > 0 ? row - rowbytes: zeros.data());
+          uint8_t* dst = &filtered[(y - dictY0)*filteredRowbytes];
+
+          dst[0] = kFilterNone;
+          size_t best = filter_png_row(kFilterNone, row, prev, dst+1,
+                                       rowbytes, bpp);
+          if (allFilters) {
+            for (int type=kFilterSub; type<kFilters; ++type) {
+              const size_t sum = filter_png_row(type, row, prev, tmp.data(),
+                                                rowbytes, bpp);
+              if (sum < best) {
+                best = sum;
+                dst[0] = type;
+                std::copy(tmp.begin(), tmp.end(), dst+1);
+              }
+            }
+          }
+        }
+
+        // Compress the segment
+        const size_t dictBytes = std::min(kDictionaryBytes,
+                                          (segY0 - dictY0) * filteredRowbytes);
+        uint8_t* data = &filtered[(segY0 - dictY0)*filteredRowbytes];
+        const size_t length = (segY1 - segY0) * filteredRowbytes;
+
+        z_stream zstream;
+        zstream.zalloc = (alloc_func)0;
+        zstream.zfree = (free_func)0;
+        zstream.opaque = (voidpf)0;
+        int err = deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                               -15, 8, Z_DEFAULT_STRATEGY);
+        if (err != Z_OK)
+          throw base::Exception("ZLib error %d in deflateInit2().", err);
+
+        if (dictBytes > 0)
+          deflateSetDictionary(&zstream, data - dictBytes, dictBytes);
+
+        PngSegment& seg = batch[i];
+        seg.data.resize(deflateBound(&zstream, length) + 64);
+        zstream.next_in = (Bytef*)data;
+        zstream.avail_in = length;
+        zstream.next_out = (Bytef*)seg.data.data();
+        zstream.avail_out = seg.data.size();
+
+        const int flush = (segment == segments-1 ? Z_FINISH: Z_SYNC_FLUSH);
+        err = deflate(&zstream, flush);
+        const size_t outLength = seg.data.size() - zstream.avail_out;
+        deflateEnd(&zstream);
+        if ((flush == Z_FINISH && err != Z_STREAM_END) ||
+            (flush == Z_SYNC_FLUSH && (err != Z_OK || zstream.avail_in > 0)))
+          throw base::Exception("ZLib error %d in deflate().", err);
+
+        seg.data.resize(outLength);
+        seg.adler = adler32(adler32(0L, Z_NULL, 0), data, length);
+        seg.length = length;
+      });
+
+    for (const PngSegment& seg : batch) {
+      adler = adler32_combine(adler, seg.adler, seg.length);
+      idat.insert(idat.end(), seg.data.begin(), seg.data.end());
+      if (idat.size() >= kSegmentBytes) {
+        png_write_chunk(png, (png_const_bytep)"IDAT", idat.data(), idat.size());
+        idat.clear();
+      }
+    }
+
+    fop->setProgress((double)y1 / (double)height);
+  }
+
+  idat.push_back((adler >> 24) & 0xff);
+  idat.push_back((adler >> 16) & 0xff);
+  idat.push_back((adler >> 8) & 0xff);
+  idat.push_back(adler & 0xff);
+  png_write_chunk(png, (png_const_bytep)"IDAT", idat.data(), idat.size());
+}
+
+} // anonymous namespace
+
 bool PngFormat::onSave(FileOp* fop)
 {
   png_infop info;
@@ -663,109 +1019,38 @@ bool PngFormat::onSave(FileOp* fop)
   png_write_info(png, info);
   png_set_packing(png);
 
-  row_pointer = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
-
-  for (png_uint_32 y=0; y<height; ++y) {
-    uint8_t* dst_address = row_pointer;
-
-    if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB_ALPHA) {
-      unsigned int x, c, a;
-      bool opaque = true;
-
-      if (spec.colorMode() == ColorMode::RGB) {
-        auto src_address = (const uint32_t*)img->getScanline(y);
-
-        for (x=0; x<width; ++x) {
-          c = *(src_address++);
-          a = rgba_geta(c);
-
-          if (opaque) {
-            if (a < 255)
-              opaque = false;
-            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-              a = 254;
-          }
-
-          *(dst_address++) = rgba_getr(c);
-          *(dst_address++) = rgba_getg(c);
-          *(dst_address++) = rgba_getb(c);
-          *(dst_address++) = a;
-        }
-      }
-      // In case that we are converting an indexed image to RGB just
-      // to convert one pixel with alpha=254.
-      else if (spec.colorMode() == ColorMode::INDEXED) {
-        auto src_address = (const uint8_t*)img->getScanline(y);
-        unsigned int x, c;
-        int r, g, b, a;
-        bool opaque = true;
-
-        for (x=0; x<width; ++x) {
-          c = *(src_address++);
-          fop->sequenceGetColor(c, &r, &g, &b);
-          fop->sequenceGetAlpha(c, &a);
-
-          if (opaque) {
-            if (a < 255)
-              opaque = false;
-            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-              a = 254;
-          }
-
-          *(dst_address++) = r;
-          *(dst_address++) = g;
-          *(dst_address++) = b;
-          *(dst_address++) = a;
-        }
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB) {
-      auto src_address = (const uint32_t*)img->getScanline(y);
-      unsigned int x, c;
-
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = rgba_getr(c);
-        *(dst_address++) = rgba_getg(c);
-        *(dst_address++) = rgba_getb(c);
+  // Big images are compressed in parallel (except when there are
+  // user chunks that must be written after the IDAT chunks, as we
+  // write the IEND chunk directly).
+  bool parallel =
+    (doc::parallel_concurrency() > 1 &&
+     png_get_rowbytes(png, info) * height >= kParallelMinBytes);
+  if (parallel && opts) {
+    for (const auto& chunk : opts->chunks()) {
+      if (chunk.location & PNG_AFTER_IDAT) {
+        parallel = false;
+        break;
       }
     }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c, a;
-      bool opaque = true;
-
-      for (x=0; x<width; x++) {
-        c = *(src_address++);
-        a = graya_geta(c);
+  }
 
-        if (opaque) {
-          if (a < 255)
-            opaque = false;
-          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-            a = 254;
-        }
+  if (parallel) {
+    write_png_idat_in_parallel(png, fop, img, color_type, width, height);
+    png_write_chunk(png, (png_const_bytep)"IEND", nullptr, 0);
 
-        *(dst_address++) = graya_getv(c);
-        *(dst_address++) = a;
-      }
+    if (spec.colorMode() == ColorMode::INDEXED) {
+      png_free(png, palette);
+      palette = nullptr;
     }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c;
+    return true;
+  }
 
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = graya_getv(c);
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE) {
-      auto src_address = (const uint8_t*)img->getScanline(y);
-      unsigned int x;
+  row_pointer = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
 
-      for (x=0; x<width; ++x)
-        *(dst_address++) = *(src_address++);
-    }
+  for (png_uint_32 y=0; y<height; ++y) {
+    convert_row_to_png(color_type, spec.colorMode(), fop,
+                       img->getScanline(y), row_pointer,
+                       width, y, height);
 
     png_write_rows(png, &row_pointer, 1);
 
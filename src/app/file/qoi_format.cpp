@@ -11,6 +11,7 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "base/file_handle.h"
+#include "doc/parallel.h"
 
 #define QOI_NO_STDIO
 #define QOI_IMPLEMENTATION
@@ -160,31 +161,37 @@ bool QoiFormat::onSave(FileOp* fop)
   if (!pixels)
     return false;
 
-  auto dst = pixels;
-  for (int y=0; y<desc.height; ++y) {
-    auto src = (uint32_t*)image->getPixelAddress(0, y);
-    switch (desc.channels) {
-      case 4:
-        for (int x=0; x<desc.width; ++x, ++src) {
-          uint32_t c = *src;
-          dst[0] = doc::rgba_getr(c);
-          dst[1] = doc::rgba_getg(c);
-          dst[2] = doc::rgba_getb(c);
-          dst[3] = doc::rgba_geta(c);
-          dst += 4;
-        }
-        break;
-      case 3:
-        for (int x=0; x<desc.width; ++x, ++src) {
-          uint32_t c = *src;
-          dst[0] = doc::rgba_getr(c);
-          dst[1] = doc::rgba_getg(c);
-          dst[2] = doc::rgba_getb(c);
-          dst += 3;
-        }
-        break;
-    }
-  }
+  // The QOI encoder is sequential (each pixel depends on the previous
+  // one), but at least we can convert rows in parallel.
+  const int channels = desc.channels;
+  const int width = desc.width;
+  doc::parallel_for(
+    desc.height,
+    [pixels, channels, width, &image](const int y){
+      auto src = (const uint32_t*)image->getPixelAddress(0, y);
+      auto dst = pixels + y*width*channels;
+      switch (channels) {
+        case 4:
+          for (int x=0; x<width; ++x, ++src) {
+            uint32_t c = *src;
+            dst[0] = doc::rgba_getr(c);
+            dst[1] = doc::rgba_getg(c);
+            dst[2] = doc::rgba_getb(c);
+            dst[3] = doc::rgba_geta(c);
+            dst += 4;
+          }
+          break;
+        case 3:
+          for (int x=0; x<width; ++x, ++src) {
+            uint32_t c = *src;
+            dst[0] = doc::rgba_getr(c);
+            dst[1] = doc::rgba_getg(c);
+            dst[2] = doc::rgba_getb(c);
+            dst += 3;
+          }
+          break;
+      }
+    });
 
   int size = 0;
   auto encoded = qoi_encode(pixels, &desc, &size);
@@ -20,12 +20,16 @@
 #include "base/file_handle.h"
 #include "doc/doc.h"
 #include "doc/image_bits.h"
+#include "doc/parallel.h"
 #include "tga/tga.h"
 #include "ui/combobox.h"
 #include "ui/listitem.h"
 
 #include "tga_options.xml.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace base;
@@ -285,6 +289,46 @@ void prepare_header(tga::Header& header,
   }
 }
 
+// Used to encode bands of rows in memory from different threads.
+class MemoryFileInterface : public tga::FileInterface {
+public:
+  MemoryFileInterface() { }
+
+  const std::vector<uint8_t>& buffer() const { return m_buf; }
+
+  bool ok() const override { return true; }
+  size_t tell() override { return m_pos; }
+  void seek(size_t absPos) override { m_pos = absPos; }
+
+  uint8_t read8() override {
+    return (m_pos < m_buf.size() ? m_buf[m_pos++]: 0);
+  }
+
+  size_t readBytes(uint8_t* buf, size_t n) override {
+    n = std::min(n, m_buf.size() - std::min(m_pos, m_buf.size()));
+    std::copy(m_buf.begin()+m_pos, m_buf.begin()+m_pos+n, buf);
+    m_pos += n;
+    return n;
+  }
+
+  void write8(uint8_t value) override {
+    if (m_pos < m_buf.size())
+      m_buf[m_pos] = value;
+    else
+      m_buf.push_back(value);
+    ++m_pos;
+  }
+
+private:
+  std::vector<uint8_t> m_buf;
+  size_t m_pos = 0;
+};
+
+// Minimum number of rows of each band encoded in parallel (RLE
+// packets never cross a row in TGA files, so each band can be
+// encoded independently).
+const int kMinBandRows = 64;
+
 } // anonymous namespace
 
 bool TgaFormat::onSave(FileOp* fop)
@@ -315,8 +359,35 @@ bool TgaFormat::onSave(FileOp* fop)
   tgaImage.rowstride = image->getRowStrideSize();
   tgaImage.bytesPerPixel = image->getRowStrideSize(1);
 
-  TgaDelegate delegate(fop);
-  encoder.writeImage(header, tgaImage);
+  const int bands =
+    std::min(doc::parallel_concurrency(),
+             std::max(1, image->height() / kMinBandRows));
+  if (bands > 1) {
+    const int bandRows = (image->height() + bands - 1) / bands;
+    std::vector<MemoryFileInterface> encoded(bands);
+
+    doc::parallel_for(
+      bands,
+      [&](const int i){
+        const int y = i*bandRows;
+        tga::Header bandHeader = header;
+        bandHeader.height = std::min(bandRows, image->height() - y);
+
+        tga::Image bandImage = tgaImage;
+        bandImage.pixels = image->getPixelAddress(0, y);
+
+        tga::Encoder bandEncoder(&encoded[i]);
+        bandEncoder.writeImage(bandHeader, bandImage);
+      });
+
+    for (const auto& band : encoded) {
+      if (!band.buffer().empty())
+        fwrite(&band.buffer()[0], 1, band.buffer().size(), handle.get());
+    }
+  }
+  else {
+    encoder.writeImage(header, tgaImage);
+  }
   encoder.writeFooter();
 
   if (ferror(handle.get())) {
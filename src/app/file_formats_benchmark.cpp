@@ -0,0 +1,243 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cli/app_options.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
+#include "base/fs.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+// Synthetic sprites used by default: { width, height, layers, frames }
+// Other sprites can be specified with --sprite=W,H,L,F arguments.
+static std::vector<std::vector<int64_t>> g_sprites = {
+  { 256, 256, 1, 1 },
+  { 1024, 1024, 1, 1 },
+  { 1024, 1024, 4, 1 },
+  { 256, 256, 1, 32 },
+  { 256, 256, 4, 32 },
+};
+
+static ColorMode best_color_mode(const FileFormat* format)
+{
+  if (format->support(FILE_SUPPORT_RGBA) ||
+      format->support(FILE_SUPPORT_RGB))
+    return ColorMode::RGB;
+  else if (format->support(FILE_SUPPORT_INDEXED))
+    return ColorMode::INDEXED;
+  else
+    return ColorMode::GRAYSCALE;
+}
+
+// Creates a sprite with some noise over a gradient per cel, so
+// compressors don't get a trivial input.
+static Doc* create_synthetic_doc(Context* ctx,
+                                 const FileFormat* format,
+                                 const int w, const int h,
+                                 const int layers, const int frames)
+{
+  const ColorMode colorMode = best_color_mode(format);
+  Sprite* spr = new Sprite(ImageSpec(colorMode, w, h), 256);
+  spr->setTotalFrames(frames);
+
+  std::srand(w*h*layers*frames);
+  for (int i=0; i<layers; ++i) {
+    LayerImage* layer = new LayerImage(spr);
+    spr->root()->addLayer(layer);
+
+    for (frame_t frame=0; frame<frames; ++frame) {
+      ImageRef image(Image::create(spr->spec()));
+      for (int y=0; y<h; ++y) {
+        for (int x=0; x<w; ++x) {
+          const int v = ((x+y+frame*4) & 0xff) ^ (std::rand() & 7);
+          color_t c = 0;
+          switch (colorMode) {
+            case ColorMode::RGB:       c = rgba(v, x & 0xff, y & 0xff, 255); break;
+            case ColorMode::GRAYSCALE: c = graya(v, 255); break;
+            case ColorMode::INDEXED:   c = v; break;
+          }
+          put_pixel(image.get(), x, y, c);
+        }
+      }
+      layer->addCel(new Cel(frame, image));
+    }
+  }
+
+  Doc* doc = new Doc(spr);
+  doc->setContext(ctx);
+  return doc;
+}
+
+static std::string temp_filename(const FileFormat* format)
+{
+  base::paths exts;
+  format->getExtensions(exts);
+  return base::join_path(base::get_temp_path(),
+                         std::string("aseprite_benchmark.") +
+                         (exts.empty() ? "bin": exts.front()));
+}
+
+// Bytes processed are the pixels encoded/decoded in each frame: the
+// flattened image for formats without layers, or the image of each
+// layer for formats with layers. The size of the encoded file is
+// reported too.
+static void set_throughput(benchmark::State& state,
+                           const FileFormat* format,
+                           const Doc* doc)
+{
+  const Sprite* spr = doc->sprite();
+  int bpp = 1;
+  switch (spr->colorMode()) {
+    case ColorMode::RGB:       bpp = 4; break;
+    case ColorMode::GRAYSCALE: bpp = 2; break;
+  }
+  const int layers =
+    (format->support(FILE_SUPPORT_LAYERS) ? spr->allLayersCount(): 1);
+  const int64_t frames = state.iterations() * spr->totalFrames();
+  const int64_t frameBytes =
+    int64_t(spr->width()) * spr->height() * bpp * layers;
+
+  state.SetBytesProcessed(frames * frameBytes);
+  state.counters["frames/s"] =
+    benchmark::Counter(double(frames), benchmark::Counter::kIsRate);
+  state.counters["file_size"] =
+    benchmark::Counter(double(base::file_size(doc->filename())),
+                       benchmark::Counter::kDefaults,
+                       benchmark::Counter::kIs1024);
+}
+
+static void BM_SaveFile(benchmark::State& state, FileFormat* format) {
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const int layers = state.range(2);
+  const int frames = (format->support(FILE_SUPPORT_FRAMES) ? state.range(3): 1);
+  Context* ctx = App::instance()->context();
+
+  std::unique_ptr<Doc> doc(create_synthetic_doc(ctx, format, w, h, layers, frames));
+  doc->setFilename(temp_filename(format));
+
+  while (state.KeepRunning()) {
+    if (save_document(ctx, doc.get()) < 0) {
+      state.SkipWithError("Error saving file");
+      break;
+    }
+  }
+
+  set_throughput(state, format, doc.get());
+  base::delete_file(doc->filename());
+  doc->close();
+}
+
+static void BM_LoadFile(benchmark::State& state, FileFormat* format) {
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const int layers = state.range(2);
+  const int frames = (format->support(FILE_SUPPORT_FRAMES) ? state.range(3): 1);
+  Context* ctx = App::instance()->context();
+
+  std::unique_ptr<Doc> doc(create_synthetic_doc(ctx, format, w, h, layers, frames));
+  const std::string fn = temp_filename(format);
+  doc->setFilename(fn);
+  if (save_document(ctx, doc.get()) < 0) {
+    state.SkipWithError("Error saving file");
+    doc->close();
+    return;
+  }
+
+  while (state.KeepRunning()) {
+    std::unique_ptr<Doc> loaded(load_document(ctx, fn));
+    if (!loaded) {
+      state.SkipWithError("Error loading file");
+      break;
+    }
+    loaded->close();
+  }
+
+  set_throughput(state, format, doc.get());
+  base::delete_file(fn);
+  doc->close();
+}
+
+static void register_benchmarks()
+{
+  for (FileFormat* format : *FileFormatsManager::instance()) {
+    base::paths exts;
+    format->getExtensions(exts);
+    if (exts.empty())
+      continue;
+
+    const std::string ext = exts.front();
+
+    if (format->support(FILE_SUPPORT_SAVE)) {
+      auto bm = benchmark::RegisterBenchmark(
+        ("BM_SaveFile/" + ext).c_str(), BM_SaveFile, format);
+      for (const auto& args : g_sprites)
+        bm->Args(args);
+      bm->Unit(benchmark::kMillisecond);
+    }
+
+    if (format->support(FILE_SUPPORT_SAVE) &&
+        format->support(FILE_SUPPORT_LOAD)) {
+      auto bm = benchmark::RegisterBenchmark(
+        ("BM_LoadFile/" + ext).c_str(), BM_LoadFile, format);
+      for (const auto& args : g_sprites)
+        bm->Args(args);
+      bm->Unit(benchmark::kMillisecond);
+    }
+  }
+}
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+  App app;
+  const char* argv2[] = { argv[0], "--batch" };
+  app.initialize(AppOptions(2, { argv2 }));
+
+  ::benchmark::Initialize(&argc, argv);
+
+  // Custom sprites to benchmark
+  bool customSprites = false;
+  for (int i=1; i<argc; ++i) {
+    int w, h, layers, frames;
+    if (std::sscanf(argv[i], "--sprite=%d,%d,%d,%d",
+                    &w, &h, &layers, &frames) == 4) {
+      if (!customSprites) {
+        g_sprites.clear();
+        customSprites = true;
+      }
+      g_sprites.push_back({ w, h, layers, frames });
+    }
+  }
+
+  register_benchmarks();
+  int status = ::benchmark::RunSpecifiedBenchmarks();
+
+  app.close();
+  return status;
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -664,6 +664,13 @@ bool CustomizedGuiManager::onProcessDevModeKeyDown(KeyMessage* msg)
     return true;
   }
 
+  // Ctrl+F2 shows/hides the frame-time graph
+  if (msg->ctrlPressed() &&
+      msg->scancode() == kKeyF2) {
+    setShowFrameTimes(!showFrameTimes());
+    return true;
+  }
+
 #ifdef ENABLE_DATA_RECOVERY
   // Ctrl+Shift+R recover active sprite from the backup store
   auto editor = Editor::activeEditor();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -56,6 +56,7 @@ namespace app {
     virtual void setRefLayersVisiblity(const bool visible) = 0;
     virtual void setNonactiveLayersOpacity(const int opacity) = 0;
     virtual void setNewBlendMethod(const bool newBlend) = 0;
+    virtual void setMipmaps(const bool state) = 0;
     virtual void setBgOptions(const render::BgOptions& bg) = 0;
     virtual void setProjection(const render::Projection& projection) = 0;
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -117,6 +117,11 @@ void ShaderRenderer::setNewBlendMethod(const bool newBlend)
   // TODO impl
 }
 
+void ShaderRenderer::setMipmaps(const bool state)
+{
+  // TODO impl
+}
+
 void ShaderRenderer::setBgOptions(const render::BgOptions& bg)
 {
   m_bgOptions = bg;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -37,6 +37,11 @@ void SimpleRenderer::setNewBlendMethod(const bool newBlend)
   m_render.setNewBlend(newBlend);
 }
 
+void SimpleRenderer::setMipmaps(const bool state)
+{
+  m_render.setMipmaps(state);
+}
+
 void SimpleRenderer::setBgOptions(const render::BgOptions& bg)
 {
   m_render.setBgOptions(bg);
@@ -0,0 +1,343 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/context.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "app/tx.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/parallel.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "render/render.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace app {
+namespace script {
+
+void register_app_pixel_color_object(lua_State* L);
+void register_image_buffer_class(lua_State* L);
+void register_point_class(lua_State* L);
+void register_rect_class(lua_State* L);
+void register_size_class(lua_State* L);
+
+namespace {
+
+// Max depth of tables returned by a parallel function
+const int kMaxTableDepth = 64;
+
+// A value returned by a parallel function, copied from the worker
+// Lua state so it can be pushed in the main Lua state.
+struct Value {
+  int type = LUA_TNIL;
+  bool boolean = false;
+  bool isInteger = false;
+  lua_Integer integer = 0;
+  lua_Number number = 0;
+  std::string string;
+  std::vector<Value> keys;      // Table keys/values
+  std::vector<Value> values;
+};
+
+bool copy_value(lua_State* L, int index, Value& value,
+                const int depth, std::string& error)
+{
+  index = lua_absindex(L, index);
+  value.type = lua_type(L, index);
+  switch (value.type) {
+    case LUA_TNIL:
+      return true;
+    case LUA_TBOOLEAN:
+      value.boolean = lua_toboolean(L, index);
+      return true;
+    case LUA_TNUMBER:
+      value.isInteger = lua_isinteger(L, index);
+      if (value.isInteger)
+        value.integer = lua_tointeger(L, index);
+      else
+        value.number = lua_tonumber(L, index);
+      return true;
+    case LUA_TSTRING: {
+      size_t len;
+      const char* s = lua_tolstring(L, index, &len);
+      value.string.assign(s, len);
+      return true;
+    }
+    case LUA_TTABLE:
+      if (depth >= kMaxTableDepth) {
+        error = "the returned table has too many nested tables";
+        return false;
+      }
+      luaL_checkstack(L, 3, nullptr);
+      lua_pushnil(L);
+      while (lua_next(L, index) != 0) {
+        value.keys.emplace_back();
+        value.values.emplace_back();
+        if (!copy_value(L, -2, value.keys.back(), depth+1, error) ||
+            !copy_value(L, -1, value.values.back(), depth+1, error)) {
+          lua_pop(L, 2);
+          return false;
+        }
+        lua_pop(L, 1);
+      }
+      return true;
+    default:
+      error = std::string("cannot return a '") + lua_typename(L, value.type) +
+        "' value from a parallel function";
+      return false;
+  }
+}
+
+void push_value(lua_State* L, const Value& value)
+{
+  luaL_checkstack(L, 3, nullptr);
+  switch (value.type) {
+    case LUA_TBOOLEAN:
+      lua_pushboolean(L, value.boolean);
+      break;
+    case LUA_TNUMBER:
+      if (value.isInteger)
+        lua_pushinteger(L, value.integer);
+      else
+        lua_pushnumber(L, value.number);
+      break;
+    case LUA_TSTRING:
+      lua_pushlstring(L, value.string.c_str(), value.string.size());
+      break;
+    case LUA_TTABLE:
+      lua_createtable(L, 0, int(value.keys.size()));
+      for (std::size_t i=0; i<value.keys.size(); ++i) {
+        push_value(L, value.keys[i]);
+        push_value(L, value.values[i]);
+        lua_rawset(L, -3);
+      }
+      break;
+    default:
+      lua_pushnil(L);
+      break;
+  }
+}
+
+int dump_writer(lua_State* L, const void* p, size_t sz, void* ud)
+{
+  static_cast<std::string*>(ud)->append((const char*)p, sz);
+  return 0;
+}
+
+// Creates a Lua state for a worker thread. It contains only the
+// libraries without access to files/processes, app.pixelColor,
+// Point/Rectangle/Size, and read-only image buffers.
+lua_State* create_worker_state()
+{
+  lua_State* L = luaL_newstate();
+
+  luaL_requiref(L, "_G", luaopen_base, 1);
+  luaL_requiref(L, LUA_TABLIBNAME, luaopen_table, 1);
+  luaL_requiref(L, LUA_STRLIBNAME, luaopen_string, 1);
+  luaL_requiref(L, LUA_MATHLIBNAME, luaopen_math, 1);
+  luaL_requiref(L, LUA_UTF8LIBNAME, luaopen_utf8, 1);
+  lua_pop(L, 5);
+
+  for (const char* name : { "dofile", "loadfile", "print" }) {
+    lua_pushnil(L);
+    lua_setglobal(L, name);
+  }
+
+  lua_newtable(L);
+  lua_setglobal(L, "app");
+  register_app_pixel_color_object(L);
+
+  run_mt_index_code(L);
+  register_image_buffer_class(L);
+  register_point_class(L);
+  register_rect_class(L);
+  register_size_class(L);
+  return L;
+}
+
+// Runs the parallel function and the merge function (if it's
+// present). Returns true and the table of results on the stack, or
+// false and an error message on the stack.
+bool run_parallel(lua_State* L)
+{
+  const bool withMerge = !lua_isnoneornil(L, 3);
+  const int n = int(luaL_len(L, 1));
+
+  // Get the images to process (frames are rendered in new images)
+  std::vector<const doc::Image*> images(n);
+  std::vector<doc::ImageRef> frameImages;
+  for (int i=0; i<n; ++i) {
+    lua_geti(L, 1, i+1);
+    doc::frame_t frame;
+    if (const doc::Image* image = may_get_image_from_arg(L, -1)) {
+      images[i] = image;
+    }
+    else if (doc::Sprite* sprite = may_get_sprite_frame_from_arg(L, -1, frame)) {
+      doc::ImageRef image(doc::Image::create(sprite->spec()));
+      doc::clear_image(image.get(), sprite->transparentColor());
+      render::Render().renderSprite(image.get(), sprite, frame);
+      images[i] = image.get();
+      frameImages.push_back(image);
+    }
+    lua_pop(L, 1);
+  }
+
+  // The function is passed to each worker state as bytecode
+  std::string code;
+  lua_pushvalue(L, 2);
+  lua_dump(L, dump_writer, &code, 0);
+  lua_pop(L, 1);
+
+  std::vector<Value> results(n);
+  std::atomic<int> next(0);
+  std::atomic<bool> stop(false);
+  std::mutex errorMutex;
+  std::string error;
+
+  auto setError = [&](const std::string& msg) {
+    std::lock_guard lock(errorMutex);
+    if (error.empty())
+      error = msg;
+    stop = true;
+  };
+
+  const int workers = std::min(n, doc::parallel_concurrency());
+  doc::parallel_for(
+    workers,
+    [&](int){
+      lua_State* W = create_worker_state();
+      if (luaL_loadbufferx(W, code.c_str(), code.size(), "=parallel", "b") != LUA_OK) {
+        setError(lua_tostring(W, -1));
+        lua_close(W);
+        return;
+      }
+
+      const int func = lua_gettop(W);
+      int i;
+      while (!stop && (i = next++) < n) {
+        lua_pushvalue(W, func);
+        push_readonly_image_buffer(W, images[i]);
+        lua_pushinteger(W, i+1);
+
+        std::string msg;
+        if (lua_pcall(W, 2, 1, 0) != LUA_OK) {
+          const char* s = lua_tostring(W, -1);
+          msg = (s ? s: "unknown error");
+        }
+        else
+          copy_value(W, -1, results[i], 0, msg);
+
+        if (!msg.empty()) {
+          setError("item " + std::to_string(i+1) + ": " + msg);
+          break;
+        }
+        lua_settop(W, func);
+      }
+      lua_close(W);
+    });
+
+  if (!error.empty()) {
+    lua_pushstring(L, error.c_str());
+    return false;
+  }
+
+  lua_createtable(L, n, 0);
+  const int resultsIndex = lua_gettop(L);
+  for (int i=0; i<n; ++i) {
+    push_value(L, results[i]);
+    lua_seti(L, resultsIndex, i+1);
+  }
+  results.clear();
+
+  // Merge results in the main thread (in one transaction, so all
+  // the changes can be undone at once)
+  if (withMerge) {
+    std::unique_ptr<Tx> tx;
+    if (App::instance()->context()->activeDocument())
+      tx = std::make_unique<Tx>();
+
+    for (int i=0; i<n; ++i) {
+      lua_pushvalue(L, 3);
+      lua_geti(L, resultsIndex, i+1);
+      lua_pushinteger(L, i+1);
+      if (lua_pcall(L, 2, 0, 0) != LUA_OK)
+        return false;           // The error is on the stack
+    }
+
+    if (tx)
+      tx->commit();
+  }
+  return true;
+}
+
+// app.parallel(items, function(buffer, i) ... end [, function(result, i) ... end])
+//
+// Calls the first function for each item (an Image or a Frame) in
+// worker Lua states, where "buffer" is a read-only buffer of the
+// image pixels (see Image:buffer()). The function is copied to the
+// workers, so it cannot use local variables of the script (and the
+// workers don't have access to files or the "app" API).
+//
+// The returned values (nil, booleans, numbers, strings, or tables of
+// them) are passed to the optional merge function in the main
+// thread (in one transaction), and returned in a table.
+int App_parallel(lua_State* L)
+{
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  if (!lua_isnoneornil(L, 3))
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+  if (lua_iscfunction(L, 2))
+    return luaL_error(L, "the parallel function must be a Lua function");
+
+  for (int i=1; const char* name = lua_getupvalue(L, 2, i); ++i) {
+    lua_pop(L, 1);
+    if (std::strcmp(name, "_ENV") != 0)
+      return luaL_error(L, "the parallel function cannot use the local variable '%s' of the script", name);
+  }
+
+  const int n = int(luaL_len(L, 1));
+  for (int i=1; i<=n; ++i) {
+    lua_geti(L, 1, i);
+    doc::frame_t frame;
+    if (!may_get_image_from_arg(L, -1) &&
+        !may_get_sprite_frame_from_arg(L, -1, frame))
+      return luaL_error(L, "item %d must be an Image or a Frame", i);
+    lua_pop(L, 1);
+  }
+
+  if (!run_parallel(L))
+    return lua_error(L);
+  return 1;
+}
+
+} // anonymous namespace
+
+void register_app_parallel_function(lua_State* L)
+{
+  lua_getglobal(L, "app");
+  lua_pushstring(L, "parallel");
+  lua_pushcfunction(L, App_parallel);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);                // Pop app global
+}
+
+} // namespace script
+} // namespace app
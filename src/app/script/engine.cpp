@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -36,6 +36,7 @@
 #include "ui/mouse_button.h"
 
 #include <fstream>
+#include <iostream>
 #include <sstream>
 #include <stack>
 #include <string>
@@ -87,10 +88,8 @@ int print(lua_State* L)
     auto app = App::instance();
     if (app && app->scriptEngine())
       app->scriptEngine()->consolePrint(output.c_str());
-    else {
-      std::printf("%s\n", output.c_str());
-      std::fflush(stdout);
-    }
+    else
+      std::cout << output << std::endl;
   }
   return 0;
 }
@@ -150,6 +149,7 @@ int unsupported(lua_State* L)
 } // anonymous namespace
 
 void register_app_object(lua_State* L);
+void register_app_parallel_function(lua_State* L);
 void register_app_pixel_color_object(lua_State* L);
 void register_app_fs_object(lua_State* L);
 void register_app_command_object(lua_State* L);
@@ -169,6 +169,7 @@ void register_events_class(lua_State* L);
 void register_frame_class(lua_State* L);
 void register_frames_class(lua_State* L);
 void register_grid_class(lua_State* L);
+void register_image_buffer_class(lua_State* L);
 void register_image_class(lua_State* L);
 void register_image_iterator_class(lua_State* L);
 void register_image_spec_class(lua_State* L);
@@ -258,6 +259,7 @@ Engine::Engine()
   // Register global app object
   register_app_object(L);
   register_app_pixel_color_object(L);
+  register_app_parallel_function(L);
   register_app_fs_object(L);
   register_app_command_object(L);
   register_app_preferences_object(L);
@@ -472,6 +474,7 @@ Engine::Engine()
   register_frame_class(L);
   register_frames_class(L);
   register_grid_class(L);
+  register_image_buffer_class(L);
   register_image_class(L);
   register_image_iterator_class(L);
   register_image_spec_class(L);
@@ -645,10 +648,8 @@ void Engine::onConsolePrint(const char* text)
 
   if (m_delegate)
     m_delegate->onConsolePrint(text);
-  else {
-    std::printf("%s\n", text);
-    std::fflush(stdout);
-  }
+  else
+    std::cout << text << std::endl;
 }
 
 } // namespace script
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -153,6 +153,9 @@ namespace app {
   void push_editor(lua_State* L, Editor* editor);
   void push_group_layers(lua_State* L, doc::LayerGroup* group);
   void push_image(lua_State* L, doc::Image* image);
+  void push_readonly_image_buffer(lua_State* L, const doc::Image* image);
+  void push_image_buffer(lua_State* L, int imageIndex,
+                         doc::Image* image, const gfx::Rect& bounds);
   void push_layers(lua_State* L, const doc::ObjectIds& layers);
   void push_palette(lua_State* L, doc::Palette* palette);
   void push_plugin(lua_State* L, Extension* ext);
@@ -189,6 +192,7 @@ namespace app {
   doc::Image* get_image_from_arg(lua_State* L, int index);
   doc::Cel* get_image_cel_from_arg(lua_State* L, int index);
   doc::frame_t get_frame_number_from_arg(lua_State* L, int index);
+  doc::Sprite* may_get_sprite_frame_from_arg(lua_State* L, int index, doc::frame_t& frame);
   const doc::Mask* get_mask_from_arg(lua_State* L, int index);
   app::tools::Tool* get_tool_from_arg(lua_State* L, int index);
   doc::BrushRef get_brush_from_arg(lua_State* L, int index);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2020  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -152,5 +152,14 @@ doc::frame_t get_frame_number_from_arg(lua_State* L, int index)
     return lua_tointeger(L, index)-1;
 }
 
+doc::Sprite* may_get_sprite_frame_from_arg(lua_State* L, int index, doc::frame_t& frame)
+{
+  auto obj = may_get_obj<FrameObj>(L, index);
+  if (!obj)
+    return nullptr;
+  frame = obj->frame;
+  return obj->sprite(L);
+}
+
 } // namespace script
 } // namespace app
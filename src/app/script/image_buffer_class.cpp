@@ -0,0 +1,341 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/docobj.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "doc/image.h"
+
+#include <cstring>
+#include <string>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// A view of the pixels of an image (or a rectangle of it) that can
+// be read/written from scripts without copying the whole image (as
+// Image.bytes does). Pixels can be accessed with buf[i] (from 1 to
+// #buf, row by row) or with buf:get(x, y)/buf:set(x, y, value)
+// (relative to the view bounds).
+//
+// The image userdata is kept alive in the uservalue of the view.
+// Read-only views (used in app.parallel() worker states) point
+// directly to an image that is kept alive by the main thread.
+struct ImageBufferObj {
+  doc::ObjectId imageId = 0;
+  const doc::Image* readOnlyImage = nullptr;
+  gfx::Rect bounds;
+  // The image is found by its ID only when some object was removed
+  // since the last access (doc::get() locks a mutex and searches the
+  // ID, too slow to be done for each pixel).
+  doc::Image* cachedImage = nullptr;
+  doc::ObjectVersion cachedVersion = 0;
+  ImageBufferObj(doc::Image* image, const gfx::Rect& bounds)
+    : imageId(image->id())
+    , bounds(bounds)
+    , cachedImage(image)
+    , cachedVersion(doc::get_objects_version()) {
+  }
+  ImageBufferObj(const doc::Image* image, const gfx::Rect& bounds)
+    : readOnlyImage(image)
+    , bounds(bounds) {
+  }
+  ImageBufferObj(const ImageBufferObj& view, const gfx::Rect& bounds)
+    : imageId(view.imageId)
+    , readOnlyImage(view.readOnlyImage)
+    , bounds(bounds)
+    , cachedImage(view.cachedImage)
+    , cachedVersion(view.cachedVersion) {
+  }
+  ImageBufferObj(const ImageBufferObj&) = delete;
+  ImageBufferObj& operator=(const ImageBufferObj&) = delete;
+
+  const doc::Image* image(lua_State* L) {
+    if (readOnlyImage)
+      return readOnlyImage;
+    return findImage(L);
+  }
+
+  doc::Image* writableImage(lua_State* L) {
+    if (readOnlyImage) {
+      luaL_error(L, "the image buffer is read-only");
+      return nullptr;
+    }
+    return findImage(L);
+  }
+
+private:
+  doc::Image* findImage(lua_State* L) {
+    const doc::ObjectVersion version = doc::get_objects_version();
+    if (!cachedImage || cachedVersion != version) {
+      cachedImage = nullptr;
+      cachedImage = check_docobj(L, doc::get<doc::Image>(imageId));
+      cachedVersion = version;
+    }
+    return cachedImage;
+  }
+};
+
+// Creates a new view of the same image of the view in "index"
+void push_image_buffer_view(lua_State* L, int index,
+                            const gfx::Rect& bounds)
+{
+  index = lua_absindex(L, index);
+  push_new<ImageBufferObj>(L, *get_obj<ImageBufferObj>(L, index), bounds);
+  lua_getuservalue(L, index);
+  lua_setuservalue(L, -2);
+}
+
+doc::color_t get_pixel_value(lua_State* L, int index,
+                             const doc::PixelFormat pixelFormat)
+{
+  if (lua_isinteger(L, index))
+    return lua_tointeger(L, index);
+  else
+    return convert_args_into_pixel_color(L, index, pixelFormat);
+}
+
+// Converts the 1-based index "i" of the view pixels to image
+// coordinates, returns false if it's out of bounds.
+bool index_to_xy(const ImageBufferObj* obj,
+                 const lua_Integer i,
+                 int& x, int& y)
+{
+  const lua_Integer n = lua_Integer(obj->bounds.w) * obj->bounds.h;
+  if (i < 1 || i > n)
+    return false;
+  x = obj->bounds.x + int((i-1) % obj->bounds.w);
+  y = obj->bounds.y + int((i-1) / obj->bounds.w);
+  return true;
+}
+
+void check_xy(lua_State* L, const ImageBufferObj* obj,
+              const int u, const int v)
+{
+  if (u < 0 || v < 0 || u >= obj->bounds.w || v >= obj->bounds.h)
+    luaL_error(L, "pixel (%d, %d) is outside the buffer bounds (%d x %d)",
+               u, v, obj->bounds.w, obj->bounds.h);
+}
+
+int ImageBuffer_gc(lua_State* L)
+{
+  get_obj<ImageBufferObj>(L, 1)->~ImageBufferObj();
+  return 0;
+}
+
+int ImageBuffer_len(lua_State* L)
+{
+  auto obj = get_obj<ImageBufferObj>(L, 1);
+  lua_pushinteger(L, lua_Integer(obj->bounds.w) * obj->bounds.h);
+  return 1;
+}
+
+int ImageBuffer_get_bytes(lua_State* L, ImageBufferObj* obj)
+{
+  const doc::Image* img = obj->image(L);
+  const int rowBytes = img->getRowStrideSize(obj->bounds.w);
+  if (obj->bounds.h == 1) {
+    lua_pushlstring(
+      L, (const char*)img->getPixelAddress(obj->bounds.x, obj->bounds.y),
+      rowBytes);
+  }
+  else {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    for (int y=obj->bounds.y; y<obj->bounds.y2(); ++y)
+      luaL_addlstring(&b, (const char*)img->getPixelAddress(obj->bounds.x, y), rowBytes);
+    luaL_pushresult(&b);
+  }
+  return 1;
+}
+
+int ImageBuffer_set_bytes(lua_State* L, ImageBufferObj* obj)
+{
+  doc::Image* img = obj->writableImage(L);
+  const int rowBytes = img->getRowStrideSize(obj->bounds.w);
+  size_t bytes_size, bytes_needed = size_t(rowBytes) * obj->bounds.h;
+  const char* bytes = lua_tolstring(L, 3, &bytes_size);
+  if (bytes_size != bytes_needed) {
+    return luaL_error(L, "Data size does not match: given %d, needed %d.",
+                      int(bytes_size), int(bytes_needed));
+  }
+
+  for (int y=obj->bounds.y; y<obj->bounds.y2(); ++y, bytes+=rowBytes)
+    std::memcpy(img->getPixelAddress(obj->bounds.x, y), bytes, rowBytes);
+  img->incrementVersion();
+  return 0;
+}
+
+int ImageBuffer_index(lua_State* L)
+{
+  auto obj = get_obj<ImageBufferObj>(L, 1);
+
+  // buf[i]
+  if (lua_isinteger(L, 2)) {
+    int x, y;
+    if (index_to_xy(obj, lua_tointeger(L, 2), x, y))
+      lua_pushinteger(L, obj->image(L)->getPixel(x, y));
+    else
+      lua_pushnil(L);
+    return 1;
+  }
+
+  const char* field = lua_tostring(L, 2);
+  if (!field)
+    return luaL_error(L, "invalid buffer index");
+
+  if (std::strcmp(field, "width") == 0) {
+    lua_pushinteger(L, obj->bounds.w);
+    return 1;
+  }
+  else if (std::strcmp(field, "height") == 0) {
+    lua_pushinteger(L, obj->bounds.h);
+    return 1;
+  }
+  else if (std::strcmp(field, "bounds") == 0) {
+    push_obj(L, obj->bounds);
+    return 1;
+  }
+  else if (std::strcmp(field, "bytes") == 0) {
+    return ImageBuffer_get_bytes(L, obj);
+  }
+
+  // Methods
+  if (luaL_getmetafield(L, 1, field) != LUA_TNIL)
+    return 1;
+
+  return luaL_error(L, "Field '%s' does not exist", field);
+}
+
+int ImageBuffer_newindex(lua_State* L)
+{
+  auto obj = get_obj<ImageBufferObj>(L, 1);
+
+  // buf[i] = value
+  if (lua_isinteger(L, 2)) {
+    const lua_Integer i = lua_tointeger(L, 2);
+    int x, y;
+    if (!index_to_xy(obj, i, x, y))
+      return luaL_error(L, "index %d is outside the buffer (1 to %d)",
+                        int(i), obj->bounds.w * obj->bounds.h);
+
+    doc::Image* img = obj->writableImage(L);
+    img->putPixel(x, y, get_pixel_value(L, 3, img->pixelFormat()));
+    img->incrementVersion();
+    return 0;
+  }
+
+  const char* field = lua_tostring(L, 2);
+  if (field && std::strcmp(field, "bytes") == 0)
+    return ImageBuffer_set_bytes(L, obj);
+
+  return luaL_error(L, "Cannot set field '%s'", (field ? field: "?"));
+}
+
+int ImageBuffer_get(lua_State* L)
+{
+  auto obj = get_obj<ImageBufferObj>(L, 1);
+  const int u = lua_tointeger(L, 2);
+  const int v = lua_tointeger(L, 3);
+  check_xy(L, obj, u, v);
+  lua_pushinteger(L, obj->image(L)->getPixel(obj->bounds.x+u,
+                                             obj->bounds.y+v));
+  return 1;
+}
+
+int ImageBuffer_set(lua_State* L)
+{
+  auto obj = get_obj<ImageBufferObj>(L, 1);
+  const int u = lua_tointeger(L, 2);
+  const int v = lua_tointeger(L, 3);
+  check_xy(L, obj, u, v);
+
+  doc::Image* img = obj->writableImage(L);
+  img->putPixel(obj->bounds.x+u, obj->bounds.y+v,
+                get_pixel_value(L, 4, img->pixelFormat()));
+  img->incrementVersion();
+  return 0;
+}
+
+int ImageBuffer_row(lua_State* L)
+{
+  auto obj = get_obj<ImageBufferObj>(L, 1);
+  const int v = lua_tointeger(L, 2);
+  check_xy(L, obj, 0, v);
+  push_image_buffer_view(
+    L, 1, gfx::Rect(obj->bounds.x, obj->bounds.y+v, obj->bounds.w, 1));
+  return 1;
+}
+
+// Calls the given function for each row of the buffer as
+// func(row, y), where "row" is a view of that row, and "y" is
+// relative to the buffer bounds. The iteration stops if the function
+// returns false.
+int ImageBuffer_forEachRow(lua_State* L)
+{
+  auto obj = get_obj<ImageBufferObj>(L, 1);
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+
+  const gfx::Rect bounds = obj->bounds;
+  for (int v=0; v<bounds.h; ++v) {
+    lua_pushvalue(L, 2);
+    push_image_buffer_view(
+      L, 1, gfx::Rect(bounds.x, bounds.y+v, bounds.w, 1));
+    lua_pushinteger(L, v);
+    lua_call(L, 2, 1);
+
+    const bool stop = (lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+    lua_pop(L, 1);
+    if (stop)
+      break;
+  }
+  return 0;
+}
+
+const luaL_Reg ImageBuffer_methods[] = {
+  { "__gc", ImageBuffer_gc },
+  { "__len", ImageBuffer_len },
+  { "__index", ImageBuffer_index },
+  { "__newindex", ImageBuffer_newindex },
+  { "get", ImageBuffer_get },
+  { "set", ImageBuffer_set },
+  { "row", ImageBuffer_row },
+  { "forEachRow", ImageBuffer_forEachRow },
+  { nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(ImageBufferObj);
+
+void register_image_buffer_class(lua_State* L)
+{
+  using ImageBuffer = ImageBufferObj;
+  REG_CLASS(L, ImageBuffer);
+}
+
+void push_image_buffer(lua_State* L, int imageIndex,
+                       doc::Image* image, const gfx::Rect& bounds)
+{
+  imageIndex = lua_absindex(L, imageIndex);
+  push_new<ImageBufferObj>(L, image, bounds);
+  lua_pushvalue(L, imageIndex);
+  lua_setuservalue(L, -2);
+}
+
+void push_readonly_image_buffer(lua_State* L, const doc::Image* image)
+{
+  push_new<ImageBufferObj>(L, image, image->bounds());
+}
+
+} // namespace script
+} // namespace app
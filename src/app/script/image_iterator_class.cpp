@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -29,14 +29,28 @@ template<typename ImageTraits>
 struct ImageIteratorObj {
   typename doc::LockImageBits<ImageTraits> bits;
   typename doc::LockImageBits<ImageTraits>::iterator begin, next, end;
+  doc::ObjectId imageId;
+  bool modified = false;
   ImageIteratorObj(const doc::Image* image, const gfx::Rect& bounds)
     : bits(image, bounds),
       begin(bits.begin()),
       next(begin),
-      end(bits.end()) {
+      end(bits.end()),
+      imageId(image->id()) {
   }
   ImageIteratorObj(const ImageIteratorObj&) = delete;
   ImageIteratorObj& operator=(const ImageIteratorObj&) = delete;
+
+  // Increments the image version once (when the iteration ends or the
+  // iterator is collected) if pixels were modified, so cached
+  // renders of the image (e.g. mip levels) are discarded.
+  void updateVersion() {
+    if (modified) {
+      modified = false;
+      if (auto image = doc::get<doc::Image>(imageId))
+        image->incrementVersion();
+    }
+  }
 };
 
 using RgbImageIterator = ImageIteratorObj<RgbTraits>;
@@ -47,7 +61,9 @@ using TilemapImageIterator = ImageIteratorObj<TilemapTraits>;
 template<typename ImageTraits>
 int ImageIterator_gc(lua_State* L)
 {
-  get_obj<ImageIteratorObj<ImageTraits>>(L, 1)->~ImageIteratorObj<ImageTraits>();
+  auto obj = get_obj<ImageIteratorObj<ImageTraits>>(L, 1);
+  obj->updateVersion();
+  obj->~ImageIteratorObj<ImageTraits>();
   return 0;
 }
 
@@ -63,6 +79,7 @@ int ImageIterator_call(lua_State* L)
   // Set value
   else {
     *obj->begin = lua_tointeger(L, 2);
+    obj->modified = true;
     return 1;
   }
 }
@@ -124,6 +141,7 @@ static int image_iterator_step_closure(lua_State* L)
     lua_pushvalue(L, idx);
   }
   else {
+    obj->updateVersion();
     lua_pushnil(L);
   }
   return 1;
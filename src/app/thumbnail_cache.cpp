@@ -0,0 +1,278 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "base/convert_to.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/serialization.h"
+#include "base/sha1.h"
+#include "base/time.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#define THUMB_CACHE_TRACE(...)
+
+namespace app {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+
+namespace {
+
+const uint32_t kMagicNumber = 0x48544541; // "AETH"
+const char* kIndexFilename = "index";
+const char* kThumbnailExtension = ".thumb";
+
+} // anonymous namespace
+
+ThumbnailCache::ThumbnailCache(const std::string& dir,
+                               const std::size_t maxSize)
+  : m_dir(dir)
+  , m_maxSize(maxSize)
+  , m_totalSize(0)
+  , m_indexLoaded(false)
+  , m_indexModified(false)
+{
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+  std::lock_guard lock(m_mutex);
+  if (m_indexLoaded && m_indexModified)
+    saveIndex();
+}
+
+doc::ImageRef ThumbnailCache::load(const std::string& filename)
+{
+  const std::string key = makeKey(filename);
+  if (key.empty())
+    return nullptr;
+
+  std::string fn;
+  {
+    std::lock_guard lock(m_mutex);
+    loadIndex();
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+      return nullptr;
+
+    touch(it->second);
+    fn = entryFilename(key);
+  }
+
+  doc::ImageRef image;
+  try {
+    std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+    if (s && read32(s) == kMagicNumber) {
+      image.reset(doc::read_image(s, false));
+      if (image && image->pixelFormat() != doc::IMAGE_RGB)
+        image.reset();
+    }
+  }
+  catch (const std::exception& ex) {
+    THUMB_CACHE_TRACE("THUMB: Error reading %s: %s\n", fn.c_str(), ex.what());
+    image.reset();
+  }
+
+  // Remove corrupted entries
+  if (!image) {
+    std::lock_guard lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+      remove(it->second);
+  }
+
+  THUMB_CACHE_TRACE("THUMB: Cache %s for %s\n",
+                    (image ? "hit": "miss"), filename.c_str());
+  return image;
+}
+
+void ThumbnailCache::save(const std::string& filename,
+                          const doc::Image* thumbnail)
+{
+  ASSERT(thumbnail);
+  ASSERT(thumbnail->pixelFormat() == doc::IMAGE_RGB);
+
+  const std::string key = makeKey(filename);
+  if (key.empty())
+    return;
+
+  const std::string fn = entryFilename(key);
+  const std::string tmp = fn + ".tmp";
+  {
+    std::ofstream s(FSTREAM_PATH(tmp), std::ofstream::binary);
+    if (!s)
+      return;
+
+    write32(s, kMagicNumber);
+    if (!doc::write_image(s, thumbnail) || !s.good()) {
+      s.close();
+      base::delete_file(tmp);
+      return;
+    }
+  }
+
+  std::lock_guard lock(m_mutex);
+  loadIndex();
+
+  auto it = m_entries.find(key);
+  if (it != m_entries.end())
+    remove(it->second);
+
+  // Write the final file atomically so other instances don't read a
+  // partial thumbnail.
+  if (std::rename(tmp.c_str(), fn.c_str()) != 0) {
+    base::delete_file(tmp);
+    return;
+  }
+
+  const std::size_t size = base::file_size(fn);
+  m_lru.push_back(Entry{ key, size });
+  m_entries[key] = std::prev(m_lru.end());
+  m_totalSize += size;
+  m_indexModified = true;
+
+  trim();
+}
+
+void ThumbnailCache::clear()
+{
+  std::lock_guard lock(m_mutex);
+  loadIndex();
+
+  while (!m_lru.empty())
+    remove(m_lru.begin());
+
+  saveIndex();
+}
+
+std::string ThumbnailCache::makeKey(const std::string& filename) const
+{
+  if (!base::is_file(filename))
+    return std::string();
+
+  const base::Time t = base::get_modification_time(filename);
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "\n%04d%02d%02d%02d%02d%02d\n%zu",
+                t.year, t.month, t.day,
+                t.hour, t.minute, t.second,
+                base::file_size(filename));
+
+  return base::convert_to<std::string>(
+    base::Sha1::calculateFromString(
+      base::normalize_path(filename) + buf));
+}
+
+std::string ThumbnailCache::entryFilename(const std::string& key) const
+{
+  return base::join_path(m_dir, key + kThumbnailExtension);
+}
+
+std::string ThumbnailCache::indexFilename() const
+{
+  return base::join_path(m_dir, kIndexFilename);
+}
+
+// The index file contains a list of "key size" lines from the least
+// recently used entry to the most recently used one.
+void ThumbnailCache::loadIndex()
+{
+  if (m_indexLoaded)
+    return;
+
+  m_indexLoaded = true;
+
+  if (!base::is_directory(m_dir))
+    return;
+
+  std::ifstream s(FSTREAM_PATH(indexFilename()));
+  std::string key;
+  std::size_t size;
+  while (s >> key >> size) {
+    if (m_entries.find(key) != m_entries.end() ||
+        !base::is_file(entryFilename(key)))
+      continue;
+
+    m_lru.push_back(Entry{ key, size });
+    m_entries[key] = std::prev(m_lru.end());
+    m_totalSize += size;
+  }
+
+  // Thumbnails that are not in the index (e.g. the index wasn't
+  // saved because the program crashed) are the first ones to be
+  // discarded.
+  for (const auto& fn : base::list_files(m_dir)) {
+    if (base::get_file_extension(fn) != kThumbnailExtension+1)
+      continue;
+
+    key = base::get_file_title(fn);
+    if (m_entries.find(key) != m_entries.end())
+      continue;
+
+    size = base::file_size(base::join_path(m_dir, fn));
+    m_lru.push_front(Entry{ key, size });
+    m_entries[key] = m_lru.begin();
+    m_totalSize += size;
+    m_indexModified = true;
+  }
+
+  trim();
+}
+
+void ThumbnailCache::saveIndex()
+{
+  if (!base::is_directory(m_dir))
+    return;
+
+  std::ofstream s(FSTREAM_PATH(indexFilename()));
+  for (const Entry& entry : m_lru)
+    s << entry.key << ' ' << entry.size << '\n';
+
+  m_indexModified = false;
+}
+
+void ThumbnailCache::touch(LRU::iterator it)
+{
+  if (it != std::prev(m_lru.end())) {
+    m_lru.splice(m_lru.end(), m_lru, it);
+    m_indexModified = true;
+  }
+}
+
+void ThumbnailCache::remove(LRU::iterator it)
+{
+  const std::string fn = entryFilename(it->key);
+  if (base::is_file(fn))
+    base::delete_file(fn);
+
+  ASSERT(m_totalSize >= it->size);
+  m_totalSize -= std::min(m_totalSize, it->size);
+  m_entries.erase(it->key);
+  m_lru.erase(it);
+  m_indexModified = true;
+}
+
+void ThumbnailCache::trim()
+{
+  while (m_totalSize > m_maxSize && !m_lru.empty()) {
+    THUMB_CACHE_TRACE("THUMB: Discarding %s\n", m_lru.front().key.c_str());
+    remove(m_lru.begin());
+  }
+}
+
+} // namespace app
@@ -0,0 +1,74 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_THUMBNAIL_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace app {
+
+  // On-disk cache of file selector thumbnails. Each entry is keyed by
+  // the file path, its modification time and its size, so a modified
+  // file generates a new key (and the old entry is eventually
+  // discarded by the LRU policy). All member functions are
+  // thread-safe as they are called from ThumbnailGenerator workers.
+  class ThumbnailCache {
+  public:
+    // "dir" is the directory where thumbnails are stored, "maxSize"
+    // the maximum number of bytes used by all thumbnails in the disk.
+    ThumbnailCache(const std::string& dir,
+                   const std::size_t maxSize);
+    ~ThumbnailCache();
+
+    // Returns the cached RGB thumbnail for the given file, or nullptr
+    // if it's not in the cache (or the file was modified).
+    doc::ImageRef load(const std::string& filename);
+
+    // Stores the given RGB thumbnail of the given file.
+    void save(const std::string& filename,
+              const doc::Image* thumbnail);
+
+    // Deletes all cached thumbnails.
+    void clear();
+
+  private:
+    struct Entry {
+      std::string key;
+      std::size_t size;
+    };
+    using LRU = std::list<Entry>;
+
+    std::string makeKey(const std::string& filename) const;
+    std::string entryFilename(const std::string& key) const;
+    std::string indexFilename() const;
+    void loadIndex();
+    void saveIndex();
+    void touch(LRU::iterator it);
+    void remove(LRU::iterator it);
+    void trim();
+
+    std::mutex m_mutex;
+    std::string m_dir;
+    std::size_t m_maxSize;
+    std::size_t m_totalSize;
+    bool m_indexLoaded;
+    bool m_indexModified;
+    // Least recently used entries are at the front of the list.
+    LRU m_lru;
+    std::unordered_map<std::string, LRU::iterator> m_entries;
+  };
+
+} // namespace app
+
+#endif
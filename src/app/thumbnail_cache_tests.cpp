@@ -0,0 +1,107 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/thumbnail_cache.h"
+#include "base/fs.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <fstream>
+
+using namespace app;
+using namespace doc;
+
+static void make_file(const std::string& fn, const char* content)
+{
+  std::ofstream s(fn.c_str(), std::ofstream::binary);
+  s << content;
+}
+
+static void clear_dir(const std::string& dir)
+{
+  if (base::is_directory(dir)) {
+    for (const auto& fn : base::list_files(dir))
+      base::delete_file(base::join_path(dir, fn));
+  }
+  else
+    base::make_directory(dir);
+}
+
+TEST(ThumbnailCache, SaveLoad)
+{
+  const std::string dir = "_thumbs";
+  clear_dir(dir);
+  make_file("_thumb_a.txt", "a");
+
+  ImageRef thumb(Image::create(IMAGE_RGB, 4, 3));
+  clear_image(thumb.get(), rgba(255, 0, 0, 255));
+  put_pixel(thumb.get(), 1, 2, rgba(0, 0, 255, 128));
+
+  {
+    ThumbnailCache cache(dir, 1024*1024);
+    EXPECT_EQ(nullptr, cache.load("_thumb_a.txt"));
+    EXPECT_EQ(nullptr, cache.load("_thumb_nonexistent.txt"));
+    cache.save("_thumb_a.txt", thumb.get());
+  }
+
+  // A new cache instance must read the thumbnail from disk
+  {
+    ThumbnailCache cache(dir, 1024*1024);
+    ImageRef loaded = cache.load("_thumb_a.txt");
+    ASSERT_NE(nullptr, loaded);
+    EXPECT_EQ(4, loaded->width());
+    EXPECT_EQ(3, loaded->height());
+    EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(loaded.get(), 0, 0));
+    EXPECT_EQ(rgba(0, 0, 255, 128), get_pixel(loaded.get(), 1, 2));
+
+    // Modifying the file invalidates the thumbnail
+    make_file("_thumb_a.txt", "abc");
+    EXPECT_EQ(nullptr, cache.load("_thumb_a.txt"));
+  }
+
+  base::delete_file("_thumb_a.txt");
+}
+
+TEST(ThumbnailCache, DiscardLeastRecentlyUsed)
+{
+  const std::string dir = "_thumbs";
+  clear_dir(dir);
+  make_file("_thumb_a.txt", "a");
+  make_file("_thumb_b.txt", "b");
+  make_file("_thumb_c.txt", "c");
+
+  ImageRef thumb(Image::create(IMAGE_RGB, 64, 64));
+  clear_image(thumb.get(), rgba(0, 0, 0, 0));
+
+  // Calculate the size of one entry in the disk
+  std::size_t entrySize = 0;
+  {
+    ThumbnailCache cache(dir, 1024*1024);
+    cache.save("_thumb_a.txt", thumb.get());
+    for (const auto& fn : base::list_files(dir))
+      entrySize += base::file_size(base::join_path(dir, fn));
+    cache.clear();
+  }
+  ASSERT_LT(0, entrySize);
+
+  {
+    ThumbnailCache cache(dir, 2*entrySize);
+    cache.save("_thumb_a.txt", thumb.get());
+    cache.save("_thumb_b.txt", thumb.get());
+    EXPECT_NE(nullptr, cache.load("_thumb_a.txt")); // "a" is used
+    cache.save("_thumb_c.txt", thumb.get());        // "b" is discarded
+
+    EXPECT_NE(nullptr, cache.load("_thumb_a.txt"));
+    EXPECT_EQ(nullptr, cache.load("_thumb_b.txt"));
+    EXPECT_NE(nullptr, cache.load("_thumb_c.txt"));
+  }
+
+  base::delete_file("_thumb_a.txt");
+  base::delete_file("_thumb_b.txt");
+  base::delete_file("_thumb_c.txt");
+}
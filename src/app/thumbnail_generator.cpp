@@ -16,7 +16,11 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/pref/preferences.h"
+#include "app/resource_finder.h"
+#include "app/thumbnail_cache.h"
 #include "app/util/conversion_to_surface.h"
+#include "base/fs.h"
 #include "base/thread.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/image.h"
@@ -40,8 +44,10 @@ namespace app {
 
 class ThumbnailGenerator::Worker {
 public:
-  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue)
+  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue,
+         ThumbnailCache* cache)
     : m_queue(queue)
+    , m_cache(cache)
     , m_fop(nullptr)
     , m_isDone(false)
     , m_thread([this]{ loadBgThread(); }) {
@@ -85,6 +91,19 @@ private:
         ASSERT(m_fop);
       }
 
+      // Try to get the thumbnail from the disk cache, so we don't
+      // need to decode the file again.
+      if (m_cache) {
+        if (doc::ImageRef cached = m_cache->load(m_fop->filename())) {
+          THUMB_TRACE("FOP thumbnail from cache: %s\n",
+                      m_item.fileitem->fileName().c_str());
+          setThumbnail(cached.get(), nullptr);
+          m_fop->setProgress(1.0);
+          finishItem();
+          return;
+        }
+      }
+
       THUMB_TRACE("FOP loading thumbnail: %s\n",
                   m_item.fileitem->fileName().c_str());
 
@@ -128,10 +147,11 @@ private:
         thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
         thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
 
-        // Stretch the 'image'
+        // Stretch the 'image' (always in RGB so we can store it in
+        // the disk cache independently of the sprite palette)
         thumbnailImage.reset(
           Image::create(
-            sprite->pixelFormat(), thumb_w, thumb_h));
+            IMAGE_RGB, thumb_w, thumb_h));
 
         render::Projection proj(sprite->pixelRatio(),
                                 render::Zoom(thumb_w, w));
@@ -157,19 +177,10 @@ private:
 
       // Set the thumbnail of the file-item.
       if (thumbnailImage) {
-        os::SurfaceRef thumbnail =
-          os::instance()->makeRgbaSurface(
-            thumbnailImage->width(),
-            thumbnailImage->height());
+        setThumbnail(thumbnailImage.get(), palette.get());
 
-        convert_image_to_surface(
-          thumbnailImage.get(), palette.get(), thumbnail.get(),
-          0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
-
-        {
-          std::lock_guard lock(m_mutex);
-          m_item.fileitem->setThumbnail(thumbnail);
-        }
+        if (m_cache && !m_fop->hasError())
+          m_cache->save(m_fop->filename(), thumbnailImage.get());
       }
 
       THUMB_TRACE("FOP done with thumbnail: %s %s\n",
@@ -180,6 +191,25 @@ private:
       m_fop->setError("Error loading file:\n%s", e.what());
     }
 
+    finishItem();
+  }
+
+  void setThumbnail(const Image* thumbnailImage,
+                    const Palette* palette) {
+    os::SurfaceRef thumbnail =
+      os::instance()->makeRgbaSurface(
+        thumbnailImage->width(),
+        thumbnailImage->height());
+
+    convert_image_to_surface(
+      thumbnailImage, palette, thumbnail.get(),
+      0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
+
+    std::lock_guard lock(m_mutex);
+    m_item.fileitem->setThumbnail(thumbnail);
+  }
+
+  void finishItem() {
     if (!m_fop->isStop()) {
       // Set a nullptr thumbnail if we failed loading the given file,
       // in this way we're not going to re-try generating this same
@@ -222,6 +252,7 @@ private:
   }
 
   base::concurrent_queue<Item>& m_queue;
+  ThumbnailCache* m_cache;
   app::ThumbnailGenerator::Item m_item;
   FileOp* m_fop;
   mutable std::mutex m_mutex;
@@ -247,6 +278,26 @@ ThumbnailGenerator::ThumbnailGenerator()
   int n = std::thread::hardware_concurrency()-1;
   if (n < 1) n = 1;
   m_maxWorkers = n;
+
+  auto& pref = Preferences::instance();
+  if (pref.fileSelector.thumbnailCache()) {
+    ResourceFinder rf;
+    rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+    std::string dir = rf.getFirstOrCreateDefault();
+    if (!base::is_directory(dir))
+      base::make_directory(dir);
+
+    const std::size_t maxSize =
+      std::size_t(std::max(1, pref.fileSelector.thumbnailCacheSize())) * 1024 * 1024;
+    m_cache = std::make_unique<ThumbnailCache>(dir, maxSize);
+  }
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+  // Destroy all workers before the cache as they could be using it.
+  std::lock_guard lock(m_workersAccess);
+  m_workers.clear();
 }
 
 bool ThumbnailGenerator::checkWorkers()
@@ -346,7 +397,8 @@ void ThumbnailGenerator::startWorker()
 {
   std::lock_guard lock(m_workersAccess);
   if (m_workers.size() < m_maxWorkers) {
-    m_workers.push_back(std::make_unique<Worker>(m_remainingItems));
+    m_workers.push_back(std::make_unique<Worker>(m_remainingItems,
+                                                 m_cache.get()));
   }
 }
 
@@ -22,10 +22,13 @@ namespace base {
 namespace app {
   class FileOp;
   class IFileItem;
+  class ThumbnailCache;
 
   class ThumbnailGenerator {
     ThumbnailGenerator();
   public:
+    ~ThumbnailGenerator();
+
     static ThumbnailGenerator* instance();
 
     // Generate a thumbnail for the given file-item.  It must be called
@@ -61,6 +64,9 @@ namespace app {
     };
 
     int m_maxWorkers;
+    // Disk cache of generated thumbnails (can be nullptr if it's
+    // disabled in the preferences).
+    std::unique_ptr<ThumbnailCache> m_cache;
     WorkerList m_workers;
     std::mutex m_workersAccess;
     base::concurrent_queue<Item> m_remainingItems;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2016  Carlo Caputo
 //
@@ -10,20 +10,47 @@
 #include "config.h"
 #endif
 
+#include "app/thumbnails.h"
+
 #include "app/util/conversion_to_surface.h"
+#include "base/chrono.h"
 #include "doc/blend_mode.h"
 #include "doc/cel.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
 #include "doc/sprite.h"
+#include "doc/tileset.h"
 #include "os/surface.h"
 #include "os/system.h"
 #include "render/render.h"
 
+#include <algorithm>
+
 namespace app {
 namespace thumb {
 
-os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
-                                 const gfx::Size& fitInSize)
+namespace {
+
+// Max number of thumbnails in a CelThumbnailCache
+const std::size_t kMaxCachedThumbnails = 4096;
+
+// Time to generate thumbnails in each CelThumbnailCache tick
+const double kTickBudget = 0.008;
+
+// Tileset used to render the given cel (nullptr if it's not a tilemap)
+const doc::Tileset* get_cel_tileset(const doc::Cel* cel)
+{
+  if (cel->layer() && cel->layer()->isTilemap())
+    return static_cast<const doc::LayerTilemap*>(cel->layer())->tileset();
+  else
+    return nullptr;
+}
+
+os::SurfaceRef render_cel_thumbnail(const doc::Cel* cel,
+                                    const gfx::Size& fitInSize,
+                                    render::Render& render,
+                                    const doc::ImageBufferPtr& buffer)
 {
   gfx::Size newSize;
 
@@ -39,9 +66,8 @@ os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
 
   doc::ImageRef thumbnailImage(
     doc::Image::create(
-      doc::IMAGE_RGB, newSize.w, newSize.h));
+      doc::IMAGE_RGB, newSize.w, newSize.h, buffer));
 
-  render::Render render;
   render::Projection proj(cel->sprite()->pixelRatio(),
                           render::Zoom(newSize.w, cel->bounds().w));
   render.setProjection(proj);
@@ -70,5 +96,134 @@ os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
     return nullptr;
 }
 
+} // anonymous namespace
+
+os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
+                                 const gfx::Size& fitInSize)
+{
+  render::Render render;
+  return render_cel_thumbnail(cel, fitInSize, render, doc::ImageBufferPtr());
+}
+
+bool CelThumbnailCache::Entry::isUpToDate(const doc::Image* image,
+                                          const doc::Palette* palette,
+                                          const doc::Tileset* tileset) const
+{
+  return (imageVersion == image->version() &&
+          paletteId == palette->id() &&
+          paletteModifications == palette->getModifications() &&
+          tilesetId == (tileset ? tileset->id(): doc::NullId) &&
+          tilesetVersion == (tileset ? tileset->version(): 0));
+}
+
+void CelThumbnailCache::Entry::update(const doc::Image* image,
+                                      const doc::Palette* palette,
+                                      const doc::Tileset* tileset)
+{
+  imageVersion = image->version();
+  paletteId = palette->id();
+  paletteModifications = palette->getModifications();
+  tilesetId = (tileset ? tileset->id(): doc::NullId);
+  tilesetVersion = (tileset ? tileset->version(): 0);
+}
+
+CelThumbnailCache::CelThumbnailCache()
+  : m_timer(1)
+  , m_buffer(std::make_shared<doc::ImageBuffer>(1))
+{
+  m_timer.Tick.connect([this]{ onTick(); });
+}
+
+os::SurfaceRef CelThumbnailCache::get(const doc::Cel* cel,
+                                      const gfx::Size& fitInSize)
+{
+  const doc::Image* image = cel->image();
+  const doc::Palette* palette = cel->sprite()->palette(cel->frame());
+  if (!image || !palette)
+    return nullptr;
+
+  os::SurfaceRef surface;
+  auto it = m_entries.find(Key(image->id(), fitInSize.w, fitInSize.h));
+  if (it != m_entries.end()) {
+    Entry& entry = *it->second;
+    surface = entry.surface;
+
+    // Move to the front of the LRU list
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+
+    // Up-to-date thumbnail
+    if (entry.isUpToDate(image, palette, get_cel_tileset(cel)))
+      return surface;
+  }
+
+  // Request the thumbnail (if it's not already requested)
+  auto req = std::find_if(
+    m_requests.begin(), m_requests.end(),
+    [cel, &fitInSize](const Request& r){
+      return (r.celId == cel->id() && r.size == fitInSize);
+    });
+  if (req == m_requests.end()) {
+    m_requests.push_back(Request{ cel->id(), fitInSize });
+    if (!m_timer.isRunning())
+      m_timer.start();
+  }
+
+  // Returns the outdated thumbnail (better than nothing)
+  return surface;
+}
+
+void CelThumbnailCache::clear()
+{
+  m_timer.stop();
+  m_requests.clear();
+  m_entries.clear();
+  m_lru.clear();
+}
+
+void CelThumbnailCache::onTick()
+{
+  base::Chrono chrono;
+  bool ready = false;
+  std::size_t i = 0;
+
+  // Generate the oldest requests first
+  for (; i<m_requests.size() && chrono.elapsed() < kTickBudget; ++i) {
+    const Request& req = m_requests[i];
+
+    // The cel could be deleted since the request
+    auto cel = doc::get<doc::Cel>(req.celId);
+    if (!cel || !cel->image())
+      continue;
+
+    const doc::Image* image = cel->image();
+    const doc::Palette* palette = cel->sprite()->palette(cel->frame());
+    const Key key(image->id(), req.size.w, req.size.h);
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+      m_lru.push_front(Entry{ key });
+      it = m_entries.insert(std::make_pair(key, m_lru.begin())).first;
+    }
+
+    Entry& entry = *it->second;
+    entry.update(image, palette, get_cel_tileset(cel));
+    entry.surface = render_cel_thumbnail(cel, req.size, m_render, m_buffer);
+    ready = true;
+  }
+  m_requests.erase(m_requests.begin(), m_requests.begin()+i);
+
+  if (m_requests.empty())
+    m_timer.stop();
+
+  // Discard least recently used thumbnails
+  while (m_lru.size() > kMaxCachedThumbnails) {
+    m_entries.erase(m_lru.back().key);
+    m_lru.pop_back();
+  }
+
+  if (ready)
+    Ready();
+}
+
 } // thumb
 } // app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016  Carlo Caputo
 //
 // This program is distributed under the terms of
@@ -9,11 +9,25 @@
 #define APP_THUMBNAILS_H_INCLUDED
 #pragma once
 
+#include "doc/image_buffer.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
 #include "gfx/size.h"
+#include "obs/signal.h"
 #include "os/surface.h"
+#include "render/render.h"
+#include "ui/timer.h"
+
+#include <list>
+#include <map>
+#include <tuple>
+#include <vector>
 
 namespace doc {
   class Cel;
+  class Image;
+  class Palette;
+  class Tileset;
 }
 
 namespace os {
@@ -26,6 +40,61 @@ namespace thumb {
   os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
                                    const gfx::Size& fitInSize);
 
+  // Cache of cel thumbnails (e.g. for the timeline). Thumbnails are
+  // identified by the cel image (ID and version), the palette (ID and
+  // modifications), the tileset of tilemaps (ID and version) and the
+  // thumbnail size. Missing thumbnails are
+  // generated later from a timer (a few of them on each tick), so the
+  // caller can paint a placeholder and wait the Ready signal.
+  class CelThumbnailCache {
+  public:
+    CelThumbnailCache();
+
+    // Returns the thumbnail of the given cel. If it's not in the
+    // cache, it's requested and returns the previous thumbnail of the
+    // same cel image (if the image was modified) or nullptr.
+    os::SurfaceRef get(const doc::Cel* cel,
+                       const gfx::Size& fitInSize);
+
+    void clear();
+
+    // Emitted when new requested thumbnails are ready.
+    obs::signal<void()> Ready;
+
+  private:
+    using Key = std::tuple<doc::ObjectId, int, int>; // Image ID + size
+    struct Entry {
+      Key key;
+      doc::ObjectVersion imageVersion;
+      doc::ObjectId paletteId;
+      int paletteModifications;
+      doc::ObjectId tilesetId;
+      doc::ObjectVersion tilesetVersion;
+      os::SurfaceRef surface;
+
+      bool isUpToDate(const doc::Image* image,
+                      const doc::Palette* palette,
+                      const doc::Tileset* tileset) const;
+      void update(const doc::Image* image,
+                  const doc::Palette* palette,
+                  const doc::Tileset* tileset);
+    };
+    struct Request {
+      doc::ObjectId celId;
+      gfx::Size size;
+    };
+    using LRU = std::list<Entry>;
+
+    void onTick();
+
+    LRU m_lru;    // Most recently used entries are at the front
+    std::map<Key, LRU::iterator> m_entries;
+    std::vector<Request> m_requests;
+    ui::Timer m_timer;
+    render::Render m_render;
+    doc::ImageBufferPtr m_buffer;
+  };
+
 } // thumb
 } // app
 
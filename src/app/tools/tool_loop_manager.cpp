@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,6 +20,7 @@
 #include "app/tools/symmetry.h"
 #include "app/tools/tool_loop.h"
 #include "app/tools/velocity.h"
+#include "base/chrono.h"
 #include "doc/brush.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
@@ -27,6 +28,7 @@
 #include "gfx/point_io.h"
 #include "gfx/rect_io.h"
 #include "gfx/region.h"
+#include "prof/prof.h"
 
 #include <algorithm>
 #include <climits>
@@ -65,6 +67,14 @@ void ToolLoopManager::cancel()
 
 void ToolLoopManager::end()
 {
+  TOOL_TRACE("ToolLoopManager::end steps", m_stepTimes.steps,
+             "total", m_stepTimes.total,
+             "dirtyArea", m_stepTimes.dirtyArea,
+             "validateSrc", m_stepTimes.validateSrc,
+             "validateDst", m_stepTimes.validateDst,
+             "joinStroke", m_stepTimes.joinStroke,
+             "updateDirtyArea", m_stepTimes.updateDirtyArea);
+
   if (m_canceled)
     m_toolLoop->rollback();
   else
@@ -75,6 +85,7 @@ void ToolLoopManager::prepareLoop(const Pointer& pointer)
 {
   // Start with no points at all
   m_stroke.reset();
+  m_stepTimes = StepTimes();
 
   // Prepare the ink
   m_toolLoop->getInk()->prepareInk(m_toolLoop);
@@ -168,6 +179,8 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 
 void ToolLoopManager::movement(Pointer pointer)
 {
+  PROF_ZONE("app", "ToolLoopManager::movement");
+
   // Filter points with the stabilizer
   if (m_dynamics.stabilizerFactor > 0) {
     const double f = m_dynamics.stabilizerFactor;
@@ -204,9 +217,13 @@ void ToolLoopManager::movement(Pointer pointer)
 
 void ToolLoopManager::doLoopStep(bool lastStep)
 {
+  base::Chrono chrono;
+  double t0 = 0.0, t;
+
   // Original set of points to interwine (original user stroke,
   // relative to sprite origin).
-  Stroke main_stroke;
+  Stroke& main_stroke = m_mainStroke;
+  main_stroke.reset();
   if (!lastStep)
     m_toolLoop->getController()->getStrokeToInterwine(m_stroke, main_stroke);
   else
@@ -214,14 +231,23 @@ void ToolLoopManager::doLoopStep(bool lastStep)
 
   // Calculate the area to be updated in all document observers.
   Symmetry* symmetry = m_toolLoop->getSymmetry();
-  Strokes strokes;
-  if (symmetry)
+  Strokes& strokes = m_strokes;
+  if (symmetry) {
+    strokes.clear();
     symmetry->generateStrokes(main_stroke, strokes, m_toolLoop);
-  else
-    strokes.push_back(main_stroke);
+  }
+  else {
+    // Re-use the memory of the previous step
+    strokes.resize(1);
+    strokes[0] = main_stroke;
+  }
 
   calculateDirtyArea(strokes);
 
+  t = chrono.elapsed();
+  m_stepTimes.dirtyArea += t - t0;
+  t0 = t;
+
   // If we are not in the last step (when the mouse button is
   // released) we are only showing a preview of the tool, so we can
   // limit the dirty area to the visible viewport bounds. In this way
@@ -241,14 +267,18 @@ void ToolLoopManager::doLoopStep(bool lastStep)
 
   // Validate source image area.
   if (m_toolLoop->getInk()->needsSpecialSourceArea()) {
-    gfx::Region srcArea;
-    m_toolLoop->getInk()->createSpecialSourceArea(m_dirtyArea, srcArea);
-    m_toolLoop->validateSrcImage(srcArea);
+    m_srcArea.clear();
+    m_toolLoop->getInk()->createSpecialSourceArea(m_dirtyArea, m_srcArea);
+    m_toolLoop->validateSrcImage(m_srcArea);
   }
   else {
     m_toolLoop->validateSrcImage(m_dirtyArea);
   }
 
+  t = chrono.elapsed();
+  m_stepTimes.validateSrc += t - t0;
+  t0 = t;
+
   m_toolLoop->getInk()->prepareForStrokes(m_toolLoop, strokes);
 
   // True when we have to fill
@@ -268,6 +298,10 @@ void ToolLoopManager::doLoopStep(bool lastStep)
 
   m_toolLoop->validateDstImage(m_dirtyArea);
 
+  t = chrono.elapsed();
+  m_stepTimes.validateDst += t - t0;
+  t0 = t;
+
   // Join or fill user points
   if (fillStrokes)
     m_toolLoop->getIntertwine()->fillStroke(m_toolLoop, main_stroke);
@@ -280,12 +314,22 @@ void ToolLoopManager::doLoopStep(bool lastStep)
     m_toolLoop->copyValidDstToSrcImage(m_dirtyArea);
   }
 
+  t = chrono.elapsed();
+  m_stepTimes.joinStroke += t - t0;
+  t0 = t;
+
   if (!m_dirtyArea.isEmpty()) {
     m_toolLoop->validateDstTileset(m_dirtyArea);
     m_toolLoop->updateDirtyArea(m_dirtyArea);
   }
 
-  TOOL_TRACE("ToolLoopManager::doLoopStep dirtyArea", m_dirtyArea.bounds());
+  t = chrono.elapsed();
+  m_stepTimes.updateDirtyArea += t - t0;
+  m_stepTimes.total += t;
+  ++m_stepTimes.steps;
+
+  TOOL_TRACE("ToolLoopManager::doLoopStep dirtyArea", m_dirtyArea.bounds(),
+             "time", t);
 }
 
 // Applies the grid settings to the specified sprite point.
@@ -308,7 +352,8 @@ void ToolLoopManager::snapToGrid(Stroke::Pt& pt)
 void ToolLoopManager::calculateDirtyArea(const Strokes& strokes)
 {
   // Save the current dirty area if it's needed
-  Region prevDirtyArea;
+  Region& prevDirtyArea = m_prevDirtyArea;
+  prevDirtyArea.clear();
   if (m_toolLoop->getTracePolicy() == TracePolicy::Last)
     prevDirtyArea = m_nextDirtyArea;
 
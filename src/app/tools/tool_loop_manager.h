@@ -80,6 +80,20 @@ public:
 
   const Pointer& lastPointer() const { return m_lastPointer; }
 
+  // Accumulated time (in seconds) spent in each phase of the loop
+  // steps of the current stroke. Useful to profile tools with big
+  // brushes/canvases.
+  struct StepTimes {
+    int steps = 0;
+    double dirtyArea = 0.0;
+    double validateSrc = 0.0;
+    double validateDst = 0.0;
+    double joinStroke = 0.0;
+    double updateDirtyArea = 0.0;
+    double total = 0.0;
+  };
+  const StepTimes& stepTimes() const { return m_stepTimes; }
+
 private:
   void doLoopStep(bool lastStep);
   void snapToGrid(Stroke::Pt& pt);
@@ -95,6 +109,15 @@ private:
   Pointer m_lastPointer;
   gfx::Region m_dirtyArea;
   gfx::Region m_nextDirtyArea;
+
+  // Scratch data reused in each doLoopStep() of the stroke (so we
+  // don't allocate new vectors/regions on each mouse movement).
+  Stroke m_mainStroke;
+  Strokes m_strokes;
+  gfx::Region m_prevDirtyArea;
+  gfx::Region m_srcArea;
+
+  StepTimes m_stepTimes;
   doc::Brush m_brush0;
   DynamicsOptions m_dynamics;
   gfx::PointF m_stabilizerCenter;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -64,6 +64,7 @@
 #include "os/sampling.h"
 #include "os/surface.h"
 #include "os/system.h"
+#include "prof/prof.h"
 #include "render/rasterize.h"
 #include "ui/ui.h"
 
@@ -670,6 +671,10 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     m_document->notifyExposeSpritePixels(m_sprite, gfx::Region(expose));
 
     m_renderEngine->setNewBlendMethod(pref.experimental.newBlend());
+    // Images can be modified in-place (without a new version) while
+    // a transaction is active (e.g. by the tool loop), so we cannot
+    // use the cached mip levels of those images.
+    m_renderEngine->setMipmaps(m_document->transaction() == nullptr);
     m_renderEngine->setRefLayersVisiblity(true);
     m_renderEngine->setSelectedLayer(m_layer);
     if (m_flags & Editor::kUseNonactiveLayersOpacityWhenEnabled)
@@ -2197,6 +2202,8 @@ void Editor::onResize(ui::ResizeEvent& ev)
 
 void Editor::onPaint(ui::PaintEvent& ev)
 {
+  PROF_ZONE("app", "Editor::onPaint");
+
   std::unique_ptr<HideBrushPreview> hide;
   if (m_flashing == Flashing::None) {
     // If we are drawing the editor for a tooltip background or any
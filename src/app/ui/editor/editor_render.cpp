@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -72,6 +72,11 @@ void EditorRender::setNewBlendMethod(const bool newBlend)
   m_renderer->setNewBlendMethod(newBlend);
 }
 
+void EditorRender::setMipmaps(const bool state)
+{
+  m_renderer->setMipmaps(state);
+}
+
 void EditorRender::setProjection(const render::Projection& projection)
 {
   m_renderer->setProjection(projection);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -42,11 +42,14 @@
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "gfx/region.h"
 #include "render/render.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 
 #if _DEBUG
 #define DUMP_INNER_CMDS() dumpInnerCmds()
@@ -56,6 +59,34 @@
 
 namespace app {
 
+// Data to calculate the RotSprite version of the extra cel in a
+// background thread. Images are copies, so the main thread can
+// continue modifying the originals.
+struct PixelsMovement::RotSpriteJob {
+  doc::ImageRef dst;
+  doc::ImageRef background;     // "dst" before drawing the RotSprite
+  doc::ImageRef src;
+  doc::ImageRef mask;
+  std::array<int, 8> corners;
+  bool ready = false;           // Filled by drawParallelogram()
+  bool failed = false;          // Not enough memory
+  std::atomic<bool> done { false };
+
+  // Returns true if the result of this job is the RotSprite of the
+  // given parameters (so it can be reused instead of calculating it
+  // again).
+  bool matches(const doc::Image* dst2,
+               const doc::Image* src2,
+               const doc::Image* mask2,
+               const std::array<int, 8>& corners2) const {
+    return (corners == corners2 &&
+            src->maskColor() == src2->maskColor() &&
+            (mask ? (mask2 && doc::is_same_image(mask.get(), mask2)): !mask2) &&
+            doc::is_same_image(background.get(), dst2) &&
+            doc::is_same_image(src.get(), src2));
+  }
+};
+
 PixelsMovement::InnerCmd::InnerCmd(InnerCmd&& c)
   : type(None)
 {
@@ -129,6 +160,7 @@ PixelsMovement::PixelsMovement(
   , m_canHandleFrameChange(false)
   , m_fastMode(false)
   , m_needsRotSpriteRedraw(false)
+  , m_rotSpriteTimer(10)
 {
   double cornerThick = (m_site.tilemapMode() == TilemapMode::Tiles) ?
                           CORNER_THICK_FOR_TILEMAP_MODE :
@@ -152,6 +184,7 @@ PixelsMovement::PixelsMovement(
   m_rotAlgoConn =
     Preferences::instance().selection.rotationAlgorithm.AfterChange.connect(
       [this]{ onRotationAlgorithmChange(); });
+  m_rotSpriteTimer.Tick.connect([this]{ onRotSpriteTimer(); });
 
   // The extra cel must be null, because if it's not null, it means
   // that someone else is using it (e.g. the editor brush preview),
@@ -171,6 +204,15 @@ PixelsMovement::PixelsMovement(
   }
 }
 
+PixelsMovement::~PixelsMovement()
+{
+  cancelRotSpriteTask();
+
+  // The task cannot be destroyed while it's running
+  if (m_taskJob)
+    m_rotSpriteTask.wait();
+}
+
 bool PixelsMovement::editMultipleCels() const
 {
   return
@@ -189,8 +231,9 @@ void PixelsMovement::setFastMode(const bool fastMode)
   bool redraw = (m_fastMode && !fastMode);
   m_fastMode = fastMode;
   if (m_needsRotSpriteRedraw && redraw) {
-    redrawExtraImage();
-    update_screen_for_document(m_document);
+    // The fast version is kept on the screen until the RotSprite
+    // one is ready.
+    startRotSpriteTask();
     m_needsRotSpriteRedraw = false;
   }
 }
@@ -707,6 +750,13 @@ void PixelsMovement::moveImage(const gfx::PointF& pos, MoveModifier moveModifier
   }
 
   setTransformationBase(newTransformation);
+
+  // The fast version is displayed while the RotSprite one is
+  // calculated in the background (the next movement cancels it).
+  if (m_fastMode && m_needsRotSpriteRedraw) {
+    startRotSpriteTask();
+    m_needsRotSpriteRedraw = false;
+  }
 }
 
 void PixelsMovement::getDraggedImageCopy(std::unique_ptr<Image>& outputImage,
@@ -1024,6 +1074,11 @@ void PixelsMovement::redrawExtraImage(Transformation* transformation)
     drawImage(*transformation, m_extraCel->image(),
               gfx::PointF(bounds.origin()), true);
   }
+
+  // The result of the background RotSprite is not valid anymore (we
+  // cancel it after drawImage() because drawParallelogram() can wait
+  // the running task to reuse its result)
+  cancelRotSpriteTask();
 }
 
 void PixelsMovement::redrawCurrentMask()
@@ -1133,8 +1188,10 @@ void PixelsMovement::drawParallelogram(
     rotAlgo = tools::RotationAlgorithm::FAST;
   }
 
-  // Don't use RotSprite if we are in "fast mode"
-  if (rotAlgo == tools::RotationAlgorithm::ROTSPRITE && m_fastMode) {
+  // Don't use RotSprite if we are in "fast mode" (except to prepare
+  // the background task)
+  if (rotAlgo == tools::RotationAlgorithm::ROTSPRITE && m_fastMode &&
+      !m_newRotSpriteJob) {
     m_needsRotSpriteRedraw = true;
     rotAlgo = tools::RotationAlgorithm::FAST;
   }
@@ -1157,18 +1214,57 @@ retry:;      // In case that we don't have enough memory for RotSprite
         int(corners.leftBottom().y-leftTop.y));
       break;
 
-    case tools::RotationAlgorithm::ROTSPRITE:
+    case tools::RotationAlgorithm::ROTSPRITE: {
+      const std::array<int, 8> c = {
+        int(corners.leftTop().x-leftTop.x),
+        int(corners.leftTop().y-leftTop.y),
+        int(corners.rightTop().x-leftTop.x),
+        int(corners.rightTop().y-leftTop.y),
+        int(corners.rightBottom().x-leftTop.x),
+        int(corners.rightBottom().y-leftTop.y),
+        int(corners.leftBottom().x-leftTop.x),
+        int(corners.leftBottom().y-leftTop.y) };
+      const Image* maskBitmap = (mask ? mask->bitmap(): nullptr);
+
+      // Called from startRotSpriteTask(), the RotSprite will be
+      // calculated in a background thread.
+      if (m_newRotSpriteJob) {
+        RotSpriteJob* job = m_newRotSpriteJob;
+        ASSERT(job->dst.get() == dst);
+        job->background.reset(Image::createCopy(dst));
+        job->src.reset(Image::createCopy(src));
+        if (maskBitmap)
+          job->mask.reset(Image::createCopy(maskBitmap));
+        job->corners = c;
+        job->ready = true;
+        break;
+      }
+
+      // Reuse the result of the background task (e.g. when the
+      // pixels are dropped after the RotSprite preview is ready)
+      if (m_rotSpriteResult &&
+          m_rotSpriteResult->matches(dst, src, maskBitmap, c)) {
+        dst->copy(m_rotSpriteResult->dst.get(), gfx::Clip(dst->bounds()));
+        break;
+      }
+
+      // If the running background task is calculating the same
+      // RotSprite (e.g. the pixels are dropped before the preview is
+      // ready), we wait it instead of calculating it again.
+      if (m_taskJob &&
+          m_taskJob == m_rotSpriteJob &&
+          m_taskJob->matches(dst, src, maskBitmap, c)) {
+        m_rotSpriteTask.wait();
+        if (!m_taskJob->failed) {
+          dst->copy(m_taskJob->dst.get(), gfx::Clip(dst->bounds()));
+          break;
+        }
+      }
+
       try {
         doc::algorithm::rotsprite_image(
-          dst, src, (mask ? mask->bitmap(): nullptr),
-          int(corners.leftTop().x-leftTop.x),
-          int(corners.leftTop().y-leftTop.y),
-          int(corners.rightTop().x-leftTop.x),
-          int(corners.rightTop().y-leftTop.y),
-          int(corners.rightBottom().x-leftTop.x),
-          int(corners.rightBottom().y-leftTop.y),
-          int(corners.leftBottom().x-leftTop.x),
-          int(corners.leftBottom().y-leftTop.y));
+          dst, src, maskBitmap,
+          c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7]);
       }
       catch (const std::bad_alloc&) {
         StatusBar::instance()->showTip(
@@ -1179,6 +1275,7 @@ retry:;      // In case that we don't have enough memory for RotSprite
         goto retry;
       }
       break;
+    }
 
   }
 }
@@ -1255,6 +1352,97 @@ void PixelsMovement::onRotationAlgorithmChange()
   }
 }
 
+void PixelsMovement::startRotSpriteTask()
+{
+  cancelRotSpriteTask();
+
+  const Image* extraImage = (m_extraCel ? m_extraCel->image(): nullptr);
+  if (!extraImage || m_site.tilemapMode() == TilemapMode::Tiles)
+    return;
+
+  auto job = std::make_shared<RotSpriteJob>();
+  job->dst.reset(Image::create(extraImage->spec()));
+
+  // drawImage() prepares the background of the image in this thread
+  // and drawParallelogram() fills the job instead of calling
+  // rotsprite_image().
+  m_newRotSpriteJob = job.get();
+  drawImage(m_currentData, job->dst.get(),
+            gfx::PointF(m_currentData.transformedBounds().origin()), true);
+  m_newRotSpriteJob = nullptr;
+
+  if (!job->ready)
+    return;
+
+  m_rotSpriteJob = job;
+  m_rotSpriteTimer.start();
+  onRotSpriteTimer();
+}
+
+void PixelsMovement::cancelRotSpriteTask()
+{
+  if (m_taskJob)
+    m_rotSpriteTask.cancel();
+  m_rotSpriteJob.reset();
+}
+
+void PixelsMovement::onRotSpriteTimer()
+{
+  // Wait the running task (it can be a canceled one). The "done"
+  // flag is set before the task is completed, so we wait both to
+  // avoid restarting the task while it's still running.
+  if (m_taskJob) {
+    if (!m_taskJob->done ||
+        !m_rotSpriteTask.completed())
+      return;
+
+    auto job = m_taskJob;
+    m_taskJob.reset();
+
+    if (job == m_rotSpriteJob) {
+      m_rotSpriteJob.reset();
+
+      if (job->failed) {
+        StatusBar::instance()->showTip(
+          1000,
+          Strings::statusbar_tips_not_enough_rotsprite_memory());
+      }
+      else if (m_extraCel &&
+               m_extraCel == m_document->extraCel() &&
+               m_extraCel->image() &&
+               m_extraCel->image()->bounds() == job->dst->bounds()) {
+        m_extraCel->image()->copy(job->dst.get(),
+                                  gfx::Clip(job->dst->bounds()));
+        update_screen_for_document(m_document);
+
+        // Keep the result to reuse it when the pixels are dropped
+        m_rotSpriteResult = job;
+      }
+    }
+  }
+
+  if (!m_rotSpriteJob) {
+    m_rotSpriteTimer.stop();
+    return;
+  }
+
+  m_taskJob = m_rotSpriteJob;
+  m_rotSpriteTask.run(
+    [job = m_taskJob](base::task_token& token){
+      try {
+        const auto& c = job->corners;
+        doc::algorithm::rotsprite_image(
+          job->dst.get(), job->src.get(), job->mask.get(),
+          c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7],
+          &token);
+      }
+      catch (const std::bad_alloc&) {
+        job->failed = true;
+      }
+      job->done = true;
+    });
+}
+
 void PixelsMovement::updateDocumentMask()
 {
   m_document->setMask(m_currentMask.get());
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,7 @@
 #include "app/context_access.h"
 #include "app/extra_cel.h"
 #include "app/site.h"
+#include "app/task.h"
 #include "app/transformation.h"
 #include "app/tx.h"
 #include "app/ui/editor/handle_type.h"
@@ -20,6 +21,7 @@
 #include "doc/image_ref.h"
 #include "gfx/size.h"
 #include "obs/connection.h"
+#include "ui/timer.h"
 
 #include <memory>
 
@@ -74,6 +76,7 @@ namespace app {
                    const Image* moveThis,
                    const Mask* mask,
                    const char* operationName);
+    ~PixelsMovement();
 
     HandleType handle() const { return m_handle; }
     bool canHandleFrameChange() const { return m_canHandleFrameChange; }
@@ -153,6 +156,9 @@ namespace app {
       doc::Image* dst, const doc::Image* src, const doc::Mask* mask);
     void updateDocumentMask();
     void hideDocumentMask();
+    void startRotSpriteTask();
+    void cancelRotSpriteTask();
+    void onRotSpriteTimer();
 
     void flipOriginalImage(const doc::algorithm::FlipType flipType);
     void shiftOriginalImage(const int dx, const int dy,
@@ -190,6 +196,19 @@ namespace app {
     bool m_fastMode;
     bool m_needsRotSpriteRedraw;
 
+    // In fast mode (while the pixels are dragged) and when we leave
+    // it, the RotSprite version of the extra cel is calculated in a
+    // background task, and the fast version is displayed until the
+    // task finishes. Any change in the extra cel cancels the task,
+    // and dropping the pixels reuses its result.
+    struct RotSpriteJob;
+    std::shared_ptr<RotSpriteJob> m_rotSpriteJob; // Job to show in the extra cel
+    std::shared_ptr<RotSpriteJob> m_taskJob;      // Job running in m_rotSpriteTask
+    std::shared_ptr<RotSpriteJob> m_rotSpriteResult; // Last finished job
+    RotSpriteJob* m_newRotSpriteJob = nullptr;    // Job being filled by drawParallelogram()
+    app::Task m_rotSpriteTask;
+    ui::Timer m_rotSpriteTimer;
+
     // Commands used in the interaction with the transformed pixels.
     // This is used to re-create the whole interaction on each
     // modified cel when we are modifying multiples cels at the same
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -201,7 +201,9 @@ void HomeView::onNewFile()
 void HomeView::onOpenFile()
 {
   Command* command = Commands::instance()->byId(CommandId::OpenFile());
-  UIContext::instance()->executeCommandFromMenuOrShortcut(command);
+  Params params;
+  params.set("progressive", "true");
+  UIContext::instance()->executeCommandFromMenuOrShortcut(command, params);
 }
 
 void HomeView::onResize(ui::ResizeEvent& ev)
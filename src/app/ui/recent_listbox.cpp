@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -319,6 +319,7 @@ void RecentFilesListBox::onClick(const std::string& path)
   Command* command = Commands::instance()->byId(CommandId::OpenFile());
   Params params;
   params.set("filename", path.c_str());
+  params.set("progressive", "true");
   UIContext::instance()->executeCommandFromMenuOrShortcut(command, params);
 }
 
@@ -357,6 +358,7 @@ void RecentFoldersListBox::onClick(const std::string& path)
   Command* command = Commands::instance()->byId(CommandId::OpenFile());
   Params params;
   params.set("folder", path.c_str());
+  params.set("progressive", "true");
   UIContext::instance()->executeCommandFromMenuOrShortcut(command, params);
 }
 
@@ -258,6 +258,8 @@ Timeline::Timeline(TooltipManager* tooltipManager)
 {
   enableFlags(CTRL_RIGHT_CLICK);
 
+  m_celThumbnails.Ready.connect([this]{ invalidate(); });
+
   m_ctxConn1 = m_context->BeforeCommandExecution.connect(
     &Timeline::onBeforeCommandExecution, this);
   m_ctxConn2 = m_context->AfterCommandExecution.connect(
@@ -406,6 +408,7 @@ void Timeline::detachDocument()
 
   if (m_document) {
     m_thumbnailsPrefConn.disconnect();
+    m_celThumbnails.clear();
     m_document->remove_observer(this);
     m_document = nullptr;
   }
@@ -2390,7 +2393,7 @@ void Timeline::drawCel(ui::Graphics* g,
         skinTheme()->calcBorder(this, style));
 
     if (!thumb_bounds.isEmpty()) {
-      if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, thumb_bounds.size())) {
+      if (os::SurfaceRef surface = m_celThumbnails.get(cel, thumb_bounds.size())) {
         const int t = std::clamp(thumb_bounds.w/8, 4, 16);
         draw_checkered_grid(g, thumb_bounds, gfx::Size(t, t), docPref());
 
@@ -2484,7 +2487,7 @@ void Timeline::drawCelOverlay(ui::Graphics* g)
 
   gfx::Rect rc = m_sprite->bounds().fitIn(
     gfx::Rect(m_thumbnailsOverlayBounds).shrink(1));
-  if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, rc.size())) {
+  if (os::SurfaceRef surface = m_celThumbnails.get(cel, rc.size())) {
     draw_checkered_grid(g, rc, gfx::Size(8, 8)*ui::guiscale(), docPref());
 
     g->drawRgbaSurface(surface.get(),
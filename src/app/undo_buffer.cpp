@@ -0,0 +1,366 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undo_buffer.h"
+
+#include "base/convert_to.h"
+#include "base/debug.h"
+#include "base/exception.h"
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/process.h"
+#include "base/thread_pool.h"
+
+#include "zlib.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+#define UNDO_BUFFER_TRACE(...)
+
+namespace app {
+
+namespace {
+
+// Buffers smaller than this are not compressed.
+const size_t kMinCompressSize = 4*1024;
+
+// Only one thread to compress undo data in the background, so we
+// don't compete with other tasks (e.g. rendering). It's created the
+// first time it's needed.
+base::thread_pool& compress_pool()
+{
+  static base::thread_pool pool(1);
+  return pool;
+}
+
+bool seek_file(FILE* file, const uint64_t pos)
+{
+#ifdef _WIN32
+  return (_fseeki64(file, int64_t(pos), SEEK_SET) == 0);
+#else
+  return (fseeko(file, off_t(pos), SEEK_SET) == 0);
+#endif
+}
+
+// Temporary file where compressed undo data is swapped out. The
+// ranges of released entries are reused by next writes, and the file
+// is truncated when all the entries are released. It can be used
+// from any thread.
+class UndoSwapFile {
+public:
+  static UndoSwapFile* instance() {
+    static UndoSwapFile swapFile;
+    return &swapFile;
+  }
+
+  ~UndoSwapFile() {
+    if (m_file) {
+      m_file.reset();
+      base::delete_file(m_filename);
+    }
+  }
+
+  bool write(const base::buffer& buf, uint64_t& pos) {
+    std::lock_guard lock(m_mutex);
+
+    if (!m_file) {
+      m_filename = base::join_path(
+        base::get_temp_path(),
+        "aseprite-undo-" +
+        base::convert_to<std::string>(int(base::get_current_process_id())) +
+        ".tmp");
+      m_file = base::open_file(m_filename, "w+b");
+      if (!m_file)
+        return false;
+    }
+
+    pos = allocRange(buf.size());
+    if (!seek_file(m_file.get(), pos) ||
+        std::fwrite(&buf[0], 1, buf.size(), m_file.get()) != buf.size()) {
+      freeRange(pos, buf.size());
+      return false;
+    }
+
+    UNDO_BUFFER_TRACE("UNDO: Swap out %d bytes at %lld\n",
+                      int(buf.size()), (long long)pos);
+
+    ++m_entries;
+    return true;
+  }
+
+  bool read(const uint64_t pos, base::buffer& buf) {
+    std::lock_guard lock(m_mutex);
+    ASSERT(m_file);
+    return (m_file &&
+            seek_file(m_file.get(), pos) &&
+            std::fread(&buf[0], 1, buf.size(), m_file.get()) == buf.size());
+  }
+
+  void release(const uint64_t pos, const uint64_t size) {
+    std::lock_guard lock(m_mutex);
+    ASSERT(m_entries > 0);
+    if (--m_entries == 0) {
+      // Truncate the file
+      m_file = base::open_file(m_filename, "w+b");
+      m_freeRanges.clear();
+      m_end = 0;
+    }
+    else {
+      freeRange(pos, size);
+    }
+  }
+
+private:
+  UndoSwapFile() { }
+
+  // Returns the position of the first free range where "size" bytes
+  // fit, or the end of the file.
+  uint64_t allocRange(const uint64_t size) {
+    for (auto it=m_freeRanges.begin(); it!=m_freeRanges.end(); ++it) {
+      if (it->second >= size) {
+        const uint64_t pos = it->first;
+        const uint64_t rest = it->second - size;
+        m_freeRanges.erase(it);
+        if (rest > 0)
+          m_freeRanges[pos+size] = rest;
+        return pos;
+      }
+    }
+    const uint64_t pos = m_end;
+    m_end += size;
+    return pos;
+  }
+
+  void freeRange(uint64_t pos, uint64_t size) {
+    // Join with the next free range
+    auto next = m_freeRanges.find(pos+size);
+    if (next != m_freeRanges.end()) {
+      size += next->second;
+      m_freeRanges.erase(next);
+    }
+
+    // Join with the previous free range
+    auto it = m_freeRanges.lower_bound(pos);
+    if (it != m_freeRanges.begin()) {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second == pos) {
+        pos = prev->first;
+        size += prev->second;
+        m_freeRanges.erase(prev);
+      }
+    }
+
+    // A free range at the end of the file is just discarded
+    if (pos + size == m_end)
+      m_end = pos;
+    else
+      m_freeRanges[pos] = size;
+  }
+
+  std::mutex m_mutex;
+  std::string m_filename;
+  base::FileHandle m_file;
+  std::map<uint64_t, uint64_t> m_freeRanges; // Position -> size
+  uint64_t m_end = 0;
+  int m_entries = 0;
+};
+
+} // anonymous namespace
+
+struct UndoBuffer::Data {
+  // The state is changed only from the main thread.
+  enum class State { Raw, Compressing, Compressed, SwappedOut };
+  State state = State::Raw;
+
+  base::buffer raw;
+  base::buffer compressed;
+  size_t rawSize = 0;
+  size_t compressedSize = 0;
+  uint64_t swapPos = 0;
+
+  // Used to synchronize the main thread with the background
+  // compression (when state == Compressing).
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool taskDone = false;
+  bool taskOk = false;
+};
+
+UndoBuffer::UndoBuffer()
+  : m_data(std::make_shared<Data>())
+{
+}
+
+UndoBuffer::~UndoBuffer()
+{
+  // If we're still compressing, the background task keeps a
+  // reference to m_data, so we don't need to wait it.
+  if (m_data->state == Data::State::SwappedOut)
+    UndoSwapFile::instance()->release(m_data->swapPos, m_data->compressedSize);
+}
+
+base::buffer& UndoBuffer::data()
+{
+  wait();
+
+  Data* d = m_data.get();
+  if (d->state == Data::State::SwappedOut) {
+    d->compressed.resize(d->compressedSize);
+    if (!UndoSwapFile::instance()->read(d->swapPos, d->compressed)) {
+      // Keep the data in the swap file (it's released in the
+      // destructor) so we can try to read it again.
+      base::buffer().swap(d->compressed);
+      throw base::Exception("Error reading undo data from the swap file");
+    }
+
+    UndoSwapFile::instance()->release(d->swapPos, d->compressedSize);
+    d->state = Data::State::Compressed;
+  }
+
+  if (d->state == Data::State::Compressed) {
+    d->raw.resize(d->rawSize);
+    uLongf rawSize = d->rawSize;
+    const int err = uncompress(&d->raw[0], &rawSize,
+                               &d->compressed[0], d->compressed.size());
+    if (err != Z_OK || rawSize != d->rawSize)
+      throw base::Exception("ZLib error %d uncompressing undo data", err);
+
+    base::buffer().swap(d->compressed);
+    d->state = Data::State::Raw;
+  }
+
+  ASSERT(d->state == Data::State::Raw);
+  return d->raw;
+}
+
+size_t UndoBuffer::memSize() const
+{
+  update();
+
+  switch (m_data->state) {
+    case Data::State::Raw:
+    case Data::State::Compressing:
+      // The compressed buffer is not counted until the compression
+      // finishes (and we release the raw buffer).
+      return m_data->raw.size();
+    case Data::State::Compressed:
+      return m_data->compressed.size();
+    case Data::State::SwappedOut:
+      return 0;
+  }
+  return 0;
+}
+
+void UndoBuffer::compress()
+{
+  update();
+
+  Data* d = m_data.get();
+  if (d->state != Data::State::Raw ||
+      d->raw.size() < kMinCompressSize)
+    return;
+
+  d->state = Data::State::Compressing;
+  d->taskDone = false;
+  d->rawSize = d->raw.size();
+
+  compress_pool().execute(
+    [data = m_data]{
+      // The main thread doesn't modify "raw" while we are in the
+      // Compressing state.
+      uLongf size = compressBound(data->raw.size());
+      base::buffer out(size);
+      const int err = compress2(&out[0], &size,
+                                &data->raw[0], data->raw.size(),
+                                Z_BEST_SPEED);
+      const bool ok = (err == Z_OK && size < data->raw.size());
+      if (ok) {
+        out.resize(size);
+        out.shrink_to_fit();
+      }
+
+      std::lock_guard lock(data->mutex);
+      if (ok)
+        data->compressed.swap(out);
+      data->taskOk = ok;
+      data->taskDone = true;
+      data->cv.notify_all();
+    });
+}
+
+void UndoBuffer::swapOut()
+{
+  update();
+
+  Data* d = m_data.get();
+  if (d->state != Data::State::Compressed)
+    return;
+
+  if (UndoSwapFile::instance()->write(d->compressed, d->swapPos)) {
+    d->compressedSize = d->compressed.size();
+    base::buffer().swap(d->compressed);
+    d->state = Data::State::SwappedOut;
+  }
+}
+
+bool UndoBuffer::isCompressing() const
+{
+  update();
+  return (m_data->state == Data::State::Compressing);
+}
+
+bool UndoBuffer::isCompressed() const
+{
+  update();
+  return (m_data->state == Data::State::Compressed);
+}
+
+bool UndoBuffer::isSwappedOut() const
+{
+  return (m_data->state == Data::State::SwappedOut);
+}
+
+// Applies the result of the background compression (if it's
+// finished).
+void UndoBuffer::update() const
+{
+  Data* d = m_data.get();
+  if (d->state != Data::State::Compressing)
+    return;
+
+  std::lock_guard lock(d->mutex);
+  if (!d->taskDone)
+    return;
+
+  if (d->taskOk) {
+    base::buffer().swap(d->raw);
+    d->state = Data::State::Compressed;
+  }
+  else {
+    d->state = Data::State::Raw;
+  }
+}
+
+void UndoBuffer::wait() const
+{
+  Data* d = m_data.get();
+  if (d->state == Data::State::Compressing) {
+    std::unique_lock lock(d->mutex);
+    d->cv.wait(lock, [d]{ return d->taskDone; });
+  }
+  update();
+}
+
+} // namespace app
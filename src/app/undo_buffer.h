@@ -0,0 +1,67 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UNDO_BUFFER_H_INCLUDED
+#define APP_UNDO_BUFFER_H_INCLUDED
+#pragma once
+
+#include "base/buffer.h"
+#include "base/disable_copying.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace app {
+
+  // Buffer to store undo data (e.g. pixels of a cmd::CopyRegion)
+  // that can be compressed in a background thread and then moved to
+  // a temporary file when the undo state is far from the current
+  // one. The data is restored transparently when it's accessed
+  // again with data().
+  //
+  // All member functions must be called from the same thread (the
+  // main thread), only the compression is done in other thread.
+  class UndoBuffer {
+  public:
+    UndoBuffer();
+    ~UndoBuffer();
+
+    // Returns the uncompressed data. If the data was compressed or
+    // swapped out, it's restored (so this can be slow).
+    base::buffer& data();
+
+    // Bytes used in memory by this buffer (zero if it's in the swap
+    // file). This value changes when the background compression
+    // finishes.
+    size_t memSize() const;
+
+    // Starts compressing the data in a background thread. The
+    // uncompressed data is released (and memSize() is reduced) when
+    // the compression finishes.
+    void compress();
+
+    // Moves the compressed data to the undo swap file. Does nothing
+    // if the data is not compressed yet.
+    void swapOut();
+
+    bool isCompressing() const;
+    bool isCompressed() const;
+    bool isSwappedOut() const;
+
+  private:
+    struct Data;
+
+    void update() const;
+    void wait() const;
+
+    std::shared_ptr<Data> m_data;
+
+    DISABLE_COPYING(UndoBuffer);
+  };
+
+} // namespace app
+
+#endif
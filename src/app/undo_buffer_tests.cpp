@@ -0,0 +1,121 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/undo_buffer.h"
+
+#include <chrono>
+#include <initializer_list>
+#include <thread>
+
+using namespace app;
+
+static base::buffer make_data(const size_t size, const int seed = 0)
+{
+  base::buffer buf(size);
+  for (size_t i=0; i<size; ++i)
+    buf[i] = uint8_t((i / 64 + seed) & 0xff);
+  return buf;
+}
+
+static void wait_compression(UndoBuffer& buf)
+{
+  for (int i=0; i<1000 && !buf.isCompressed(); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+TEST(UndoBuffer, CompressAndRestore)
+{
+  const base::buffer orig = make_data(64*1024);
+
+  UndoBuffer buf;
+  buf.data() = orig;
+  EXPECT_EQ(orig.size(), buf.memSize());
+
+  buf.compress();
+  wait_compression(buf);
+  ASSERT_TRUE(buf.isCompressed());
+  EXPECT_LT(buf.memSize(), orig.size());
+
+  EXPECT_EQ(orig, buf.data());
+  EXPECT_FALSE(buf.isCompressed());
+  EXPECT_EQ(orig.size(), buf.memSize());
+}
+
+TEST(UndoBuffer, AccessWhileCompressing)
+{
+  const base::buffer orig = make_data(1024*1024);
+
+  UndoBuffer buf;
+  buf.data() = orig;
+  buf.compress();
+
+  // data() waits the background compression
+  EXPECT_EQ(orig, buf.data());
+  EXPECT_EQ(orig.size(), buf.memSize());
+}
+
+TEST(UndoBuffer, SwapOut)
+{
+  const base::buffer orig1 = make_data(64*1024);
+  const base::buffer orig2 = make_data(128*1024);
+
+  UndoBuffer buf1, buf2;
+  buf1.data() = orig1;
+  buf2.data() = orig2;
+
+  // Cannot swap out uncompressed data
+  buf1.swapOut();
+  EXPECT_FALSE(buf1.isSwappedOut());
+
+  buf1.compress();
+  buf2.compress();
+  wait_compression(buf1);
+  wait_compression(buf2);
+  buf1.swapOut();
+  buf2.swapOut();
+  ASSERT_TRUE(buf1.isSwappedOut());
+  ASSERT_TRUE(buf2.isSwappedOut());
+  EXPECT_EQ(0u, buf1.memSize());
+  EXPECT_EQ(0u, buf2.memSize());
+
+  EXPECT_EQ(orig2, buf2.data());
+  EXPECT_EQ(orig1, buf1.data());
+}
+
+TEST(UndoBuffer, ReuseReleasedSwapRanges)
+{
+  const base::buffer orig1 = make_data(64*1024, 1);
+  const base::buffer orig2 = make_data(128*1024, 2);
+  const base::buffer orig3 = make_data(64*1024, 3);
+  const base::buffer orig4 = make_data(32*1024, 4);
+
+  UndoBuffer buf1, buf2, buf3, buf4;
+  buf1.data() = orig1;
+  buf2.data() = orig2;
+  buf3.data() = orig3;
+  buf4.data() = orig4;
+
+  for (UndoBuffer* buf : { &buf1, &buf2, &buf3 }) {
+    buf->compress();
+    wait_compression(*buf);
+    buf->swapOut();
+    ASSERT_TRUE(buf->isSwappedOut());
+  }
+
+  // Restoring buf2 releases its range in the middle of the swap
+  // file, which is reused by buf4.
+  EXPECT_EQ(orig2, buf2.data());
+  buf4.compress();
+  wait_compression(buf4);
+  buf4.swapOut();
+  ASSERT_TRUE(buf4.isSwappedOut());
+
+  EXPECT_EQ(orig1, buf1.data());
+  EXPECT_EQ(orig3, buf3.data());
+  EXPECT_EQ(orig4, buf4.data());
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This program is distributed under the terms of
@@ -16,12 +16,16 @@
 #include "doc/color_scales.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/rgbmap.h"
 #include "os/surface.h"
 #include "os/surface_format.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 namespace app {
 
@@ -29,6 +33,11 @@ using namespace doc;
 
 namespace {
 
+// Minimum number of pixels to convert in each thread. Small
+// conversions (e.g. thumbnails, the area below the mouse) are done in
+// the calling thread.
+const int kMinPixelsPerThread = 64*1024;
+
 template<typename ImageTraits, os::SurfaceFormat format>
 uint32_t convert_color_to_surface(color_t color, const Palette* palette, const os::SurfaceFormatData* fd) {
   static_assert(false && sizeof(ImageTraits), "Invalid color conversion");
@@ -73,26 +82,128 @@ uint32_t convert_color_to_surface<BitmapTraits, os::kRgbaSurfaceFormat>(color_t
     ((rgba_geta(c) << fd->alphaShift) & fd->alphaMask);
 }
 
+// Calls func(y0, y1) for bands of rows in [0, h), using several
+// threads when there are enough pixels to convert.
+template<typename Func>
+void for_each_band(const int w, const int h, Func&& func)
+{
+  const int bands = std::clamp(int(int64_t(w) * h / kMinPixelsPerThread),
+                               1, std::min(h, parallel_concurrency()));
+  if (bands == 1) {
+    func(0, h);
+    return;
+  }
+
+  parallel_for(
+    bands,
+    [bands, h, &func](const int i){
+      func(h*i/bands, h*(i+1)/bands);
+    });
+}
+
+// Converts a row of "w" pixels from "src" to 32-bit surface colors.
+// These loops don't have branches or function calls, so the compiler
+// can vectorize them.
+void convert_row(const RgbTraits::pixel_t* src, uint32_t* dst, const int w,
+                 const uint32_t*, const os::SurfaceFormatData* fd)
+{
+  const uint32_t rs = fd->redShift,   rm = fd->redMask;
+  const uint32_t gs = fd->greenShift, gm = fd->greenMask;
+  const uint32_t bs = fd->blueShift,  bm = fd->blueMask;
+  const uint32_t as = fd->alphaShift, am = fd->alphaMask;
+  for (int x=0; x<w; ++x) {
+    const uint32_t c = src[x];
+    dst[x] =
+      ((((c >> rgba_r_shift) & 0xff) << rs) & rm) |
+      ((((c >> rgba_g_shift) & 0xff) << gs) & gm) |
+      ((((c >> rgba_b_shift) & 0xff) << bs) & bm) |
+      ((((c >> rgba_a_shift) & 0xff) << as) & am);
+  }
+}
+
+void convert_row(const GrayscaleTraits::pixel_t* src, uint32_t* dst, const int w,
+                 const uint32_t*, const os::SurfaceFormatData* fd)
+{
+  const uint32_t rs = fd->redShift,   rm = fd->redMask;
+  const uint32_t gs = fd->greenShift, gm = fd->greenMask;
+  const uint32_t bs = fd->blueShift,  bm = fd->blueMask;
+  const uint32_t as = fd->alphaShift, am = fd->alphaMask;
+  for (int x=0; x<w; ++x) {
+    const uint32_t v = (src[x] & 0xff);
+    const uint32_t a = (src[x] >> 8);
+    dst[x] =
+      ((v << rs) & rm) |
+      ((v << gs) & gm) |
+      ((v << bs) & bm) |
+      ((a << as) & am);
+  }
+}
+
+// Palette expansion using a lookup table with the surface color of
+// each index (a gather).
+void convert_row(const IndexedTraits::pixel_t* src, uint32_t* dst, const int w,
+                 const uint32_t* lut, const os::SurfaceFormatData*)
+{
+  for (int x=0; x<w; ++x)
+    dst[x] = lut[src[x]];
+}
+
+template<typename AddressType>
+void write_row(const uint32_t* src, AddressType dst_address, const int w)
+{
+  for (int u=0; u<w; ++u, ++dst_address)
+    *dst_address = src[u];
+}
+
 template<typename ImageTraits, typename AddressType>
 void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
-  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette,
+  const uint32_t* lut, const os::SurfaceFormatData* fd)
 {
-  const LockImageBits<ImageTraits> bits(image, gfx::Rect(src_x, src_y, w, h));
-  typename LockImageBits<ImageTraits>::const_iterator src_it = bits.begin();
+  // Bitmap images are not used in the editor and their pixels are
+  // packed in bits, so we use the generic iterator.
+  if constexpr (std::is_same_v<ImageTraits, BitmapTraits>) {
+    const LockImageBits<ImageTraits> bits(image, gfx::Rect(src_x, src_y, w, h));
+    typename LockImageBits<ImageTraits>::const_iterator src_it = bits.begin();
 #ifdef _DEBUG
-  typename LockImageBits<ImageTraits>::const_iterator src_end = bits.end();
+    typename LockImageBits<ImageTraits>::const_iterator src_end = bits.end();
 #endif
 
-  for (int v=0; v<h; ++v, ++dst_y) {
-    AddressType dst_address = AddressType(dst->getData(dst_x, dst_y));
-    for (int u=0; u<w; ++u) {
-      ASSERT(src_it != src_end);
+    for (int v=0; v<h; ++v, ++dst_y) {
+      AddressType dst_address = AddressType(dst->getData(dst_x, dst_y));
+      for (int u=0; u<w; ++u) {
+        ASSERT(src_it != src_end);
 
-      *dst_address = convert_color_to_surface<ImageTraits, os::kRgbaSurfaceFormat>(*src_it, palette, fd);
-      ++dst_address;
-      ++src_it;
+        *dst_address = convert_color_to_surface<ImageTraits, os::kRgbaSurfaceFormat>(*src_it, palette, fd);
+        ++dst_address;
+        ++src_it;
+      }
     }
   }
+  else {
+    for_each_band(
+      w, h,
+      [=](const int y0, const int y1){
+        // Temporal row to convert pixels to 8/16/24bpp surfaces
+        std::vector<uint32_t> row;
+        if constexpr (!std::is_same_v<AddressType, uint32_t*>)
+          row.resize(w);
+
+        for (int v=y0; v<y1; ++v) {
+          auto src_address = (const typename ImageTraits::pixel_t*)
+            image->getPixelAddress(src_x, src_y+v);
+          uint8_t* dst_address = dst->getData(dst_x, dst_y+v);
+
+          if constexpr (std::is_same_v<AddressType, uint32_t*>) {
+            convert_row(src_address, (uint32_t*)dst_address, w, lut, fd);
+          }
+          else {
+            convert_row(src_address, row.data(), w, lut, fd);
+            write_row(row.data(), AddressType(dst_address), w);
+          }
+        }
+      });
+  }
 }
 
 struct Address24bpp
@@ -111,23 +222,30 @@ template<typename ImageTraits>
 void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
   int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
 {
+  // Surface colors of all palette entries for indexed images
+  uint32_t lut[256];
+  if constexpr (std::is_same_v<ImageTraits, IndexedTraits>) {
+    for (int i=0; i<256; ++i)
+      lut[i] = convert_color_to_surface<IndexedTraits, os::kRgbaSurfaceFormat>(i, palette, fd);
+  }
+
   switch (fd->bitsPerPixel) {
 
     case 8:
-      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, lut, fd);
       break;
 
     case 15:
     case 16:
-      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, lut, fd);
       break;
 
     case 24:
-      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, lut, fd);
       break;
 
     case 32:
-      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, lut, fd);
       break;
   }
 }
@@ -177,13 +295,17 @@ void convert_image_to_surface(
           gfx::ColorGShift == fd.greenShift &&
           gfx::ColorBShift == fd.blueShift &&
           gfx::ColorAShift == fd.alphaShift) {
-        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
-          uint8_t* src_address = image->getPixelAddress(src_x, src_y);
-          uint8_t* dst_address = surface->getData(dst_x, dst_y);
-          std::copy(src_address,
-                    src_address + RgbTraits::bytes_per_pixel * w,
-                    dst_address);
-        }
+        for_each_band(
+          w, h,
+          [=](const int y0, const int y1){
+            for (int v=y0; v<y1; ++v) {
+              const uint8_t* src_address = image->getPixelAddress(src_x, src_y+v);
+              uint8_t* dst_address = surface->getData(dst_x, dst_y+v);
+              std::copy(src_address,
+                        src_address + RgbTraits::bytes_per_pixel * w,
+                        dst_address);
+            }
+          });
         return;
       }
       convert_image_to_surface_selector<RgbTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
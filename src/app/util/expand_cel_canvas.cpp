@@ -520,7 +520,7 @@ void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
 
   getSourceCanvas();
 
-  gfx::Region rgnToValidate;
+  gfx::Region& rgnToValidate = m_rgnToValidate;
   gfx::Point origCelPos;
   gfx::Point zeroPos;
   if (m_tilemapMode == TilemapMode::Tiles) {
@@ -540,7 +540,7 @@ void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
   rgnToValidate.createIntersection(rgnToValidate, gfx::Region(m_srcImage->bounds()));
 
   if (m_celImage && previewSpecificLayerChanges()) {
-    gfx::Region rgnToClear;
+    gfx::Region& rgnToClear = m_rgnToClear;
     rgnToClear.createSubtraction(
       rgnToValidate,
       gfx::Region(m_celImage->bounds()
@@ -625,8 +625,9 @@ void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
 
   getDestCanvas();              // Create m_dstImage
 
-  gfx::Region rgnToValidate;
+  gfx::Region& rgnToValidate = m_rgnToValidate;
   if (m_tilemapMode == TilemapMode::Tiles) {
+    rgnToValidate.clear();
     for (const auto& rc : rgn)
       rgnToValidate |= gfx::Region(m_grid.canvasToTile(rc));
   }
@@ -642,7 +643,7 @@ void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
 
   // ASSERT(src);                  // TODO is it always true?
   if (src) {
-    gfx::Region rgnToClear;
+    gfx::Region& rgnToClear = m_rgnToClear;
     rgnToClear.createSubtraction(rgnToValidate,
       gfx::Region(src->bounds()
         .offset(src_x, src_y)
@@ -133,6 +133,11 @@ namespace app {
     gfx::Region m_validSrcRegion;
     gfx::Region m_validDstRegion;
 
+    // Temporary regions used in each validate*Canvas() call (members
+    // to re-use their memory in the whole tool loop).
+    gfx::Region m_rgnToValidate;
+    gfx::Region m_rgnToClear;
+
     // True if we can compare src image with dst image to patch the
     // cel. This is false when dst is copied to the src, so we cannot
     // reduce the patched region because both images will be the same.
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -88,6 +88,9 @@ bool AsepriteDecoder::decode()
   auto tag_end = sprite->tags().end();
 
   m_allLayers.clear();
+  m_header = header;
+  m_pendingCelImages.clear();
+  m_nextPendingCelImage = 0;
 
   int current_level = -1;
   AsepriteExternalFiles extFiles;
@@ -889,7 +892,10 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       if (w > 0 && h > 0) {
         // Read pixel data
         doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
-        read_raw_image(f(), delegate(), image.get(), header);
+        if (delegate()->decodeCelImagesLater())
+          image->clear(sprite->transparentColor());
+        else
+          read_raw_image(f(), delegate(), image.get(), header);
 
         cel = std::make_unique<doc::Cel>(frame, image);
         cel->setPosition(x, y);
@@ -915,6 +921,16 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
           cel.reset(doc::Cel::MakeCopy(frame, link));
           cel->setPosition(x, y);
           cel->setOpacity(opacity);
+
+          // The copied image will be decoded later too
+          for (size_t i=0; i<m_pendingCelImages.size(); ++i) {
+            if (m_pendingCelImages[i].cel->data() == link->data()) {
+              PendingCelImage pending = m_pendingCelImages[i];
+              pending.cel = cel.get();
+              m_pendingCelImages.push_back(pending);
+              break;
+            }
+          }
         }
         cel->setZIndex(zIndex);
       }
@@ -932,7 +948,10 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
 
       if (w > 0 && h > 0) {
         doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+        if (delegate()->decodeCelImagesLater())
+          image->clear(sprite->transparentColor());
+        else
+          read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
 
         cel = std::make_unique<doc::Cel>(frame, image);
         cel->setPosition(x, y);
@@ -1006,10 +1025,57 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
   if (!cel)
     return nullptr;
 
+  // Remember where the pixels are to decode them later
+  if (delegate()->decodeCelImagesLater() &&
+      (cel_type == ASE_FILE_RAW_CEL ||
+       cel_type == ASE_FILE_COMPRESSED_CEL)) {
+    PendingCelImage pending;
+    pending.cel = cel.get();
+    pending.type = cel_type;
+    pending.pixelFormat = pixelFormat;
+    pending.width = cel->image()->width();
+    pending.height = cel->image()->height();
+    pending.pos = f()->tell();
+    pending.chunk_end = chunk_end;
+    m_pendingCelImages.push_back(pending);
+  }
+
   static_cast<doc::LayerImage*>(layer)->addCel(cel.get());
   return cel.release();
 }
 
+bool AsepriteDecoder::decodeNextCelImage(doc::Cel*& cel, doc::ImageRef& image)
+{
+  if (m_nextPendingCelImage >= m_pendingCelImages.size())
+    return false;
+
+  const PendingCelImage& pending = m_pendingCelImages[m_nextPendingCelImage++];
+  image.reset(doc::Image::create(pending.pixelFormat,
+                                 pending.width, pending.height));
+  f()->seek(pending.pos);
+
+  if (pending.type == ASE_FILE_RAW_CEL)
+    read_raw_image(f(), delegate(), image.get(), &m_header);
+  else
+    read_compressed_image(f(), delegate(), image.get(), &m_header,
+                          pending.chunk_end);
+
+  cel = pending.cel;
+  return true;
+}
+
+bool AsepriteDecoder::hasPendingCelImages() const
+{
+  return (m_nextPendingCelImage < m_pendingCelImages.size());
+}
+
+double AsepriteDecoder::pendingCelImagesProgress() const
+{
+  if (m_pendingCelImages.empty())
+    return 1.0;
+  return double(m_nextPendingCelImage) / double(m_pendingCelImages.size());
+}
+
 void AsepriteDecoder::readCelExtraChunk(doc::Cel* cel)
 {
   // Read chunk data
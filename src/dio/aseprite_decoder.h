@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,8 +9,10 @@
 #define DIO_ASEPRITE_DECODER_H_INCLUDED
 #pragma once
 
+#include "dio/aseprite_common.h"
 #include "dio/decoder.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/layer_list.h"
 #include "doc/pixel_format.h"
 #include "doc/slices.h"
@@ -33,15 +35,29 @@ namespace doc {
 
 namespace dio {
 
-struct AsepriteHeader;
-struct AsepriteFrameHeader;
-class AsepriteExternalFiles;
-
 class AsepriteDecoder : public Decoder {
 public:
   bool decode() override;
 
+  // Decodes the next cel image that decode() skipped because
+  // DecodeDelegate::decodeCelImagesLater() returned true (the file
+  // must be still open). Returns false when there are no more
+  // pending images.
+  bool decodeNextCelImage(doc::Cel*& cel, doc::ImageRef& image);
+  bool hasPendingCelImages() const;
+  double pendingCelImagesProgress() const;
+
 private:
+  // Cel image to be decoded by decodeNextCelImage()
+  struct PendingCelImage {
+    doc::Cel* cel;
+    int type;                   // ASE_FILE_RAW_CEL/COMPRESSED_CEL
+    doc::PixelFormat pixelFormat;
+    int width, height;
+    size_t pos;                 // Position of the pixels in the file
+    size_t chunk_end;
+  };
+
   bool readHeader(AsepriteHeader* header);
   void readFrameHeader(AsepriteFrameHeader* frame_header);
   void readPadding(const int bytes);
@@ -76,6 +92,9 @@ private:
 
   doc::LayerList m_allLayers;
   std::vector<uint32_t> m_tilesetFlags;
+  AsepriteHeader m_header;
+  std::vector<PendingCelImage> m_pendingCelImages;
+  size_t m_nextPendingCelImage = 0;
 };
 
 } // namespace dio
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -38,6 +38,13 @@ public:
   // to generate a thumbnail)
   virtual bool decodeOneFrame() { return false; }
 
+  // Return true if you want to receive the sprite structure (layers,
+  // frames, tags, etc.) as soon as possible, without decoding the
+  // cel images. Cels are created with empty images and the real
+  // images can be decoded later (e.g. with
+  // AsepriteDecoder::decodeNextCelImage()).
+  virtual bool decodeCelImagesLater() { return false; }
+
   // Default color for slices without user data
   virtual doc::color_t defaultSliceColor() {
     return doc::rgba(0, 0, 255, 255);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2021 Igara Studio S.A.
+// Copyright (c) 2021-2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,15 +13,288 @@
 
 #include "doc/image_impl.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
+#include "doc/primitives_fast.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
-// TODO create morphological operators/functions in "doc" namespace
-// TODO the impl is not optimal, but is good enough as a first version
+namespace {
+
+// Returns the max squared distance from the center of the circle
+// brush of the given radius to its pixels (i.e. the circle is the set
+// of pixels where dx^2+dy^2 <= threshold). It's calculated from the
+// same rasterized circle used by circle brushes, so the result is the
+// same as the old kernel-based implementation (at least for radius
+// <= 10, for bigger radius some pixels in the edge can differ).
+int circle_threshold(const int radius)
+{
+  const int size = 2*radius+1;
+  std::unique_ptr<Image> kernel(Image::create(IMAGE_BITMAP, size, size));
+  clear_image(kernel.get(), 0);
+  fill_ellipse(kernel.get(), 0, 0, size-1, size-1, 0, 0, 1);
+
+  int minOutside = (radius+1)*(radius+1);
+  for (int v=0; v<size; ++v) {
+    for (int u=0; u<size; ++u) {
+      if (!get_pixel_fast<BitmapTraits>(kernel.get(), u, v)) {
+        const int dx = u - radius;
+        const int dy = v - radius;
+        minOutside = std::min(minOutside, dx*dx + dy*dy);
+      }
+    }
+  }
+  return minOutside-1;
+}
+
+// Grid where we calculate the distance transform. The grid is a
+// rectangle in source mask coordinates (it can be bigger than the
+// mask bitmap), and "features" are the pixels we measure the distance
+// to (the selected pixels to expand, or the unselected pixels to
+// contract/border).
+struct Grid {
+  const Image* bitmap;
+  gfx::Rect bounds;
+  bool featureIsSelected;
+
+  bool isFeature(const int gx, const int gy) const {
+    const int x = bounds.x + gx;
+    const int y = bounds.y + gy;
+    bool selected = false;
+    if (x >= 0 && y >= 0 && x < bitmap->width() && y < bitmap->height())
+      selected = (bitmap->getPixelAddress(0, y)[x >> 3] & (1 << (x & 7)));
+    return (selected == featureIsSelected);
+  }
+};
+
+// Calculates the vertical distance from each pixel of the grid to the
+// nearest feature in the same column (distances are capped to "cap"
+// because we only need to know if the distance is <= radius). The
+// columns are processed in parallel by bands.
+template<typename Dist>
+void vertical_distances(const Grid& grid,
+                        const int cap,
+                        std::vector<Dist>& dist)
+{
+  const int w = grid.bounds.w;
+  const int h = grid.bounds.h;
+  dist.resize(std::size_t(w) * h);
+
+  const int bandWidth =
+    std::max(64, (w + parallel_concurrency() - 1) / parallel_concurrency());
+  const int bands = (w + bandWidth - 1) / bandWidth;
+
+  parallel_for(
+    bands,
+    [&grid, &dist, w, h, cap, bandWidth](const int band){
+      const int x0 = band * bandWidth;
+      const int x1 = std::min(x0 + bandWidth, w);
+
+      // Top to bottom
+      for (int y=0; y<h; ++y) {
+        Dist* row = &dist[std::size_t(y) * w];
+        for (int x=x0; x<x1; ++x) {
+          if (grid.isFeature(x, y))
+            row[x] = 0;
+          else if (y > 0)
+            row[x] = Dist(std::min<int>(row[x-w] + 1, cap));
+          else
+            row[x] = Dist(cap);
+        }
+      }
+
+      // Bottom to top
+      for (int y=h-2; y>=0; --y) {
+        Dist* row = &dist[std::size_t(y) * w];
+        const Dist* next = row + w;
+        for (int x=x0; x<x1; ++x) {
+          if (next[x] + 1 < row[x])
+            row[x] = Dist(next[x] + 1);
+        }
+      }
+    });
+}
+
+// Sets within[x-x0] = 1 for each x in [x0, x1) that has a feature at
+// a Euclidean squared distance <= threshold. "row" contains the
+// vertical distances of one grid row (the distance from (x, y) to
+// the nearest feature is the lower envelope of the parabolas
+// (x-i)^2 + row[i]^2, see Felzenszwalb & Huttenlocher, "Distance
+// Transforms of Sampled Functions").
+template<typename Dist>
+void euclidean_row(const Dist* row, const int n, const int cap,
+                   const int threshold,
+                   const int x0, const int x1,
+                   std::vector<int>& loc,
+                   std::vector<double>& z,
+                   std::vector<uint8_t>& within)
+{
+  auto f = [row](const int i) -> int64_t {
+    return int64_t(row[i]) * row[i];
+  };
+
+  // Lower envelope of parabolas (columns at "cap" distance cannot
+  // reach any pixel at "threshold" distance, cap^2 > threshold)
+  int k = -1;
+  for (int q=0; q<n; ++q) {
+    if (row[q] >= cap)
+      continue;
+
+    double s = -std::numeric_limits<double>::infinity();
+    while (k >= 0) {
+      const int p = loc[k];
+      s = double((f(q) + int64_t(q)*q) - (f(p) + int64_t(p)*p)) / double(2*q - 2*p);
+      if (s <= z[k])
+        --k;
+      else
+        break;
+    }
+    if (k < 0)
+      s = -std::numeric_limits<double>::infinity();
+    ++k;
+    loc[k] = q;
+    z[k] = s;
+  }
+
+  std::fill(within.begin(), within.end(), 0);
+  if (k < 0)
+    return;
+
+  int j = 0;
+  for (int x=x0; x<x1; ++x) {
+    while (j < k && z[j+1] < x)
+      ++j;
+    const int64_t dx = x - loc[j];
+    if (dx*dx + f(loc[j]) <= threshold)
+      within[x-x0] = 1;
+  }
+}
+
+// Sets within[x-x0] = 1 for each x in [x0, x1) that has a feature at
+// a Chebyshev distance <= radius.
+template<typename Dist>
+void chebyshev_row(const Dist* row, const int n, const int radius,
+                   const int x0, const int x1,
+                   std::vector<int>& count,
+                   std::vector<uint8_t>& within)
+{
+  // count[i] = number of columns in [0, i) with a feature at a
+  // vertical distance <= radius
+  count[0] = 0;
+  for (int i=0; i<n; ++i)
+    count[i+1] = count[i] + (row[i] <= radius ? 1: 0);
+
+  for (int x=x0; x<x1; ++x) {
+    const int a = std::clamp(x-radius, 0, n);
+    const int b = std::clamp(x+radius+1, 0, n);
+    within[x-x0] = (count[b] - count[a] > 0 ? 1: 0);
+  }
+}
+
+template<typename Dist>
+void modify_selection_templ(const SelectionModifier modifier,
+                            const Image* srcImage,
+                            Image* dstImage,
+                            const gfx::Point& offset,
+                            const int radius,
+                            const BrushType brush)
+{
+  const int w = srcImage->width();
+  const int h = srcImage->height();
+
+  // When we expand the selection we measure the distance to selected
+  // pixels from a grid that includes the whole expanded area (but
+  // only mask columns can contain features). In other case, we
+  // measure the distance to unselected pixels from selected pixels,
+  // where the area outside the mask is unselected too.
+  Grid grid;
+  grid.bitmap = srcImage;
+  gfx::Rect outBounds;
+  if (modifier == SelectionModifier::Expand) {
+    grid.bounds = gfx::Rect(0, -radius, w, h+2*radius);
+    grid.featureIsSelected = true;
+    outBounds = gfx::Rect(-radius, -radius, w+2*radius, h+2*radius);
+  }
+  else {
+    grid.bounds = gfx::Rect(-1, -1, w+2, h+2);
+    grid.featureIsSelected = false;
+    outBounds = gfx::Rect(0, 0, w, h);
+  }
+
+  const int cap = radius+1;
+  std::vector<Dist> dist;
+  vertical_distances<Dist>(grid, cap, dist);
+
+  const int threshold =
+    (brush == kCircleBrushType ? circle_threshold(radius): 0);
+
+  // Clip the output to the destination bitmap
+  const gfx::Rect dstBounds =
+    outBounds.createIntersection(dstImage->bounds() - offset);
+  if (dstBounds.isEmpty())
+    return;
+
+  parallel_for(
+    dstBounds.h,
+    [&, threshold](const int i){
+      const int y = dstBounds.y + i;
+      const int n = grid.bounds.w;
+      const Dist* row = &dist[std::size_t(y - grid.bounds.y) * n];
+
+      // Output range in grid coordinates
+      const int x0 = dstBounds.x - grid.bounds.x;
+      const int x1 = dstBounds.x2() - grid.bounds.x;
+
+      std::vector<uint8_t> within(dstBounds.w);
+      if (brush == kCircleBrushType) {
+        std::vector<int> loc(n);
+        std::vector<double> z(n);
+        euclidean_row<Dist>(row, n, cap, threshold, x0, x1, loc, z, within);
+      }
+      else {
+        std::vector<int> count(n+1);
+        chebyshev_row<Dist>(row, n, radius, x0, x1, count, within);
+      }
+
+      for (int j=0; j<dstBounds.w; ++j) {
+        const int x = dstBounds.x + j;
+        bool c;
+        switch (modifier) {
+          case SelectionModifier::Expand:
+            c = within[j];
+            break;
+          case SelectionModifier::Contract:
+          case SelectionModifier::Border: {
+            const bool selected =
+              (srcImage->getPixelAddress(0, y)[x >> 3] & (1 << (x & 7)));
+            c = selected &&
+              (modifier == SelectionModifier::Border ? within[j]: !within[j]);
+            break;
+          }
+          default:
+            c = false;
+            break;
+        }
+        if (c)
+          put_pixel_fast<BitmapTraits>(dstImage, offset.x+x, offset.y+y, 1);
+      }
+    });
+}
+
+} // anonymous namespace
+
+// Expand/Contract/Border are calculated with a distance transform:
+// a pixel is inside the brush centered at other pixel if their
+// Euclidean distance (circle brush) or Chebyshev distance (square
+// brush) is <= radius. So the cost is O(W*H) instead of O(W*H*r^2)
+// of a kernel-based implementation.
 void modify_selection(const SelectionModifier modifier,
                       const Mask* srcMask,
                       Mask* dstMask,
@@ -30,67 +303,17 @@ void modify_selection(const SelectionModifier modifier,
 {
   const doc::Image* srcImage = srcMask->bitmap();
   doc::Image* dstImage = dstMask->bitmap();
+  if (!srcImage || !dstImage || radius < 0)
+    return;
+
   const gfx::Point offset =
     srcMask->bounds().origin() -
     dstMask->bounds().origin();
 
-  // Image bounds to clip get/put pixels
-  const gfx::Rect srcBounds = srcImage->bounds();
-
-  // Create a kernel
-  const int size = 2*radius+1;
-  std::unique_ptr<doc::Image> kernel(doc::Image::create(IMAGE_BITMAP, size, size));
-  doc::clear_image(kernel.get(), 0);
-  if (brush == doc::kCircleBrushType)
-    doc::fill_ellipse(kernel.get(), 0, 0, size-1, size-1, 0, 0, 1);
+  if (radius < 255)
+    modify_selection_templ<uint8_t>(modifier, srcImage, dstImage, offset, radius, brush);
   else
-    doc::fill_rect(kernel.get(), 0, 0, size-1, size-1, 1);
-  doc::put_pixel(kernel.get(), radius, radius, 0);
-
-  int total = 0;                // Number of 1s in the kernel image
-  for (int v=0; v<size; ++v)
-    for (int u=0; u<size; ++u)
-      total += kernel->getPixel(u, v);
-
-  for (int y=-radius; y<srcBounds.h+radius; ++y) {
-    for (int x=-radius; x<srcBounds.w+radius; ++x) {
-      doc::color_t c;
-      if (srcBounds.contains(x, y))
-        c = srcImage->getPixel(x, y);
-      else
-        c = 0;
-
-      int accum = 0;
-      for (int v=0; v<size; ++v) {
-        for (int u=0; u<size; ++u) {
-          if (kernel->getPixel(u, v)) {
-            if (srcBounds.contains(x+u-radius, y+v-radius))
-              accum += srcImage->getPixel(x-radius+u, y-radius+v);
-          }
-        }
-      }
-
-      switch (modifier) {
-        case SelectionModifier::Border: {
-          c = (c && accum < total) ? 1: 0;
-          break;
-        }
-        case SelectionModifier::Expand: {
-          c = (c || accum > 0) ? 1: 0;
-          break;
-        }
-        case SelectionModifier::Contract: {
-          c = (c && accum == total) ? 1: 0;
-          break;
-        }
-      }
-
-      if (c)
-        doc::put_pixel(dstImage,
-                       offset.x+x,
-                       offset.y+y, 1);
-    }
-  }
+    modify_selection_templ<int>(modifier, srcImage, dstImage, offset, radius, brush);
 }
 
 } // namespace algorithm
@@ -0,0 +1,121 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/modify_selection.h"
+#include "doc/image.h"
+#include "doc/mask.h"
+
+#include <string>
+
+using namespace doc;
+using namespace doc::algorithm;
+using namespace gfx;
+
+// Returns the mask as a string of 0/1 rows inside the given bounds
+static std::string mask_str(const Mask& mask, const Rect& bounds)
+{
+  std::string s;
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    for (int x=bounds.x; x<bounds.x2(); ++x)
+      s.push_back(mask.containsPoint(x, y) ? '1': '0');
+    s.push_back('\n');
+  }
+  return s;
+}
+
+static std::string modify(const SelectionModifier modifier,
+                          const Rect& selection,
+                          const int radius,
+                          const BrushType brush)
+{
+  const Rect bounds(0, 0, 9, 9);
+  Mask src;
+  src.replace(selection);
+
+  Mask dst;
+  dst.reserve(bounds);
+  dst.freeze();
+  modify_selection(modifier, &src, &dst, radius, brush);
+  dst.unfreeze();
+  return mask_str(dst, bounds);
+}
+
+TEST(ModifySelection, ExpandCircle)
+{
+  EXPECT_EQ("000000000\n"
+            "000000000\n"
+            "000000000\n"
+            "000010000\n"
+            "000111000\n"
+            "000010000\n"
+            "000000000\n"
+            "000000000\n"
+            "000000000\n",
+            modify(SelectionModifier::Expand, Rect(4, 4, 1, 1), 1, kCircleBrushType));
+
+  EXPECT_EQ("000000000\n"
+            "000111000\n"
+            "001111100\n"
+            "011111110\n"
+            "011111110\n"
+            "011111110\n"
+            "001111100\n"
+            "000111000\n"
+            "000000000\n",
+            modify(SelectionModifier::Expand, Rect(4, 4, 1, 1), 3, kCircleBrushType));
+}
+
+TEST(ModifySelection, ExpandSquare)
+{
+  EXPECT_EQ("000000000\n"
+            "000000000\n"
+            "001111000\n"
+            "001111000\n"
+            "001111000\n"
+            "001111000\n"
+            "000000000\n"
+            "000000000\n"
+            "000000000\n",
+            modify(SelectionModifier::Expand, Rect(3, 3, 2, 2), 1, kSquareBrushType));
+}
+
+TEST(ModifySelection, ContractSquare)
+{
+  EXPECT_EQ("000000000\n"
+            "000000000\n"
+            "000000000\n"
+            "000111000\n"
+            "000111000\n"
+            "000000000\n"
+            "000000000\n"
+            "000000000\n"
+            "000000000\n",
+            modify(SelectionModifier::Contract, Rect(2, 2, 5, 4), 1, kSquareBrushType));
+}
+
+TEST(ModifySelection, BorderCircle)
+{
+  // With radius=1 the circle is a plus sign, so the corners of the
+  // selection aren't considered inner pixels
+  EXPECT_EQ("000000000\n"
+            "000000000\n"
+            "001111100\n"
+            "001000100\n"
+            "001000100\n"
+            "001111100\n"
+            "000000000\n"
+            "000000000\n"
+            "000000000\n",
+            modify(SelectionModifier::Border, Rect(2, 2, 5, 4), 1, kCircleBrushType));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
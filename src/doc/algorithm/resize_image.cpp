@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,6 +17,7 @@
 #include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 #include "gfx/point.h"
+#include "prof/prof.h"
 
 #include <cmath>
 
@@ -49,6 +50,8 @@ void resize_image(const Image* src,
                   const RgbMap* rgbmap,
                   const color_t maskColor)
 {
+  PROF_ZONE("doc", "resize_image");
+
   switch (method) {
 
     // TODO optimize this
@@ -11,6 +11,8 @@
 #include "config.h"
 #endif
 
+#include "doc/algorithm/rotate.h"
+
 #include "base/pi.h"
 #include "doc/blend_funcs.h"
 #include "doc/image_impl.h"
@@ -338,11 +340,11 @@ public:
  *  at least partly covered by the sprite. This is useful for doing
  *  anti-aliased blending.
  */
-template<class Traits, class Delegate>
+template<class DrawScanline>
 static void ase_parallelogram_map(
-  Image* bmp, const Image* spr, const Image* mask,
+  int bmp_w, int bmp_h, int spr_w, int spr_h,
   fixed xs[4], fixed ys[4],
-  int sub_pixel_accuracy, Delegate delegate)
+  int sub_pixel_accuracy, DrawScanline draw)
 {
   /* Index in xs[] and ys[] to topmost point. */
   int top_index;
@@ -417,11 +419,11 @@ static void ase_parallelogram_map(
       corner_spr_y[i] = 0;
     else
       /* Need `- 1' since otherwise it would be outside sprite. */
-      corner_spr_y[i] = (spr->height() << 16) - 1;
+      corner_spr_y[i] = (spr_h << 16) - 1;
     if ((index == 0) || (index == 3))
       corner_spr_x[i] = 0;
     else
-      corner_spr_x[i] = (spr->width() << 16) - 1;
+      corner_spr_x[i] = (spr_w << 16) - 1;
     index = (index + right_index) & 3;
   }
 
@@ -447,7 +449,7 @@ static void ase_parallelogram_map(
 
   /* Calculate left and right clipping. */
   clip_left = 0;
-  clip_right = (bmp->width() << 16) - 1;
+  clip_right = (bmp_w << 16) - 1;
 
   /* Quit if we're totally outside. */
   if ((left_bmp_x > clip_right) &&
@@ -465,8 +467,8 @@ static void ase_parallelogram_map(
   else
     clip_bottom_i = (bottom_bmp_y + 0x8000) >> 16;
 
-  if (clip_bottom_i > bmp->height())
-    clip_bottom_i = bmp->height();
+  if (clip_bottom_i > bmp_h)
+    clip_bottom_i = bmp_h;
 
   /* Calculate y coordinate of first scanline. */
   if (sub_pixel_accuracy)
@@ -527,10 +529,10 @@ static void ase_parallelogram_map(
      We'd better use double to get this as exact as possible, since any
      errors will be accumulated along the scanline.
   */
-  spr_dx = (fixed)((ys[3] - ys[0]) * 65536.0 * (65536.0 * spr->width()) /
+  spr_dx = (fixed)((ys[3] - ys[0]) * 65536.0 * (65536.0 * spr_w) /
                    ((xs[1] - xs[0]) * (double)(ys[3] - ys[0]) -
                     (xs[3] - xs[0]) * (double)(ys[1] - ys[0])));
-  spr_dy = (fixed)((ys[1] - ys[0]) * 65536.0 * (65536.0 * spr->height()) /
+  spr_dy = (fixed)((ys[1] - ys[0]) * 65536.0 * (65536.0 * spr_h) /
                    ((xs[3] - xs[0]) * (double)(ys[1] - ys[0]) -
                     (xs[1] - xs[0]) * (double)(ys[3] - ys[0])));
 
@@ -637,7 +639,7 @@ static void ase_parallelogram_map(
            Drawing a sprite with that routine took about 25% longer time
            though.
         */
-        if ((unsigned)(l_spr_x_rounded >> 16) >= (unsigned)spr->width()) {
+        if ((unsigned)(l_spr_x_rounded >> 16) >= (unsigned)spr_w) {
           if (((l_spr_x_rounded < 0) && (spr_dx <= 0)) ||
               ((l_spr_x_rounded > 0) && (spr_dx >= 0))) {
             /* This can happen. */
@@ -651,14 +653,14 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while ((unsigned)(l_spr_x_rounded >> 16) >=
-                     (unsigned)spr->width());
+                     (unsigned)spr_w);
 
           }
         }
         right_edge_test = l_spr_x_rounded +
           ((r_bmp_x_rounded - l_bmp_x_rounded) >> 16) *
           spr_dx;
-        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr->width()) {
+        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr_w) {
           if (((right_edge_test < 0) && (spr_dx <= 0)) ||
               ((right_edge_test > 0) && (spr_dx >= 0))) {
             /* This can happen. */
@@ -668,14 +670,14 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while ((unsigned)(right_edge_test >> 16) >=
-                     (unsigned)spr->width());
+                     (unsigned)spr_w);
           }
           else {
             /* I don't think this can happen, but I can't prove it. */
             goto skip_draw;
           }
         }
-        if ((unsigned)(l_spr_y_rounded >> 16) >= (unsigned)spr->height()) {
+        if ((unsigned)(l_spr_y_rounded >> 16) >= (unsigned)spr_h) {
           if (((l_spr_y_rounded < 0) && (spr_dy <= 0)) ||
               ((l_spr_y_rounded > 0) && (spr_dy >= 0))) {
             /* This can happen. */
@@ -689,13 +691,13 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while (((unsigned)l_spr_y_rounded >> 16) >=
-                     (unsigned)spr->height());
+                     (unsigned)spr_h);
           }
         }
         right_edge_test = l_spr_y_rounded +
           ((r_bmp_x_rounded - l_bmp_x_rounded) >> 16) *
           spr_dy;
-        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr->height()) {
+        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr_h) {
           if (((right_edge_test < 0) && (spr_dy <= 0)) ||
               ((right_edge_test > 0) && (spr_dy >= 0))) {
             /* This can happen. */
@@ -705,7 +707,7 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while ((unsigned)(right_edge_test >> 16) >=
-                     (unsigned)spr->height());
+                     (unsigned)spr_h);
           }
           else {
             /* I don't think this can happen, but I can't prove it. */
@@ -713,10 +715,9 @@ static void ase_parallelogram_map(
           }
         }
       }
-      draw_scanline<Traits, Delegate>(bmp, spr, mask,
-        l_bmp_x_rounded, bmp_y_i, r_bmp_x_rounded,
-        l_spr_x_rounded, l_spr_y_rounded,
-        spr_dx, spr_dy, delegate);
+      draw(l_bmp_x_rounded, bmp_y_i, r_bmp_x_rounded,
+           l_spr_x_rounded, l_spr_y_rounded,
+           spr_dx, spr_dy);
 
     }
     /* I'm not going to apoligize for this label and its gotos: to get
@@ -738,6 +739,44 @@ static void ase_parallelogram_map(
   }
 }
 
+template<class Traits, class Delegate>
+static void ase_parallelogram_map_delegate(
+  Image* bmp, const Image* spr, const Image* mask,
+  fixed xs[4], fixed ys[4], Delegate& delegate)
+{
+  ase_parallelogram_map(
+    bmp->width(), bmp->height(), spr->width(), spr->height(),
+    xs, ys, false,
+    [&](fixed l_bmp_x, int bmp_y_i, fixed r_bmp_x,
+        fixed l_spr_x, fixed l_spr_y,
+        fixed spr_dx, fixed spr_dy) {
+      draw_scanline<Traits, Delegate>(bmp, spr, mask,
+        l_bmp_x, bmp_y_i, r_bmp_x,
+        l_spr_x, l_spr_y,
+        spr_dx, spr_dy, delegate);
+    });
+}
+
+void parallelogram_scanlines(
+  int dstW, int dstH, int srcW, int srcH,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4,
+  const ParallelogramScanlineFunc& func)
+{
+  fixed xs[4] = { itofix(x1), itofix(x2), itofix(x3), itofix(x4) };
+  fixed ys[4] = { itofix(y1), itofix(y2), itofix(y3), itofix(y4) };
+
+  ase_parallelogram_map(
+    dstW, dstH, srcW, srcH,
+    xs, ys, false,
+    [&func](fixed l_bmp_x, int bmp_y_i, fixed r_bmp_x,
+            fixed l_spr_x, fixed l_spr_y,
+            fixed spr_dx, fixed spr_dy) {
+      func(bmp_y_i, l_bmp_x >> 16, r_bmp_x >> 16,
+           l_spr_x, l_spr_y, spr_dx, spr_dy);
+    });
+}
+
 /* _parallelogram_map_standard:
  *  Helper function for calling _parallelogram_map() with the appropriate
  *  scanline drawer. I didn't want to include this in the
@@ -752,25 +791,25 @@ static void ase_parallelogram_map_standard(
 
     case IMAGE_RGB: {
       RgbDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<RgbTraits, RgbDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map_delegate<RgbTraits>(bmp, sprite, mask, xs, ys, delegate);
       break;
     }
 
     case IMAGE_GRAYSCALE: {
       GrayscaleDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<GrayscaleTraits, GrayscaleDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map_delegate<GrayscaleTraits>(bmp, sprite, mask, xs, ys, delegate);
       break;
     }
 
     case IMAGE_INDEXED: {
       IndexedDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<IndexedTraits, IndexedDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map_delegate<IndexedTraits>(bmp, sprite, mask, xs, ys, delegate);
       break;
     }
 
     case IMAGE_BITMAP: {
       BitmapDelegate delegate;
-      ase_parallelogram_map<BitmapTraits, BitmapDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map_delegate<BitmapTraits>(bmp, sprite, mask, xs, ys, delegate);
       break;
     }
   }
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -8,6 +9,8 @@
 #define DOC_ALGORITHM_ROTATE_H_INCLUDED
 #pragma once
 
+#include <functional>
+
 namespace doc {
   class Image;
 
@@ -25,6 +28,23 @@ namespace doc {
       int x1, int y1, int x2, int y2,
       int x3, int y3, int x4, int y4);
 
+    // Function called for each scanline painted by parallelogram():
+    // the pixels from x1 to x2 (inclusive) of the row "y" are taken
+    // from the source point (u, v), adding (du, dv) for each next
+    // pixel. The source coordinates are in 16.16 fixed point.
+    using ParallelogramScanlineFunc =
+      std::function<void(int y, int x1, int x2,
+                         int u, int v, int du, int dv)>;
+
+    // Calculates the scanlines that parallelogram() would paint to
+    // map a srcW x srcH image in a dstW x dstH image (without
+    // painting anything).
+    void parallelogram_scanlines(
+      int dstW, int dstH, int srcW, int srcH,
+      int x1, int y1, int x2, int y2,
+      int x3, int y3, int x4, int y4,
+      const ParallelogramScanlineFunc& func);
+
   } // namespace algorithm
 } // namespace doc
 
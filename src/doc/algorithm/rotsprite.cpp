@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2022  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,170 +9,395 @@
 #include "config.h"
 #endif
 
+#include "doc/algorithm/rotsprite.h"
+
+#include "base/task.h"
 #include "doc/algorithm/rotate.h"
+#include "doc/blend_funcs.h"
 #include "doc/image_impl.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
+#include "doc/primitives_fast.h"
+#include "fixmath/fixmath.h"
+#include "prof/prof.h"
 
 #include <algorithm>
-#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
+using namespace fixmath;
+
+namespace {
+
+// The source image is upscaled 8x (three Scale2x passes), rotated,
+// and downscaled again to the destination size. We never create the
+// 8x images: the upscaled source is calculated by tiles (or pixel by
+// pixel) only in the areas that are needed.
+const int kLevels = 3;
+const int kScale = (1 << kLevels);
+
+// Size of the destination tiles processed in parallel.
+const int kTileSize = 32;
+
+// Extra source pixels upscaled around each tile. Each Scale2x pass
+// uses the 4 neighbors of each pixel, so with 2 pixels the 8x result
+// inside the tile is the same as upscaling the whole source image.
+const int kTileMargin = 2;
+
+// Tiles are used only if the source area of one destination pixel
+// is not too big (i.e. when the sprite is not downscaled too much),
+// in other case we upscale too many source pixels that are never
+// used, and it's faster to calculate each 8x pixel on demand.
+const double kMaxTiledSourcePixels = 2.0;
+
+// Approximated inverse of the parallelogram mapping: converts a
+// point in the 8x destination to the 8x source. It's used to know
+// the source area of each tile, the exact pixels are given by the
+// scanlines of parallelogram() (see Scanline).
+class InverseMap {
+public:
+  InverseMap(int srcW, int srcH,
+             double x1, double y1, double x2, double y2,
+             double x4, double y4)
+    : m_x0(x1), m_y0(y1)
+    , m_srcW(srcW), m_srcH(srcH)
+  {
+    const double ux = x2 - x1, uy = y2 - y1;
+    const double vx = x4 - x1, vy = y4 - y1;
+    const double det = ux*vy - uy*vx;
+    m_valid = (det != 0.0);
+    if (m_valid) {
+      m_a =  vy / det;
+      m_b = -vx / det;
+      m_c = -uy / det;
+      m_d =  ux / det;
+    }
+  }
+
+  bool isValid() const { return m_valid; }
+
+  // Source pixels (at 1x) covered by one destination pixel (at 1x)
+  // in each axis.
+  double sourcePixelsX() const { return m_srcW * (std::fabs(m_a) + std::fabs(m_b)); }
+  double sourcePixelsY() const { return m_srcH * (std::fabs(m_c) + std::fabs(m_d)); }
+
+  // Returns the source point (8x) without checking the source bounds.
+  void map(double x, double y, double& u, double& v) const {
+    x -= m_x0;
+    y -= m_y0;
+    u = (m_a*x + m_b*y) * m_srcW;
+    v = (m_c*x + m_d*y) * m_srcH;
+  }
+
+private:
+  double m_x0, m_y0;
+  double m_a = 0, m_b = 0, m_c = 0, m_d = 0;
+  int m_srcW, m_srcH;
+  bool m_valid;
+};
+
 // More information about EPX/Scale2x:
 // http://en.wikipedia.org/wiki/Pixel_art_scaling_algorithms#EPX.2FScale2.C3.97.2FAdvMAME2.C3.97
 // http://scale2x.sourceforge.net/algorithm.html
 // http://scale2x.sourceforge.net/scale2xandepx.html
-template<typename ImageTraits>
-static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+//
+// Upscales a buffer of w*h pixels to "dst" (of 2w*2h pixels).
+template<typename T>
+void scale2x(const T* src, const int w, const int h, T* dst)
 {
-#if 0      // TODO complete this implementation that should be faster
-           // than using a lot of get/put_pixel_fast calls.
-  int dst_w = src_w*2;
-  int dst_h = src_h*2;
-
-  LockImageBits<ImageTraits> dstBits(dst, Image::WriteLock, gfx::Rect(0, 0, dst_w, dst_h));
-  const LockImageBits<ImageTraits> srcBits(src);
-
-  LockImageBits<ImageTraits>::iterator dstRow0_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow1_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow0_end = dstBits.end();
-  LockImageBits<ImageTraits>::iterator dstRow1_end = dstBits.end();
-
-  // Iterators:
-  //   A
-  // C P B
-  //   D
-  //
-  // These iterators are displaced through src image and are modified in this way:
-  //
-  // P: is the simplest one, we just start from (0, 0) to srcEnd.
-  // A: starts from row 0 (so A = P in the first row), then we start
-  //    again from the row 0.
-  // B: It starts from (1, row) and in the last pixel we don't moved it.
-  // C: It starts from (0, 0) and then it is moved with a delay.
-  // D: It starts from row 1 and continues until we reach the last
-  //    row, in that case we start D iterator again.
-  //
-  LockImageBits<ImageTraits>::const_iterator itP, itA, itB, itC, itD, savedD;
-  LockImageBits<ImageTraits>::const_iterator srcEnd = srcBits.end();
-  color_t P, A, B, C, D;
-
-  // Adjust iterators
-  itP = itA = itB = itC = itD = savedD = srcBits.begin();
-  dstRow1_it += dst_w;
-  itD += src->width();
-
-  for (int y=0; y<src_h; ++y) {
-    if (y == 1) itA = srcBits.begin();
-    if (y == src_h-2) savedD = itD;
-    if (y == src_h-1) itD = savedD;
-    ++itB;
-
-    for (int x=0; x<src_w; ++x) {
-      ASSERT(itP != srcEnd);
-      ASSERT(itA != srcEnd);
-      ASSERT(itB != srcEnd);
-      ASSERT(itC != srcEnd);
-      ASSERT(itD != srcEnd);
-      ASSERT(dstRow0_it != dstRow0_end);
-      ASSERT(dstRow1_it != dstRow1_end);
-
-      P = *itP;
-      A = *itA;                 // y-1
-      B = *itB;                 // x+1
-      C = *itC;                 // x-1
-      D = *itD;                 // y+1
-
-      *dstRow0_it = (C == A && C != D && A != B ? A: P);
-      ++dstRow0_it;
-      *dstRow0_it = (A == B && A != C && B != D ? B: P);
-      ++dstRow0_it;
-
-      *dstRow1_it = (D == C && D != B && C != A ? C: P);
-      ++dstRow1_it;
-      *dstRow1_it = (B == D && B != A && D != C ? D: P);
-      ++dstRow1_it;
-
-      ++itP;
-      ++itA;
-      if (x < src_w-2) ++itB;
-      if (x > 0) ++itC;
-      ++itD;
+  const int dst_w = w*2;
+
+  for (int y=0; y<h; ++y) {
+    const T* row = src + y*w;
+    const T* prev = (y > 0 ? row-w: row);
+    const T* next = (y < h-1 ? row+w: row);
+    T* dst0 = dst + 2*y*dst_w;
+    T* dst1 = dst0 + dst_w;
+
+    for (int x=0; x<w; ++x) {
+      const T P = row[x];
+      const T A = prev[x];
+      const T B = (x < w-1 ? row[x+1]: P);
+      const T C = (x > 0 ? row[x-1]: P);
+      const T D = next[x];
+
+      *(dst0++) = (C == A && C != D && A != B ? A: P);
+      *(dst0++) = (A == B && A != C && B != D ? B: P);
+      *(dst1++) = (D == C && D != B && C != A ? C: P);
+      *(dst1++) = (B == D && B != A && D != C ? D: P);
     }
+  }
+}
 
-    // Adjust iterators for the next two rows.
-    ++itB;
-    ++itC;
-    dstRow0_it += dst_w;
-    if (y < src_h-1)
-      dstRow1_it += dst_w;
+// Calculates one pixel of the source upscaled "level" times with
+// Scale2x (same result as calling scale2x() on the whole image).
+template<typename ImageTraits>
+typename ImageTraits::pixel_t scale2x_pixel(const Image* src, const int level,
+                                             const int x, const int y)
+{
+  if (level == 0)
+    return get_pixel_fast<ImageTraits>(src, x, y);
+
+  const int w = (src->width() << (level-1));
+  const int h = (src->height() << (level-1));
+  const int px = x >> 1;
+  const int py = y >> 1;
+  const auto P = scale2x_pixel<ImageTraits>(src, level-1, px, py);
+  const auto A = (py > 0 ? scale2x_pixel<ImageTraits>(src, level-1, px, py-1): P);
+  const auto B = (px < w-1 ? scale2x_pixel<ImageTraits>(src, level-1, px+1, py): P);
+  const auto C = (px > 0 ? scale2x_pixel<ImageTraits>(src, level-1, px-1, py): P);
+  const auto D = (py < h-1 ? scale2x_pixel<ImageTraits>(src, level-1, px, py+1): P);
+
+  switch (((y & 1) << 1) | (x & 1)) {
+    case 0: return (C == A && C != D && A != B ? A: P);
+    case 1: return (A == B && A != C && B != D ? B: P);
+    case 2: return (D == C && D != B && C != A ? C: P);
+    default: return (B == D && B != A && D != C ? D: P);
   }
+}
 
-  // ASSERT(itP == srcEnd);
-  // ASSERT(itA == srcEnd);
-  // ASSERT(itB == srcEnd);
-  // ASSERT(itC == srcEnd);
-  // ASSERT(itD == srcEnd);
-  ASSERT(dstRow0_it == dstRow0_end);
-  ASSERT(dstRow1_it == dstRow1_end);
-#else
-
-#define A c[0]
-#define B c[1]
-#define C c[2]
-#define D c[3]
-#define P c[4]
-
-  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, 0, src_w*2, src_h*2));
-  auto dstIt = dstBits.begin();
-  auto dstIt2 = dstIt;
-
-  color_t c[5];
-  for (int y=0; y<src_h; ++y) {
-    dstIt2 += src_w*2;
-    for (int x=0; x<src_w; ++x) {
-      P = get_pixel_fast<ImageTraits>(src, x, y);
-      A = (y > 0 ? get_pixel_fast<ImageTraits>(src, x, y-1): P);
-      B = (x < src_w-1 ? get_pixel_fast<ImageTraits>(src, x+1, y): P);
-      C = (x > 0 ? get_pixel_fast<ImageTraits>(src, x-1, y): P);
-      D = (y < src_h-1 ? get_pixel_fast<ImageTraits>(src, x, y+1): P);
-
-      *dstIt = (C == A && C != D && A != B ? A: P);
-      ++dstIt;
-      *dstIt = (A == B && A != C && B != D ? B: P);
-      ++dstIt;
-
-      *dstIt2 = (D == C && D != B && C != A ? C: P);
-      ++dstIt2;
-      *dstIt2 = (B == D && B != A && D != C ? D: P);
-      ++dstIt2;
+// Pixel rules: "rotated()" returns the pixel that parallelogram()
+// painted in the intermediate 8x image (cleared with the mask
+// color), and "blend()" is how scale_image() put that pixel in the
+// destination.
+
+class RgbDelegate {
+public:
+  RgbDelegate(color_t maskColor) : m_maskColor(maskColor) { }
+  color_t maskColor() const { return m_maskColor; }
+  color_t rotated(color_t c) const {
+    if ((rgba_geta(m_maskColor) == 0) || ((c & rgba_rgb_mask) != (m_maskColor & rgba_rgb_mask)))
+      return rgba_blender_normal(m_maskColor, c);
+    else
+      return m_maskColor;
+  }
+  color_t blend(color_t back, color_t front) const {
+    return rgba_blender_normal(back, front);
+  }
+private:
+  color_t m_maskColor;
+};
+
+class GrayscaleDelegate {
+public:
+  GrayscaleDelegate(color_t maskColor) : m_maskColor(maskColor) { }
+  color_t maskColor() const { return m_maskColor; }
+  color_t rotated(color_t c) const {
+    if ((graya_geta(m_maskColor) == 0) || ((c & graya_v_mask) != (m_maskColor & graya_v_mask)))
+      return graya_blender_normal(m_maskColor, c, 255);
+    else
+      return m_maskColor;
+  }
+  color_t blend(color_t back, color_t front) const {
+    return graya_blender_normal(back, front);
+  }
+private:
+  color_t m_maskColor;
+};
+
+class IndexedDelegate {
+public:
+  IndexedDelegate(color_t maskColor) : m_maskColor(maskColor) { }
+  color_t maskColor() const { return m_maskColor; }
+  color_t rotated(color_t c) const { return c; }
+  color_t blend(color_t back, color_t front) const {
+    return (front != m_maskColor ? front: back);
+  }
+private:
+  color_t m_maskColor;
+};
+
+class BitmapDelegate {
+public:
+  color_t maskColor() const { return 0; }
+  color_t rotated(color_t c) const { return c; }
+  color_t blend(color_t back, color_t front) const {
+    return (front != 0 ? front: back);
+  }
+};
+
+// Scanline of the 8x destination painted by parallelogram(): the
+// pixels from x1 to x2 are taken from the 8x source point (u, v),
+// adding (du, dv) for each next pixel (in 16.16 fixed point). We use
+// the same scanlines to paint exactly the same pixels, even when the
+// corners don't form a perfect parallelogram.
+struct Scanline {
+  int x1 = 0, x2 = -1;
+  int u = 0, v = 0, du = 0, dv = 0;
+
+  // Returns false if the pixel x isn't painted in this scanline.
+  bool map(const int x, const int srcW, const int srcH,
+           int& srcX, int& srcY) const {
+    if (x < x1 || x > x2)
+      return false;
+    srcX = int((u + int64_t(x - x1)*du) >> 16);
+    srcY = int((v + int64_t(x - x1)*dv) >> 16);
+    return (srcX >= 0 && srcY >= 0 && srcX < srcW && srcY < srcH);
+  }
+};
+
+// Returns the source pixels that scale_image() (nearest neighbor)
+// picks to scale "srcN" pixels to "dstN" pixels, using the same
+// fixed point arithmetic. In columns, scale_image() stops painting
+// when the next source pixel is outside the source, so those
+// positions are -1.
+std::vector<int> scale_image_positions(const int srcN, const int dstN,
+                                       const bool columns)
+{
+  std::vector<int> pos(dstN, -1);
+  const fixed step = fixdiv(itofix(srcN-1), itofix(dstN-1));
+  fixed f = 0;
+  int old = 0;
+  for (int i=0; i<dstN; ++i) {
+    if (columns) {
+      pos[i] = old;
+      f = fixadd(f, step);
+      const int next = fixtoi(f);
+      if (next != old) {
+        if (next < srcN)
+          old = next;
+        else
+          break;
+      }
+    }
+    else {
+      pos[i] = fixtoi(f);
+      f = fixadd(f, step);
     }
-    dstIt += src_w*2;
   }
-
-#endif
+  return pos;
 }
 
-static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
+template<typename ImageTraits, typename Delegate>
+void rotsprite_tpl(Image* bmp, const Image* spr, const Image* mask,
+                   const gfx::Rect& rotBounds,
+                   const InverseMap& map,
+                   const std::vector<Scanline>& scanlines,
+                   const Delegate& delegate,
+                   base::task_token* token)
 {
-  switch (src->pixelFormat()) {
-    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  const gfx::Rect bounds = (rotBounds & bmp->bounds());
+  if (bounds.isEmpty())
+    return;
+
+  // Sampling positions of the 8x destination (to downscale it) and
+  // of the 1x mask (to upscale it).
+  const std::vector<int> xs = scale_image_positions(rotBounds.w*kScale, rotBounds.w, true);
+  const std::vector<int> ys = scale_image_positions(rotBounds.h*kScale, rotBounds.h, false);
+  std::vector<int> maskXs, maskYs;
+  if (mask) {
+    maskXs = scale_image_positions(mask->width(), mask->width()*kScale, true);
+    maskYs = scale_image_positions(mask->height(), mask->height()*kScale, false);
   }
+  const bool tiled = (map.sourcePixelsX() <= kMaxTiledSourcePixels &&
+                      map.sourcePixelsY() <= kMaxTiledSourcePixels);
+  const gfx::Rect sprBounds = spr->bounds();
+  const int srcW = spr->width()*kScale;
+  const int srcH = spr->height()*kScale;
+  const int rows = (bounds.h + kTileSize - 1) / kTileSize;
+
+  // Each item paints a whole row of tiles, so two threads never
+  // write the same bytes of the destination (e.g. in IMAGE_BITMAP
+  // images where each byte contains 8 pixels).
+  parallel_for(
+    rows,
+    [&](const int row){
+      if (token && token->canceled())
+        return;
+
+      std::vector<pixel_t> buf[2];
+
+      for (int tx=bounds.x; tx<bounds.x2(); tx+=kTileSize) {
+        const gfx::Rect tile =
+          (gfx::Rect(tx, bounds.y + row*kTileSize, kTileSize, kTileSize) & bounds);
+
+        // Upscale the source area used by this tile
+        gfx::Rect src8;
+        const pixel_t* src8Pixels = nullptr;
+        if (tiled) {
+          double umin = std::numeric_limits<double>::max(), umax = -umin;
+          double vmin = umin, vmax = umax;
+          for (int i=0; i<4; ++i) {
+            const int x = (i & 1 ? tile.x2()-1: tile.x) - rotBounds.x;
+            const int y = (i & 2 ? tile.y2()-1: tile.y) - rotBounds.y;
+            double u, v;
+            map.map(xs[x] + 0.5, ys[y] + 0.5, u, v);
+            umin = std::min(umin, u);
+            umax = std::max(umax, u);
+            vmin = std::min(vmin, v);
+            vmax = std::max(vmax, v);
+          }
+
+          gfx::Rect src(int(std::floor(umin / kScale)) - kTileMargin,
+                        int(std::floor(vmin / kScale)) - kTileMargin, 0, 0);
+          src.w = int(std::floor(umax / kScale)) + kTileMargin + 1 - src.x;
+          src.h = int(std::floor(vmax / kScale)) + kTileMargin + 1 - src.y;
+          src &= sprBounds;
+
+          if (!src.isEmpty()) {
+            buf[0].resize(src.w*src.h << (2*(kLevels-1)));
+            buf[1].resize(src.w*src.h << (2*kLevels));
+
+            pixel_t* p = buf[0].data();
+            for (int y=src.y; y<src.y2(); ++y)
+              for (int x=src.x; x<src.x2(); ++x)
+                *(p++) = get_pixel_fast<ImageTraits>(spr, x, y);
+
+            int w = src.w, h = src.h;
+            for (int level=0; level<kLevels; ++level, w*=2, h*=2)
+              scale2x(buf[level & 1].data(), w, h, buf[(level+1) & 1].data());
+
+            src8 = gfx::Rect(src.x*kScale, src.y*kScale, w, h);
+            src8Pixels = buf[kLevels & 1].data();
+          }
+        }
+
+        for (int y=tile.y; y<tile.y2(); ++y) {
+          const Scanline& scanline = scanlines[ys[y - rotBounds.y]];
+
+          for (int x=tile.x; x<tile.x2(); ++x) {
+            // Pixel not painted by scale_image()
+            if (xs[x - rotBounds.x] < 0)
+              continue;
+
+            color_t c = delegate.maskColor();
+            int u, v;
+            if (scanline.map(xs[x - rotBounds.x], srcW, srcH, u, v) &&
+                (!mask ||
+                 (u < int(maskXs.size()) && v < int(maskYs.size()) &&
+                  maskXs[u] >= 0 &&
+                  get_pixel_fast<BitmapTraits>(mask, maskXs[u], maskYs[v])))) {
+              if (src8.contains(u, v))
+                c = src8Pixels[(v - src8.y)*src8.w + (u - src8.x)];
+              else
+                c = scale2x_pixel<ImageTraits>(spr, kLevels, u, v);
+              c = delegate.rotated(c);
+            }
+
+            put_pixel_fast<ImageTraits>(
+              bmp, x, y,
+              delegate.blend(get_pixel_fast<ImageTraits>(bmp, x, y), c));
+          }
+        }
+      }
+    });
 }
 
+} // anonymous namespace
+
 void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   int x1, int y1, int x2, int y2,
-  int x3, int y3, int x4, int y4)
+  int x3, int y3, int x4, int y4,
+  base::task_token* token)
 {
-  static ImageBufferPtr buf[3]; // TODO non-thread safe
-
-  for (int i=0; i<3; ++i)
-    if (!buf[i])
-      buf[i].reset(new ImageBuffer(1));
+  PROF_ZONE("doc", "rotsprite_image");
 
   int xmin = std::min(x1, std::min(x2, std::min(x3, x4)));
   int xmax = std::max(x1, std::max(x2, std::max(x3, x4)));
@@ -184,45 +409,48 @@ void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   if (rot_width == 0 || rot_height == 0)
     return;
 
-  int scale = 8;
-  std::unique_ptr<Image> bmp_copy(Image::create(bmp->pixelFormat(), rot_width*scale, rot_height*scale, buf[0]));
-  std::unique_ptr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[1]));
-  std::unique_ptr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[2]));
-  std::unique_ptr<Image> msk_copy;
-
-  color_t maskColor = spr->maskColor();
-
-  bmp_copy->setMaskColor(maskColor);
-  tmp_copy->setMaskColor(maskColor);
-  spr_copy->setMaskColor(maskColor);
-
-  spr_copy->clear(maskColor);
-  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
-
-  for (int i=0; i<3; ++i) {
-    // clear_image(tmp_copy, maskColor);
-    image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy.get(), gfx::Clip(tmp_copy->bounds()));
-  }
+  // Parallelogram corners in the 8x destination
+  const InverseMap map(
+    spr->width()*kScale, spr->height()*kScale,
+    (x1-xmin)*kScale, (y1-ymin)*kScale,
+    (x2-xmin)*kScale, (y2-ymin)*kScale,
+    (x4-xmin)*kScale, (y4-ymin)*kScale);
+  if (!map.isValid())
+    return;
 
-  if (mask) {
-    // Same ImageBuffer than tmp_copy
-    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[1]));
-    clear_image(msk_copy.get(), 0);
-    scale_image(msk_copy.get(), mask,
-                0, 0, msk_copy->width(), msk_copy->height(),
-                0, 0, mask->width(), mask->height());
+  std::vector<Scanline> scanlines(rot_height*kScale);
+  parallelogram_scanlines(
+    rot_width*kScale, rot_height*kScale,
+    spr->width()*kScale, spr->height()*kScale,
+    (x1-xmin)*kScale, (y1-ymin)*kScale,
+    (x2-xmin)*kScale, (y2-ymin)*kScale,
+    (x3-xmin)*kScale, (y3-ymin)*kScale,
+    (x4-xmin)*kScale, (y4-ymin)*kScale,
+    [&scanlines](int y, int x1, int x2, int u, int v, int du, int dv) {
+      scanlines[y] = Scanline{ x1, x2, u, v, du, dv };
+    });
+
+  const gfx::Rect rotBounds(xmin, ymin, rot_width, rot_height);
+  const color_t maskColor = spr->maskColor();
+
+  switch (bmp->pixelFormat()) {
+    case IMAGE_RGB:
+      rotsprite_tpl<RgbTraits>(bmp, spr, mask, rotBounds, map, scanlines,
+                               RgbDelegate(maskColor), token);
+      break;
+    case IMAGE_GRAYSCALE:
+      rotsprite_tpl<GrayscaleTraits>(bmp, spr, mask, rotBounds, map, scanlines,
+                                     GrayscaleDelegate(maskColor), token);
+      break;
+    case IMAGE_INDEXED:
+      rotsprite_tpl<IndexedTraits>(bmp, spr, mask, rotBounds, map, scanlines,
+                                   IndexedDelegate(maskColor), token);
+      break;
+    case IMAGE_BITMAP:
+      rotsprite_tpl<BitmapTraits>(bmp, spr, mask, rotBounds, map, scanlines,
+                                  BitmapDelegate(), token);
+      break;
   }
-
-  clear_image(bmp_copy.get(), maskColor);
-  parallelogram(
-    bmp_copy.get(), spr_copy.get(), msk_copy.get(),
-    (x1-xmin)*scale, (y1-ymin)*scale, (x2-xmin)*scale, (y2-ymin)*scale,
-    (x3-xmin)*scale, (y3-ymin)*scale, (x4-xmin)*scale, (y4-ymin)*scale);
-
-  scale_image(bmp, bmp_copy.get(),
-              xmin, ymin, rot_width, rot_height,
-              0, 0, bmp_copy->width(), bmp_copy->height());
 }
 
 } // namespace algorithm
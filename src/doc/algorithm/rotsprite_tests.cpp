@@ -0,0 +1,271 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/rotate.h"
+#include "doc/algorithm/rotsprite.h"
+#include "doc/image.h"
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+
+using namespace doc;
+using namespace doc::algorithm;
+
+// Horizontal stripes aren't modified by Scale2x, so we can compare
+// the result pixel by pixel.
+static ImageRef create_stripes(PixelFormat format, int w, int h)
+{
+  ImageRef image(Image::create(format, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(image.get(), x, y,
+                format == IMAGE_RGB ? rgba((y*32) & 255, y & 255, 0, 255): y+1);
+  return image;
+}
+
+TEST(RotSprite, Identity)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_INDEXED }) {
+    ImageRef spr = create_stripes(format, 5, 4);
+    ImageRef dst(Image::create(format, 5, 4));
+    clear_image(dst.get(), 0);
+
+    rotsprite_image(dst.get(), spr.get(), nullptr,
+                    0, 0, 5, 0, 5, 4, 0, 4);
+
+    for (int y=0; y<4; ++y)
+      for (int x=0; x<5; ++x)
+        EXPECT_EQ(get_pixel(spr.get(), x, y),
+                  get_pixel(dst.get(), x, y)) << x << "," << y;
+  }
+}
+
+TEST(RotSprite, Rotate90)
+{
+  ImageRef spr = create_stripes(IMAGE_RGB, 64, 48);
+  ImageRef dst(Image::create(IMAGE_RGB, 48, 64));
+  clear_image(dst.get(), 0);
+
+  // Clockwise rotation (the top edge of the sprite is the right
+  // edge of the destination)
+  rotsprite_image(dst.get(), spr.get(), nullptr,
+                  48, 0, 48, 64, 0, 64, 0, 0);
+
+  for (int y=0; y<64; ++y)
+    for (int x=0; x<48; ++x)
+      ASSERT_EQ(get_pixel(spr.get(), y, 47-x),
+                get_pixel(dst.get(), x, y)) << x << "," << y;
+}
+
+TEST(RotSprite, Mask)
+{
+  ImageRef spr = create_stripes(IMAGE_INDEXED, 4, 4);
+  ImageRef mask(Image::create(IMAGE_BITMAP, 4, 4));
+  clear_image(mask.get(), 0);
+  put_pixel(mask.get(), 1, 2, 1);
+
+  ImageRef dst(Image::create(IMAGE_INDEXED, 4, 4));
+  clear_image(dst.get(), 0);
+
+  rotsprite_image(dst.get(), spr.get(), mask.get(),
+                  0, 0, 4, 0, 4, 4, 0, 4);
+
+  for (int y=0; y<4; ++y)
+    for (int x=0; x<4; ++x)
+      EXPECT_EQ(x == 1 && y == 2 ? 3: 0,
+                get_pixel(dst.get(), x, y)) << x << "," << y;
+}
+
+// Scale2x of the whole image (as the old rotsprite_image() did)
+template<typename ImageTraits>
+static void reference_scale2x(Image* dst, const Image* src)
+{
+  const int w = src->width();
+  const int h = src->height();
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      color_t P = get_pixel_fast<ImageTraits>(src, x, y);
+      color_t A = (y > 0 ? get_pixel_fast<ImageTraits>(src, x, y-1): P);
+      color_t B = (x < w-1 ? get_pixel_fast<ImageTraits>(src, x+1, y): P);
+      color_t C = (x > 0 ? get_pixel_fast<ImageTraits>(src, x-1, y): P);
+      color_t D = (y < h-1 ? get_pixel_fast<ImageTraits>(src, x, y+1): P);
+      put_pixel_fast<ImageTraits>(dst, 2*x,   2*y,   C == A && C != D && A != B ? A: P);
+      put_pixel_fast<ImageTraits>(dst, 2*x+1, 2*y,   A == B && A != C && B != D ? B: P);
+      put_pixel_fast<ImageTraits>(dst, 2*x,   2*y+1, D == C && D != B && C != A ? C: P);
+      put_pixel_fast<ImageTraits>(dst, 2*x+1, 2*y+1, B == D && B != A && D != C ? D: P);
+    }
+  }
+}
+
+// The old RotSprite pipeline: the sprite is upscaled 8x (three
+// Scale2x passes), rotated with parallelogram(), and downscaled with
+// scale_image().
+template<typename ImageTraits>
+static void reference_rotsprite(Image* dst, const Image* spr, const Image* mask,
+                                int x1, int y1, int x2, int y2,
+                                int x3, int y3, int x4, int y4)
+{
+  const int xmin = std::min({ x1, x2, x3, x4 });
+  const int xmax = std::max({ x1, x2, x3, x4 });
+  const int ymin = std::min({ y1, y2, y3, y4 });
+  const int ymax = std::max({ y1, y2, y3, y4 });
+  const int scale = 8;
+  const color_t maskColor = spr->maskColor();
+
+  ImageRef sprCopy(Image::createCopy(spr));
+  for (int i=0; i<3; ++i) {
+    ImageRef tmp(Image::create(spr->pixelFormat(),
+                               sprCopy->width()*2,
+                               sprCopy->height()*2));
+    reference_scale2x<ImageTraits>(tmp.get(), sprCopy.get());
+    sprCopy = tmp;
+  }
+  sprCopy->setMaskColor(maskColor);
+
+  ImageRef mskCopy;
+  if (mask) {
+    mskCopy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale));
+    clear_image(mskCopy.get(), 0);
+    scale_image(mskCopy.get(), mask,
+                0, 0, mskCopy->width(), mskCopy->height(),
+                0, 0, mask->width(), mask->height());
+  }
+
+  ImageRef dstCopy(Image::create(dst->pixelFormat(),
+                                 (xmax-xmin)*scale, (ymax-ymin)*scale));
+  dstCopy->setMaskColor(maskColor);
+  clear_image(dstCopy.get(), maskColor);
+  parallelogram(
+    dstCopy.get(), sprCopy.get(), mskCopy.get(),
+    (x1-xmin)*scale, (y1-ymin)*scale, (x2-xmin)*scale, (y2-ymin)*scale,
+    (x3-xmin)*scale, (y3-ymin)*scale, (x4-xmin)*scale, (y4-ymin)*scale);
+
+  scale_image(dst, dstCopy.get(),
+              xmin, ymin, xmax-xmin, ymax-ymin,
+              0, 0, dstCopy->width(), dstCopy->height());
+}
+
+// Diagonal lines, isolated pixels and a filled area, which are
+// modified by Scale2x.
+static ImageRef create_shapes(PixelFormat format, int w, int h)
+{
+  auto color = [format](int i) -> color_t {
+    return (format == IMAGE_RGB ? rgba(64*i, 255-32*i, 16*i, 255): i);
+  };
+  ImageRef image(Image::create(format, w, h));
+  clear_image(image.get(), 0);
+  for (int i=0; i<std::min(w, h); ++i) {
+    put_pixel(image.get(), i, i, color(1));
+    put_pixel(image.get(), w-1-i, i/2, color(2));
+  }
+  for (int y=0; y<h; y+=5)
+    for (int x=(y%3); x<w; x+=7)
+      put_pixel(image.get(), x, y, color(3));
+  fill_rect(image.get(), w/2, h/2, w-3, h-2, color(4));
+  return image;
+}
+
+// Compares rotsprite_image() against the old pipeline (scale2x three
+// times + parallelogram) for the given destination corners.
+static void expect_same_result_as_old_pipeline(const int c[8])
+{
+  const int w = 37, h = 29;
+
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_INDEXED }) {
+    for (const bool withMask : { false, true }) {
+      ImageRef spr = create_shapes(format, w, h);
+      ImageRef mask;
+      if (withMask) {
+        mask.reset(Image::create(IMAGE_BITMAP, w, h));
+        clear_image(mask.get(), 0);
+        fill_rect(mask.get(), 4, 3, w-6, h-2, 1);
+      }
+
+      const int xmin = std::min({ c[0], c[2], c[4], c[6] });
+      const int ymin = std::min({ c[1], c[3], c[5], c[7] });
+      const int dw = std::max({ c[0], c[2], c[4], c[6] }) - xmin;
+      const int dh = std::max({ c[1], c[3], c[5], c[7] }) - ymin;
+
+      ImageRef expected(Image::create(format, dw, dh));
+      ImageRef result(Image::create(format, dw, dh));
+      clear_image(expected.get(), 0);
+      clear_image(result.get(), 0);
+
+      // Move the corners inside the destination images
+      const int x1 = c[0]-xmin, y1 = c[1]-ymin;
+      const int x2 = c[2]-xmin, y2 = c[3]-ymin;
+      const int x3 = c[4]-xmin, y3 = c[5]-ymin;
+      const int x4 = c[6]-xmin, y4 = c[7]-ymin;
+
+      if (format == IMAGE_RGB)
+        reference_rotsprite<RgbTraits>(expected.get(), spr.get(), mask.get(),
+                                       x1, y1, x2, y2, x3, y3, x4, y4);
+      else
+        reference_rotsprite<IndexedTraits>(expected.get(), spr.get(), mask.get(),
+                                           x1, y1, x2, y2, x3, y3, x4, y4);
+
+      rotsprite_image(result.get(), spr.get(), mask.get(),
+                      x1, y1, x2, y2, x3, y3, x4, y4);
+
+      int nonEmpty = 0;
+      for (int y=0; y<dh; ++y) {
+        for (int x=0; x<dw; ++x) {
+          ASSERT_EQ(get_pixel(expected.get(), x, y),
+                    get_pixel(result.get(), x, y))
+            << "format=" << format << " mask=" << withMask
+            << " pixel=" << x << "," << y;
+          if (get_pixel(result.get(), x, y) != 0)
+            ++nonEmpty;
+        }
+      }
+      EXPECT_GT(nonEmpty, 0);
+    }
+  }
+}
+
+TEST(RotSprite, SameResultAsOldPipeline)
+{
+  // Rotation of 30 degrees (approximately) around the sprite center,
+  // a scaled/skewed quad, and a rotation of 235 degrees (the integer
+  // corners of the last two don't form a perfect parallelogram).
+  const int corners[][8] = {
+    { 12, -6, 44, 13, 27, 38, -5, 19 },
+    { 3, 2, 50, 9, 41, 40, -4, 25 },
+    { 35, 49, -7, -11, 4, -19, 47, 41 },
+  };
+
+  for (const auto& c : corners) {
+    SCOPED_TRACE(testing::Message() << "corners=" << c[0] << "," << c[1]);
+    expect_same_result_as_old_pipeline(c);
+  }
+}
+
+TEST(RotSprite, SameResultAsOldPipelineWithoutTiles)
+{
+  // Strong downscales (the destination is less than half the source
+  // size) sample too sparsely to use the upscaled tiles, so each
+  // pixel is computed with the per-pixel scale2x fallback.
+  const int corners[][8] = {
+    { 5, 0, 16, 6, 11, 14, 0, 8 },     // 30 degrees, 1/3 of the size
+    { 14, 16, -2, 10, 2, -2, 18, 4 },  // 200 degrees, 0.45 of the size
+    { 0, 0, 12, 0, 12, 9, 0, 9 },      // No rotation, 1/3 of the size
+  };
+
+  for (const auto& c : corners) {
+    SCOPED_TRACE(testing::Message() << "corners=" << c[0] << "," << c[1]);
+    expect_same_result_as_old_pipeline(c);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,154 +17,211 @@
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
 #include "doc/tileset.h"
 
-#include <thread>
+#include <algorithm>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
 namespace {
 
-template<typename ImageTraits>
-bool is_same_pixel(color_t pixel1, color_t pixel2)
-{
-  static_assert(false && sizeof(ImageTraits), "No is_same_pixel impl");
-  return false;
-}
+// Pixels are compared in blocks of this size without an early exit
+// inside the block, so the compiler can vectorize the inner loop.
+const int kBlockSize = 32;
 
-template<>
-bool is_same_pixel<RgbTraits>(color_t pixel1, color_t pixel2)
-{
-  return (rgba_geta(pixel1) == 0 && rgba_geta(pixel2) == 0) || (pixel1 == pixel2);
-}
+// Rows per band when we look for the bounds in parallel.
+const int kMinRowsPerBand = 64;
 
-template<>
-bool is_same_pixel<GrayscaleTraits>(color_t pixel1, color_t pixel2)
+// Pixels that are the same as the reference pixel are the ones where
+// (pixel & mask) == (refpixel & mask). For RGB/Grayscale images
+// all transparent pixels are equal if the reference pixel is
+// transparent too.
+template<typename ImageTraits>
+typename ImageTraits::pixel_t ref_pixel_mask(color_t refpixel)
 {
-  return (graya_geta(pixel1) == 0 && graya_geta(pixel2) == 0) || (pixel1 == pixel2);
+  return typename ImageTraits::pixel_t(~0);
 }
 
 template<>
-bool is_same_pixel<IndexedTraits>(color_t pixel1, color_t pixel2)
+RgbTraits::pixel_t ref_pixel_mask<RgbTraits>(color_t refpixel)
 {
-  return pixel1 == pixel2;
+  return (rgba_geta(refpixel) == 0 ? rgba_a_mask: RgbTraits::pixel_t(~0));
 }
 
 template<>
-bool is_same_pixel<BitmapTraits>(color_t pixel1, color_t pixel2)
+GrayscaleTraits::pixel_t ref_pixel_mask<GrayscaleTraits>(color_t refpixel)
 {
-  return pixel1 == pixel2;
+  return (graya_geta(refpixel) == 0 ? graya_a_mask: GrayscaleTraits::pixel_t(~0));
 }
 
 template<typename ImageTraits>
-bool shrink_bounds_left_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowSize)
-{
-  int u, v;
-  // Shrink left side
-  for (u=bounds.x; u<bounds.x2(); ++u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
-    for (; v<bounds.y2(); ++v, ptr+=rowSize) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+class RefPixel {
+public:
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  RefPixel(const Image* image, color_t refpixel)
+    : m_image(image)
+    , m_mask(ref_pixel_mask<ImageTraits>(refpixel))
+    , m_ref(pixel_t(refpixel) & m_mask) {
+  }
+
+  // Returns the index of the first pixel in the [x, x+n) range of
+  // the row y that is different from the reference pixel, or n if
+  // all pixels are the same.
+  int findFirstDiff(const int x, const int y, const int n) const {
+    auto ptr = get_pixel_address_fast<ImageTraits>(m_image, x, y);
+    int i = 0;
+    for (; i+kBlockSize <= n; i+=kBlockSize) {
+      pixel_t diff = 0;
+      for (int j=0; j<kBlockSize; ++j)
+        diff |= (ptr[i+j] & m_mask) ^ m_ref;
+      if (diff)
+        break;
     }
-    ++bounds.x;
-    --bounds.w;
+    for (; i<n; ++i)
+      if ((ptr[i] & m_mask) != m_ref)
+        return i;
+    return n;
   }
-  return (!bounds.isEmpty());
-}
 
-template<typename ImageTraits>
-bool shrink_bounds_right_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowSize)
-{
-  int u, v;
-  // Shrink right side
-  for (u=bounds.x2()-1; u>=bounds.x; --u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
-    for (; v<bounds.y2(); ++v, ptr+=rowSize) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+  // Returns the index of the last pixel in the [x, x+n) range of the
+  // row y that is different from the reference pixel, or -1 if all
+  // pixels are the same.
+  int findLastDiff(const int x, const int y, const int n) const {
+    auto ptr = get_pixel_address_fast<ImageTraits>(m_image, x, y);
+    int i = n;
+    for (; i-kBlockSize >= 0; i-=kBlockSize) {
+      pixel_t diff = 0;
+      for (int j=i-kBlockSize; j<i; ++j)
+        diff |= (ptr[j] & m_mask) ^ m_ref;
+      if (diff)
+        break;
     }
-    --bounds.w;
+    for (--i; i>=0; --i)
+      if ((ptr[i] & m_mask) != m_ref)
+        return i;
+    return -1;
   }
-  return (!bounds.isEmpty());
-}
 
+private:
+  const Image* m_image;
+  pixel_t m_mask;
+  pixel_t m_ref;
+};
+
+// Bitmaps have 8 pixels per byte, so we compare them one by one.
+template<>
+class RefPixel<BitmapTraits> {
+public:
+  RefPixel(const Image* image, color_t refpixel)
+    : m_image(image)
+    , m_ref(refpixel) {
+  }
+
+  int findFirstDiff(const int x, const int y, const int n) const {
+    for (int i=0; i<n; ++i)
+      if (get_pixel_fast<BitmapTraits>(m_image, x+i, y) != m_ref)
+        return i;
+    return n;
+  }
+
+  int findLastDiff(const int x, const int y, const int n) const {
+    for (int i=n-1; i>=0; --i)
+      if (get_pixel_fast<BitmapTraits>(m_image, x+i, y) != m_ref)
+        return i;
+    return -1;
+  }
+
+private:
+  const Image* m_image;
+  color_t m_ref;
+};
+
+// Shrinks the bounds to the pixels that are different from the
+// reference pixel. All the image is traversed by rows (which is
+// cache-friendly): first we look for the top and bottom rows with
+// different pixels, and then for the left/right limits only in the
+// rows between them and only until the current limits.
 template<typename ImageTraits>
-bool shrink_bounds_top_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+bool shrink_bounds_rows_templ(const RefPixel<ImageTraits>& ref, gfx::Rect& bounds)
 {
-  int u, v;
+  const int x = bounds.x;
+  const int w = bounds.w;
+
   // Shrink top side
-  for (v=bounds.y; v<bounds.y2(); ++v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
-    for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
-    }
+  while (!bounds.isEmpty() &&
+         ref.findFirstDiff(x, bounds.y, w) == w) {
     ++bounds.y;
     --bounds.h;
   }
-  return (!bounds.isEmpty());
-}
 
-template<typename ImageTraits>
-bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
-{
-  int u, v;
   // Shrink bottom side
-  for (v=bounds.y2()-1; v>=bounds.y; --v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
-    for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
-    }
+  while (!bounds.isEmpty() &&
+         ref.findFirstDiff(x, bounds.y2()-1, w) == w) {
     --bounds.h;
   }
-  return (!bounds.isEmpty());
+
+  if (bounds.isEmpty())
+    return false;
+
+  // The first and last rows have different pixels, so we can start
+  // with their left/right limits.
+  int left = std::min(ref.findFirstDiff(x, bounds.y, w),
+                      ref.findFirstDiff(x, bounds.y2()-1, w));
+  int right = std::max(ref.findLastDiff(x, bounds.y, w),
+                       ref.findLastDiff(x, bounds.y2()-1, w));
+
+  for (int v=bounds.y+1; v<bounds.y2()-1 && (left > 0 || right < w-1); ++v) {
+    if (left > 0)
+      left = ref.findFirstDiff(x, v, left);
+    if (right < w-1)
+      right += 1 + ref.findLastDiff(x+right+1, v, w-right-1);
+  }
+
+  bounds.x += left;
+  bounds.w = right - left + 1;
+  return true;
 }
 
 template<typename ImageTraits>
 bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
-  // Pixels per row
-  const int rowSize = image->getRowStrideSize() / image->getRowStrideSize(1);
-  const int canvasSize = image->width()*image->height();
-  if ((std::thread::hardware_concurrency() >= 4) &&
-      ((image->pixelFormat() == IMAGE_RGB && canvasSize >= 800*800) ||
-       (image->pixelFormat() != IMAGE_RGB && canvasSize >= 500*500))) {
-    gfx::Rect
-      leftBounds(bounds), rightBounds(bounds),
-      topBounds(bounds), bottomBounds(bounds);
-
-    // TODO use a base::thread_pool and a base::task for each border
-
-    std::thread left  ([&]{ shrink_bounds_left_templ  <ImageTraits>(image, leftBounds, refpixel, rowSize); });
-    std::thread right ([&]{ shrink_bounds_right_templ <ImageTraits>(image, rightBounds, refpixel, rowSize); });
-    std::thread top   ([&]{ shrink_bounds_top_templ   <ImageTraits>(image, topBounds, refpixel); });
-    std::thread bottom([&]{ shrink_bounds_bottom_templ<ImageTraits>(image, bottomBounds, refpixel); });
-    left.join();
-    right.join();
-    top.join();
-    bottom.join();
-    bounds = leftBounds;
-    bounds &= rightBounds;
-    bounds &= topBounds;
-    bounds &= bottomBounds;
-    return !bounds.isEmpty();
+  const RefPixel<ImageTraits> ref(image, refpixel);
+  const int concurrency = parallel_concurrency();
+  const int canvasSize = bounds.w*bounds.h;
+  const int bands = std::min(concurrency, bounds.h / kMinRowsPerBand);
+  if (bands < 2 ||
+      (image->pixelFormat() == IMAGE_RGB && canvasSize < 800*800) ||
+      (image->pixelFormat() != IMAGE_RGB && canvasSize < 500*500)) {
+    return shrink_bounds_rows_templ<ImageTraits>(ref, bounds);
   }
-  else {
-    return
-      shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowSize) &&
-      shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowSize) &&
-      shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
-      shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+
+  // Shrink each band of rows in parallel (using the shared pool of
+  // worker threads), the result is the union of all bands.
+  std::vector<gfx::Rect> bandBounds(bands);
+  const int bandHeight = (bounds.h + bands - 1) / bands;
+  for (int i=0; i<bands; ++i) {
+    const int y = bounds.y + i*bandHeight;
+    bandBounds[i] = gfx::Rect(bounds.x, y,
+                              bounds.w, std::min(bandHeight, bounds.y2()-y));
   }
+  parallel_for(
+    bands,
+    [&ref, &bandBounds](const int i){
+      if (!shrink_bounds_rows_templ<ImageTraits>(ref, bandBounds[i]))
+        bandBounds[i] = gfx::Rect();
+    });
+
+  gfx::Rect result;
+  for (const gfx::Rect& rc : bandBounds)
+    result |= rc;
+  bounds = result;
+  return !bounds.isEmpty();
 }
 
 template<typename ImageTraits>
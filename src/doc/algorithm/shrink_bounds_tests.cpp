@@ -0,0 +1,83 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/shrink_bounds.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+using namespace gfx;
+
+TEST(ShrinkBounds, EmptyImage)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 32, 32));
+  image->clear(rgba(255, 0, 0, 0));
+
+  Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds(image.get(), 0, nullptr, bounds));
+}
+
+TEST(ShrinkBounds, TransparentPixelsAreEqual)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 100, 70));
+  image->clear(rgba(255, 0, 0, 0));
+  put_pixel(image.get(), 40, 10, rgba(0, 0, 0, 1));
+  put_pixel(image.get(), 3, 50, rgba(0, 0, 0, 255));
+
+  Rect bounds;
+  EXPECT_TRUE(algorithm::shrink_bounds(image.get(), 0, nullptr, bounds));
+  EXPECT_EQ(Rect(3, 10, 38, 41), bounds);
+}
+
+TEST(ShrinkBounds, Indexed)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 70, 100));
+  image->clear(2);
+  put_pixel(image.get(), 69, 99, 0);
+  put_pixel(image.get(), 35, 0, 1);
+
+  Rect bounds;
+  EXPECT_TRUE(algorithm::shrink_bounds(image.get(), 2, nullptr, bounds));
+  EXPECT_EQ(Rect(35, 0, 35, 100), bounds);
+}
+
+TEST(ShrinkBounds, BigImages)
+{
+  // Big images are processed in bands of rows in parallel
+  for (const PixelFormat pixelFormat : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    ImageRef image(Image::create(pixelFormat, 1500, 1300));
+    image->clear(0);
+    put_pixel(image.get(), 1001, 7, 0xffffffff);
+    put_pixel(image.get(), 500, 1200, 0xffffffff);
+    put_pixel(image.get(), 1400, 640, 0xffffffff);
+
+    Rect bounds;
+    EXPECT_TRUE(algorithm::shrink_bounds(image.get(), 0, nullptr, bounds));
+    EXPECT_EQ(Rect(500, 7, 901, 1194), bounds);
+  }
+}
+
+TEST(ShrinkBounds, StartBounds)
+{
+  ImageRef image(Image::create(IMAGE_GRAYSCALE, 64, 64));
+  image->clear(0);
+  put_pixel(image.get(), 2, 2, graya(255, 255));
+  put_pixel(image.get(), 40, 30, graya(255, 255));
+
+  Rect bounds;
+  EXPECT_TRUE(algorithm::shrink_bounds(image.get(), 0, nullptr,
+                                       Rect(10, 10, 54, 54), bounds));
+  EXPECT_EQ(Rect(40, 30, 1, 1), bounds);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -78,4 +78,44 @@ Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
                     image->maskColor(), buffer);
 }
 
+template<typename ImageTraits>
+static Image* create_image_moving_pixels(const ImageSpec& spec,
+                                         const Image* image)
+{
+  ImageBufferPtr buffer =
+    static_cast<const ImageImpl<ImageTraits>*>(image)->buffer();
+
+  // The buffer is used by the image and by our "buffer" variable, if
+  // there are more references, it's shared with other images.
+  if (buffer.use_count() > 2)
+    return nullptr;
+
+  return new ImageImpl<ImageTraits>(spec, buffer, false);
+}
+
+// static
+Image* Image::createCopy(std::shared_ptr<Image>&& image)
+{
+  ASSERT(image);
+  std::shared_ptr<Image> src(std::move(image));
+  if (src.use_count() > 1)
+    return createCopy(src.get());
+
+  // Same spec of createCopy() (which doesn't copy the color space)
+  const ImageSpec spec((ColorMode)src->pixelFormat(),
+                       src->width(), src->height(),
+                       src->maskColor());
+  Image* dst = nullptr;
+  switch (src->pixelFormat()) {
+    case IMAGE_RGB:       dst = create_image_moving_pixels<RgbTraits>(spec, src.get()); break;
+    case IMAGE_GRAYSCALE: dst = create_image_moving_pixels<GrayscaleTraits>(spec, src.get()); break;
+    case IMAGE_INDEXED:   dst = create_image_moving_pixels<IndexedTraits>(spec, src.get()); break;
+    case IMAGE_BITMAP:    dst = create_image_moving_pixels<BitmapTraits>(spec, src.get()); break;
+    case IMAGE_TILEMAP:   dst = create_image_moving_pixels<TilemapTraits>(spec, src.get()); break;
+  }
+  if (!dst)
+    dst = createCopy(src.get());
+  return dst;
+}
+
 } // namespace doc
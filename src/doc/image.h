@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,6 +19,8 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <memory>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
@@ -41,6 +43,13 @@ namespace doc {
     static Image* createCopy(const Image* image,
                              const ImageBufferPtr& buffer = ImageBufferPtr());
 
+    // Same as createCopy(image.get()), but if "image" is the last
+    // reference to the image (and to its buffer), the pixels are
+    // moved to the new image instead of copied (so it's O(1)). Used
+    // to keep images that are being discarded with a new ID (e.g. in
+    // undo commands).
+    static Image* createCopy(std::shared_ptr<Image>&& image);
+
     virtual ~Image();
 
     const ImageSpec& spec() const { return m_spec; }
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,29 +9,67 @@
 #define DOC_IMAGE_BUFFER_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
 #include "base/ints.h"
 
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
-#include <vector>
+#include <new>
 
 namespace doc {
 
+  // Memory for image pixels. The memory is allocated with calloc()
+  // so big buffers are mapped to zero pages by the OS and they don't
+  // use physical memory until they are written. In this way a huge
+  // transparent image only uses memory for the painted rows/pages.
   class ImageBuffer {
   public:
-    ImageBuffer(std::size_t size = 1) : m_buffer(size) {
+    ImageBuffer(std::size_t size = 1)
+      : m_buffer(allocate(size))
+      , m_size(size)
+      , m_zeroed(true) {
     }
 
-    std::size_t size() const { return m_buffer.size(); }
-    uint8_t* buffer() { return &m_buffer[0]; }
+    ~ImageBuffer() {
+      std::free(m_buffer);
+    }
+
+    std::size_t size() const { return m_size; }
+    uint8_t* buffer() { return m_buffer; }
 
     void resizeIfNecessary(std::size_t size) {
-      if (size > m_buffer.size())
-        m_buffer.resize(size);
+      if (size > m_size) {
+        std::free(m_buffer);
+        m_buffer = allocate(size);
+        m_size = size;
+        m_zeroed = true;
+      }
+    }
+
+    // Fills the first "size" bytes with zeros. It's a no-op if the
+    // buffer was just allocated (so we don't touch the zero pages).
+    void clear(std::size_t size) {
+      if (!m_zeroed)
+        std::memset(m_buffer, 0, size);
+      // From now on the buffer can be modified by the image
+      m_zeroed = false;
     }
 
   private:
-    std::vector<uint8_t> m_buffer;
+    static uint8_t* allocate(std::size_t size) {
+      auto ptr = (uint8_t*)std::calloc(size, 1);
+      if (!ptr && size > 0)
+        throw std::bad_alloc();
+      return ptr;
+    }
+
+    uint8_t* m_buffer;
+    std::size_t m_size;
+    bool m_zeroed;
+
+    DISABLE_COPYING(ImageBuffer);
   };
 
   typedef std::shared_ptr<ImageBuffer> ImageBufferPtr;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -56,8 +56,11 @@ namespace doc {
       return (address_t)(getLineAddress(y) + x / (Traits::pixels_per_byte == 0 ? 1 : Traits::pixels_per_byte));
     }
 
+    // If clearBuffer is false, the pixels of the given buffer are
+    // kept (the buffer must be from an image with the same spec).
     ImageImpl(const ImageSpec& spec,
-              const ImageBufferPtr& buffer)
+              const ImageBufferPtr& buffer,
+              const bool clearBuffer = true)
       : Image(spec)
       , m_buffer(buffer)
     {
@@ -72,8 +75,9 @@ namespace doc {
       else
         m_buffer->resizeIfNecessary(required_size);
 
-      std::fill(m_buffer->buffer(),
-                m_buffer->buffer()+required_size, 0);
+      ASSERT(clearBuffer || m_buffer->size() >= required_size);
+      if (clearBuffer)
+        m_buffer->clear(required_size);
 
       m_rows = (address_t*)m_buffer->buffer();
       m_bits = (address_t)(m_buffer->buffer() + for_rows);
@@ -85,6 +89,10 @@ namespace doc {
       }
     }
 
+    const ImageBufferPtr& buffer() const {
+      return m_buffer;
+    }
+
     uint8_t* getPixelAddress(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -225,6 +225,34 @@ TYPED_TEST(ImageAllTypes, FillRect)
   }
 }
 
+TYPED_TEST(ImageAllTypes, CreateCopyMovingPixels)
+{
+  typedef TypeParam ImageTraits;
+
+  std::shared_ptr<Image> image(Image::create(ImageTraits::pixel_format, 31, 17));
+  image->setMaskColor(1);
+  image->clear(0);
+  fill_rect(image.get(), 3, 4, 20, 10, 1);
+  std::unique_ptr<Image> expected(Image::createCopy(image.get()));
+
+  // With other references the pixels are copied
+  std::shared_ptr<Image> ref(image);
+  std::unique_ptr<Image> copy(Image::createCopy(std::move(ref)));
+  EXPECT_EQ(nullptr, ref);
+  EXPECT_NE(image->getPixelAddress(0, 0), copy->getPixelAddress(0, 0));
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), copy.get()));
+
+  // With the last reference the pixels are moved
+  const uint8_t* bits = image->getPixelAddress(0, 0);
+  const ObjectId id = image->id();
+  std::unique_ptr<Image> moved(Image::createCopy(std::move(image)));
+  EXPECT_EQ(nullptr, image);
+  EXPECT_EQ(bits, moved->getPixelAddress(0, 0));
+  EXPECT_NE(id, moved->id());
+  EXPECT_EQ(1, moved->maskColor());
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), moved.get()));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
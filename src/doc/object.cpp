@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,6 +13,7 @@
 
 #include "base/debug.h"
 
+#include <atomic>
 #include <map>
 #include <mutex>
 
@@ -22,6 +23,8 @@ static std::mutex g_mutex;
 static ObjectId newId = 0;
 // TODO Profile this and see if an unordered_map is better
 static std::map<ObjectId, Object*> objects;
+// Incremented each time an ID is removed from "objects"
+static std::atomic<ObjectVersion> objectsVersion(0);
 
 Object::Object(ObjectType type)
   : m_type(type)
@@ -70,6 +73,7 @@ void Object::setId(ObjectId id)
     ASSERT(it->second == this);
     if (it != objects.end())
       objects.erase(it);
+    ++objectsVersion;
   }
 
   m_id = id;
@@ -109,4 +113,9 @@ Object* get_object(ObjectId id)
     return nullptr;
 }
 
+ObjectVersion get_objects_version()
+{
+  return objectsVersion;
+}
+
 } // namespace doc
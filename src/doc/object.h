@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -50,6 +51,12 @@ namespace doc {
 
   Object* get_object(ObjectId id);
 
+  // Returns a number that changes each time an object ID is removed
+  // (e.g. when an object is deleted). A pointer returned by
+  // get_object() can be reused (without looking for its ID again)
+  // while this number doesn't change.
+  ObjectVersion get_objects_version();
+
   template<typename T>
   inline T* get(ObjectId id) {
     return static_cast<T*>(get_object(id));
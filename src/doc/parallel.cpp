@@ -0,0 +1,111 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/parallel.h"
+
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace doc {
+
+namespace {
+
+// State shared between the calling thread and the workers. Workers
+// keep a reference to it because they could start after the
+// parallel_for() call returned (when all items were processed by
+// other threads).
+struct ParallelFor {
+  const std::function<void(int)>* func;
+  const int n;
+  std::atomic<int> next;
+  int done;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  ParallelFor(const std::function<void(int)>* func, const int n)
+    : func(func), n(n), next(0), done(0) {
+  }
+
+  void run() {
+    int i;
+    while ((i = next++) < n) {
+      std::exception_ptr err;
+      try {
+        (*func)(i);
+      }
+      catch (...) {
+        err = std::current_exception();
+      }
+
+      std::lock_guard lock(mutex);
+      if (err && !error)
+        error = err;
+      if (++done == n)
+        cv.notify_all();
+    }
+  }
+};
+
+int workers_count()
+{
+  static const int n =
+    std::max<int>(1, int(std::thread::hardware_concurrency())-1);
+  return n;
+}
+
+base::thread_pool& workers_pool()
+{
+  static base::thread_pool pool(workers_count());
+  return pool;
+}
+
+} // anonymous namespace
+
+int parallel_concurrency()
+{
+  return (std::thread::hardware_concurrency() > 1 ? workers_count()+1: 1);
+}
+
+void parallel_for(const int n,
+                  const std::function<void(int)>& func)
+{
+  if (n <= 0)
+    return;
+
+  if (n == 1 || parallel_concurrency() == 1) {
+    for (int i=0; i<n; ++i)
+      func(i);
+    return;
+  }
+
+  auto state = std::make_shared<ParallelFor>(&func, n);
+
+  const int helpers = std::min(n-1, workers_count());
+  base::thread_pool& pool = workers_pool();
+  for (int i=0; i<helpers; ++i)
+    pool.execute([state]{ state->run(); });
+
+  state->run();
+
+  std::unique_lock lock(state->mutex);
+  state->cv.wait(lock, [&state]{ return state->done == state->n; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+} // namespace doc
@@ -0,0 +1,35 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_PARALLEL_H_INCLUDED
+#define DOC_PARALLEL_H_INCLUDED
+#pragma once
+
+#include <functional>
+
+namespace doc {
+
+  // Returns the number of threads that can execute parallel_for()
+  // items at the same time (the calling thread + the shared worker
+  // threads). It's always >= 1.
+  int parallel_concurrency();
+
+  // Calls func(i) for each i in [0, n) distributing the calls
+  // between the calling thread and a shared pool of worker threads
+  // (so we don't create new threads for each call). Returns when all
+  // the calls are done. If a call throws an exception, it's rethrown
+  // in the calling thread.
+  //
+  // Items are processed in an unspecified order and func() must be
+  // thread-safe. It's safe to call parallel_for() from a func()
+  // (the calling thread always processes the items that the workers
+  // cannot take).
+  void parallel_for(const int n,
+                    const std::function<void(int)>& func);
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,52 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/parallel.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace doc;
+
+TEST(Parallel, CallsEachItemOnce)
+{
+  std::vector<std::atomic<int>> calls(1000);
+  parallel_for(int(calls.size()), [&calls](const int i){ ++calls[i]; });
+  for (const auto& c : calls)
+    EXPECT_EQ(1, c.load());
+}
+
+TEST(Parallel, Nested)
+{
+  std::atomic<int> sum(0);
+  parallel_for(32, [&sum](const int){
+    parallel_for(32, [&sum](const int j){ sum += j; });
+  });
+  EXPECT_EQ(32 * (31*32/2), sum.load());
+}
+
+TEST(Parallel, RethrowsExceptions)
+{
+  EXPECT_THROW(
+    parallel_for(100, [](const int i){
+      if (i == 50)
+        throw std::runtime_error("error");
+    }),
+    std::runtime_error);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -12,13 +12,15 @@
 
 #include "doc/cel.h"
 #include "doc/layer.h"
+#include "doc/selected_layers.h"
 
 #include <algorithm>
 #include <cmath>
 
 namespace doc {
 
-RenderPlan::RenderPlan()
+RenderPlan::RenderPlan(const SelectedLayers* visibleLayers)
+  : m_visibleLayers(visibleLayers)
 {
 }
 
@@ -31,8 +33,13 @@ void RenderPlan::addLayer(const Layer* layer,
 
   ++m_order;
 
+  // The root group (without parent) is always rendered
+  const bool visible =
+    (m_visibleLayers && layer->parent() ? m_visibleLayers->contains(layer):
+                                          layer->isVisible());
+
   // We can't read this layer
-  if (!layer->isVisible())
+  if (!visible)
     return;
 
   switch (layer->type()) {
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -14,6 +14,7 @@
 
 namespace doc {
   class Layer;
+  class SelectedLayers;
 
   // Creates a list of cels to be rendered in the correct order
   // (depending on layer ordering + z-index) to render the given root
@@ -32,7 +33,11 @@ namespace doc {
     };
     using Items = std::vector<Item>;
 
-    RenderPlan();
+    // If "visibleLayers" is specified, only those layers are
+    // rendered (instead of the visible layers of the sprite), it
+    // must include the parents of each layer (see
+    // SelectedLayers::propagateSelection()).
+    RenderPlan(const SelectedLayers* visibleLayers = nullptr);
 
     const Items& items() const {
       if (m_processZIndex)
@@ -46,6 +51,7 @@ namespace doc {
   private:
     void processZIndexes() const;
 
+    const SelectedLayers* m_visibleLayers;
     int m_order = 0;
     mutable Items m_items;
     mutable bool m_processZIndex = true;
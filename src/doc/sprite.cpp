@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -128,9 +128,9 @@ Sprite* Sprite::MakeStdSprite(const ImageSpec& spec,
   std::unique_ptr<Sprite> sprite(new Sprite(spec, ncolors));
   sprite->setTotalFrames(frame_t(1));
 
-  // Create the main image.
+  // Create the main image (new images are already cleared with
+  // zeros, so we don't touch the pixels of a big transparent image).
   ImageRef image(Image::create(spec, imageBuf));
-  clear_image(image.get(), 0);
 
   // Create the first transparent layer.
   {
@@ -400,16 +400,30 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
 {
   if (!m_rgbMap || m_rgbMapAlgorithm != mapAlgo) {
     m_rgbMapAlgorithm = mapAlgo;
-    switch (m_rgbMapAlgorithm) {
-      case RgbMapAlgorithm::RGB5A3: m_rgbMap.reset(new RgbMapRGB5A3); break;
-      case RgbMapAlgorithm::DEFAULT:
-      case RgbMapAlgorithm::OCTREE: m_rgbMap.reset(new OctreeMap); break;
-      default:
-        m_rgbMap.reset(nullptr);
-        ASSERT(false);
-        return nullptr;
-    }
+    m_rgbMap = createRgbMap(mapAlgo);
+    if (!m_rgbMap)
+      return nullptr;
   }
+  regenerateRgbMap(m_rgbMap.get(), frame, forLayer);
+  return m_rgbMap.get();
+}
+
+// static
+std::unique_ptr<RgbMap> Sprite::createRgbMap(RgbMapAlgorithm mapAlgo)
+{
+  switch (mapAlgo) {
+    case RgbMapAlgorithm::RGB5A3: return std::make_unique<RgbMapRGB5A3>();
+    case RgbMapAlgorithm::DEFAULT:
+    case RgbMapAlgorithm::OCTREE: return std::make_unique<OctreeMap>();
+  }
+  ASSERT(false);
+  return nullptr;
+}
+
+void Sprite::regenerateRgbMap(RgbMap* rgbmap,
+                              const frame_t frame,
+                              const RgbMapFor forLayer) const
+{
   int maskIndex;
   if (forLayer == RgbMapFor::OpaqueLayer)
     maskIndex = -1;
@@ -418,8 +432,7 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
     if (maskIndex == -1)
       maskIndex = 0;
   }
-  m_rgbMap->regenerateMap(palette(frame), maskIndex);
-  return m_rgbMap.get();
+  rgbmap->regenerateMap(palette(frame), maskIndex);
 }
 
 //////////////////////////////////////////////////////////////////////
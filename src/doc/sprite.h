@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -153,6 +153,14 @@ namespace doc {
                    const RgbMapFor forLayer,
                    RgbMapAlgorithm mapAlgo) const;
 
+    // Creates a new RgbMap that is not cached in the sprite (as
+    // rgbMap() does), so it can be used from other threads. It must
+    // be regenerated for each frame with regenerateRgbMap().
+    static std::unique_ptr<RgbMap> createRgbMap(RgbMapAlgorithm mapAlgo);
+    void regenerateRgbMap(RgbMap* rgbmap,
+                          const frame_t frame,
+                          const RgbMapFor forLayer) const;
+
     ////////////////////////////////////////
     // Frames
 
@@ -0,0 +1,274 @@
+// Aseprite Profiler Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "prof/prof.h"
+
+#include "base/fstream_path.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace prof {
+
+namespace {
+
+// Max number of events per thread, when the buffer is full the
+// oldest events are overwritten.
+const size_t kMaxEventsPerThread = 16*1024;
+
+// Max number of buffers of finished threads kept to be reused by new
+// threads (e.g. short-lived worker threads), the rest are freed.
+const size_t kMaxFreeThreadEvents = 8;
+
+// Number of frames to keep for the frame-time graph.
+const size_t kMaxFrames = 256;
+
+struct Event {
+  const char* category;
+  const char* name;
+  int64_t begin;
+  int64_t end;
+};
+
+// Ring buffer of events of one thread. The mutex is only contended
+// when the events are saved or cleared from other thread.
+struct ThreadEvents {
+  std::mutex mutex;
+  std::vector<Event> events;
+  size_t next = 0;
+  bool full = false;
+  bool inUse = true;
+  int tid = 0;
+
+  template<typename Func>
+  void forEach(Func&& func) const {
+    if (full) {
+      for (size_t i=next; i<events.size(); ++i)
+        func(events[i]);
+    }
+    for (size_t i=0; i<next; ++i)
+      func(events[i]);
+  }
+};
+
+struct Frame {
+  int64_t begin;
+  int64_t end;
+  double ms() const { return double(end - begin) / 1000.0; }
+};
+
+std::atomic<bool> enabled(false);
+
+// Buffers of the running threads and the free ones (which keep the
+// events of the finished threads until they are reused).
+std::mutex threads_mutex;
+std::vector<std::unique_ptr<ThreadEvents>> threads;
+int next_tid = 1;
+
+std::mutex frames_mutex;
+std::vector<Frame> frames;
+size_t frames_next = 0;
+
+ThreadEvents* acquire_thread_events()
+{
+  std::lock_guard lock(threads_mutex);
+  for (auto& t : threads) {
+    if (!t->inUse) {
+      t->inUse = true;
+      return t.get();
+    }
+  }
+
+  auto t = std::make_unique<ThreadEvents>();
+  t->events.resize(kMaxEventsPerThread);
+  t->tid = next_tid++;
+  threads.push_back(std::move(t));
+  return threads.back().get();
+}
+
+void release_thread_events(ThreadEvents* t)
+{
+  std::lock_guard lock(threads_mutex);
+  t->inUse = false;
+
+  const size_t freeCount =
+    std::count_if(threads.begin(), threads.end(),
+                  [](const auto& u){ return !u->inUse; });
+  if (freeCount > kMaxFreeThreadEvents) {
+    threads.erase(
+      std::find_if(threads.begin(), threads.end(),
+                   [t](const auto& u){ return u.get() == t; }));
+  }
+}
+
+// Returns the buffer of the current thread to the pool when the
+// thread finishes.
+class ThreadEventsOwner {
+public:
+  ~ThreadEventsOwner() {
+    if (m_events)
+      release_thread_events(m_events);
+  }
+
+  ThreadEvents* get() {
+    if (!m_events)
+      m_events = acquire_thread_events();
+    return m_events;
+  }
+
+private:
+  ThreadEvents* m_events = nullptr;
+};
+
+ThreadEvents* current_thread_events()
+{
+  thread_local ThreadEventsOwner owner;
+  return owner.get();
+}
+
+void write_json_string(std::ostream& s, const char* str)
+{
+  s << '"';
+  for (; *str; ++str) {
+    switch (*str) {
+      case '"': s << "\\\""; break;
+      case '\\': s << "\\\\"; break;
+      default:
+        if (*str >= 0 && *str < 32)
+          s << ' ';
+        else
+          s << *str;
+        break;
+    }
+  }
+  s << '"';
+}
+
+} // anonymous namespace
+
+void set_enabled(const bool state)
+{
+  enabled = state;
+}
+
+bool is_enabled()
+{
+  return enabled.load(std::memory_order_relaxed);
+}
+
+int64_t now()
+{
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+void add_event(const char* category, const char* name,
+               const int64_t begin, const int64_t end)
+{
+  ThreadEvents* t = current_thread_events();
+  std::lock_guard lock(t->mutex);
+  t->events[t->next] = Event{ category, name, begin, end };
+  if (++t->next == t->events.size()) {
+    t->next = 0;
+    t->full = true;
+  }
+}
+
+void frame_mark(const int64_t begin)
+{
+  if (!is_enabled() || begin < 0)
+    return;
+
+  const Frame frame{ begin, now() };
+  std::lock_guard lock(frames_mutex);
+  if (frames.size() < kMaxFrames)
+    frames.push_back(frame);
+  else
+    frames[frames_next] = frame;
+  frames_next = (frames_next+1) % kMaxFrames;
+}
+
+std::vector<double> frame_times()
+{
+  std::lock_guard lock(frames_mutex);
+  std::vector<double> result;
+  result.reserve(frames.size());
+  const size_t first = (frames.size() < kMaxFrames ? 0: frames_next);
+  for (size_t i=0; i<frames.size(); ++i)
+    result.push_back(frames[(first+i) % frames.size()].ms());
+  return result;
+}
+
+void clear()
+{
+  {
+    std::lock_guard lock(threads_mutex);
+    for (auto& t : threads) {
+      std::lock_guard lock2(t->mutex);
+      t->next = 0;
+      t->full = false;
+    }
+  }
+  {
+    std::lock_guard lock(frames_mutex);
+    frames.clear();
+    frames_next = 0;
+  }
+}
+
+bool save_chrome_trace(const std::string& filename)
+{
+  std::ofstream s(FSTREAM_PATH(filename), std::ofstream::binary);
+  if (!s)
+    return false;
+
+  bool first = true;
+  auto separator = [&s, &first]{
+    s << (first ? "\n": ",\n");
+    first = false;
+  };
+
+  s << "{\"traceEvents\":[";
+  {
+    std::lock_guard lock(threads_mutex);
+    for (const auto& t : threads) {
+      std::lock_guard lock2(t->mutex);
+      t->forEach(
+        [&](const Event& ev){
+          separator();
+          s << "{\"name\":";
+          write_json_string(s, ev.name);
+          s << ",\"cat\":";
+          write_json_string(s, ev.category);
+          s << ",\"ph\":\"X\",\"ts\":" << ev.begin
+            << ",\"dur\":" << (ev.end - ev.begin)
+            << ",\"pid\":1,\"tid\":" << t->tid << "}";
+        });
+    }
+  }
+  {
+    std::lock_guard lock(frames_mutex);
+    for (const Frame& frame : frames) {
+      separator();
+      s << "{\"name\":\"frame\",\"cat\":\"ui\",\"ph\":\"X\",\"ts\":"
+        << frame.begin << ",\"dur\":" << (frame.end - frame.begin)
+        << ",\"pid\":1,\"tid\":0}";
+    }
+  }
+  s << "\n]}\n";
+  return s.good();
+}
+
+} // namespace prof
@@ -0,0 +1,79 @@
+// Aseprite Profiler Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PROF_PROF_H_INCLUDED
+#define PROF_PROF_H_INCLUDED
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace prof {
+
+  // Events are recorded only when the profiler is enabled. It's
+  // disabled by default, so a disabled zone costs one atomic load.
+  void set_enabled(const bool state);
+  bool is_enabled();
+
+  // Microseconds since the first call to this function.
+  int64_t now();
+
+  // Adds an event (from "begin" to "end" microseconds) to the ring
+  // buffer of the current thread. Only the pointers to "category" and
+  // "name" are stored, so they must be string literals.
+  void add_event(const char* category, const char* name,
+                 const int64_t begin, const int64_t end);
+
+  // Marks the end of a UI frame (when the screen is flipped). "begin"
+  // is the now() value when the frame work started (or -1 if the
+  // profiler was disabled at that moment).
+  void frame_mark(const int64_t begin);
+
+  // Returns the duration (in milliseconds) of the work of the last
+  // frames, from the oldest one to the newest one.
+  std::vector<double> frame_times();
+
+  // Removes all the recorded events and frames.
+  void clear();
+
+  // Saves all the recorded events in the Chrome trace JSON format,
+  // which can be opened with chrome://tracing or ui.perfetto.dev.
+  bool save_chrome_trace(const std::string& filename);
+
+  // Records the time spent in the scope of this object.
+  class Zone {
+  public:
+    Zone(const char* category, const char* name)
+      : m_category(category)
+      , m_name(name)
+      , m_begin(is_enabled() ? now(): -1) {
+    }
+
+    ~Zone() {
+      if (m_begin >= 0)
+        add_event(m_category, m_name, m_begin, now());
+    }
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+  private:
+    const char* m_category;
+    const char* m_name;
+    int64_t m_begin;
+  };
+
+} // namespace prof
+
+#define PROF_CONCAT2(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT2(a, b)
+
+// Records the rest of the current scope as a "name" event.
+#define PROF_ZONE(category, name)                               \
+  prof::Zone PROF_CONCAT(prof_zone_, __LINE__)(category, name)
+
+#endif
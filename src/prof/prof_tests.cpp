@@ -0,0 +1,108 @@
+// Aseprite Profiler Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "prof/prof.h"
+
+#include "base/fs.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+static std::string read_file(const std::string& fn)
+{
+  std::ifstream s(fn.c_str(), std::ifstream::binary);
+  std::stringstream buf;
+  buf << s.rdbuf();
+  return buf.str();
+}
+
+TEST(Prof, DisabledByDefault)
+{
+  prof::clear();
+  EXPECT_FALSE(prof::is_enabled());
+  {
+    PROF_ZONE("test", "DisabledZone");
+  }
+  prof::frame_mark(prof::now());
+  prof::frame_mark(prof::now());
+  EXPECT_TRUE(prof::frame_times().empty());
+
+  ASSERT_TRUE(prof::save_chrome_trace("_prof_trace.json"));
+  EXPECT_EQ(std::string::npos,
+            read_file("_prof_trace.json").find("DisabledZone"));
+  base::delete_file("_prof_trace.json");
+}
+
+TEST(Prof, ChromeTrace)
+{
+  prof::clear();
+  prof::set_enabled(true);
+  {
+    PROF_ZONE("test", "MainZone");
+  }
+  std::thread([]{
+    PROF_ZONE("test", "Thread\"Zone");
+  }).join();
+  prof::set_enabled(false);
+
+  ASSERT_TRUE(prof::save_chrome_trace("_prof_trace.json"));
+  const std::string json = read_file("_prof_trace.json");
+  EXPECT_EQ(0, json.find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"MainZone\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"Thread\\\"Zone\""));
+  EXPECT_NE(std::string::npos, json.find("\"ph\":\"X\""));
+  base::delete_file("_prof_trace.json");
+}
+
+TEST(Prof, FinishedThreadsReuseBuffers)
+{
+  prof::clear();
+  prof::set_enabled(true);
+  for (int i=0; i<100; ++i) {
+    std::thread([]{
+      PROF_ZONE("test", "PooledZone");
+    }).join();
+  }
+  prof::set_enabled(false);
+
+  // The buffer of each finished thread is reused by the next one, so
+  // the events of all of them are kept.
+  ASSERT_TRUE(prof::save_chrome_trace("_prof_trace.json"));
+  const std::string json = read_file("_prof_trace.json");
+  int count = 0;
+  for (size_t i=json.find("PooledZone"); i!=std::string::npos;
+       i=json.find("PooledZone", i+1))
+    ++count;
+  EXPECT_EQ(100, count);
+  base::delete_file("_prof_trace.json");
+}
+
+TEST(Prof, FrameTimes)
+{
+  prof::clear();
+  prof::set_enabled(true);
+  prof::frame_mark(prof::now());
+  const int64_t begin = prof::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  prof::frame_mark(begin);
+  prof::frame_mark(-1); // Frame started when the profiler was disabled
+  prof::set_enabled(false);
+
+  const std::vector<double> times = prof::frame_times();
+  ASSERT_EQ(2, times.size());
+  EXPECT_LE(0.0, times[0]);
+  EXPECT_LE(5.0, times[1]);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
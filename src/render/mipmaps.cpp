@@ -0,0 +1,180 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/mipmaps.h"
+
+#include "doc/image.h"
+#include "doc/image_impl.h"
+#include "doc/parallel.h"
+#include "doc/primitives_fast.h"
+
+#include <algorithm>
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+// Images with less pixels than this don't use mip levels (it's
+// faster to read the original image directly).
+const int kMinPixels = 1024*1024;
+
+// Max memory used by all cached levels.
+const std::size_t kMaxMemSize = 128*1024*1024;
+
+template<typename ImageTraits>
+void sample_image(const Image* src, Image* dst, const int step)
+{
+  parallel_for(
+    dst->height(),
+    [src, dst, step](const int y){
+      auto src_ptr = get_pixel_address_fast<ImageTraits>(src, 0, y*step);
+      auto dst_ptr = get_pixel_address_fast<ImageTraits>(dst, 0, y);
+      for (int x=0; x<dst->width(); ++x, src_ptr+=step)
+        dst_ptr[x] = *src_ptr;
+    });
+}
+
+std::size_t image_size(const Image* image)
+{
+  return std::size_t(image->getRowStrideSize()) * image->height();
+}
+
+} // anonymous namespace
+
+// static
+Mipmaps* Mipmaps::instance()
+{
+  static Mipmaps mipmaps;
+  return &mipmaps;
+}
+
+Mipmaps::Mipmaps()
+  : m_memSize(0)
+  , m_useCounter(0)
+{
+}
+
+ImageRef Mipmaps::getLevel(const Image* image, const int level)
+{
+  ASSERT(level >= 1);
+
+  const int w = (image->width() >> level);
+  const int h = (image->height() >> level);
+  if (level < 1 ||
+      image->width() * image->height() < kMinPixels ||
+      w < 1 || h < 1)
+    return nullptr;
+
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+    case IMAGE_GRAYSCALE:
+    case IMAGE_INDEXED:
+      break;
+    default:
+      // Bitmaps cannot be sampled in this way (pixels are packed in
+      // bits), and tilemaps are rendered tile by tile.
+      return nullptr;
+  }
+
+  std::lock_guard lock(m_mutex);
+
+  const ObjectId id = image->id();
+  auto it = m_entries.find(id);
+  if (it != m_entries.end() &&
+      it->second.version != image->version()) {
+    discard(it);
+    it = m_entries.end();
+  }
+  if (it == m_entries.end()) {
+    it = m_entries.emplace(id, Entry()).first;
+    it->second.version = image->version();
+  }
+
+  Entry& entry = it->second;
+  entry.lastUse = ++m_useCounter;
+  if (int(entry.levels.size()) < level)
+    entry.levels.resize(level);
+  if (entry.levels[level-1])
+    return entry.levels[level-1];
+
+  // Generate the level from the nearest finer level
+  const Image* src = image;
+  int srcLevel = 0;
+  for (int i=level-1; i>=1; --i) {
+    if (entry.levels[i-1]) {
+      src = entry.levels[i-1].get();
+      srcLevel = i;
+      break;
+    }
+  }
+
+  ImageSpec spec = image->spec();
+  spec.setSize(w, h);
+  ImageRef result(Image::create(spec));
+  const int step = (1 << (level - srcLevel));
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       sample_image<RgbTraits>(src, result.get(), step); break;
+    case IMAGE_GRAYSCALE: sample_image<GrayscaleTraits>(src, result.get(), step); break;
+    case IMAGE_INDEXED:   sample_image<IndexedTraits>(src, result.get(), step); break;
+  }
+
+  // Levels that are too big are not cached (we'd discard all the
+  // other levels to keep it)
+  const std::size_t size = image_size(result.get());
+  if (size <= kMaxMemSize/4) {
+    entry.levels[level-1] = result;
+    entry.size += size;
+    m_memSize += size;
+    trim(id);
+  }
+  return result;
+}
+
+void Mipmaps::clear()
+{
+  std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  m_memSize = 0;
+}
+
+std::size_t Mipmaps::memSize() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_memSize;
+}
+
+void Mipmaps::discard(std::unordered_map<ObjectId, Entry>::iterator it)
+{
+  ASSERT(m_memSize >= it->second.size);
+  m_memSize -= it->second.size;
+  m_entries.erase(it);
+}
+
+// Discards the least recently used entries (except the "keep" one)
+// until we are below the memory limit.
+void Mipmaps::trim(const ObjectId keep)
+{
+  while (m_memSize > kMaxMemSize) {
+    auto lru = m_entries.end();
+    for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+      if (it->first != keep &&
+          (lru == m_entries.end() ||
+           it->second.lastUse < lru->second.lastUse))
+        lru = it;
+    }
+    if (lru == m_entries.end())
+      break;
+    discard(lru);
+  }
+}
+
+} // namespace render
@@ -0,0 +1,74 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_MIPMAPS_H_INCLUDED
+#define RENDER_MIPMAPS_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
+namespace render {
+
+  // Cache of reduced versions (mip levels) of big images, used to
+  // render zoomed out images without reading all the rows/columns
+  // of the original image.
+  //
+  // Each level N is the original image sampled each 2^N pixels (the
+  // top-left pixel of each 2^N x 2^N block), which are the same
+  // pixels that composite_image_scale_down() reads, so rendering a
+  // level with a zoom 2^N times bigger gives the same result.
+  //
+  // Levels are generated lazily from the nearest finer level, and
+  // are discarded when the image version changes.
+  class Mipmaps {
+  public:
+    static Mipmaps* instance();
+
+    Mipmaps();
+
+    // Returns the given level (>= 1) of the image, or nullptr if the
+    // image is too small to use mip levels (or the level is too big
+    // to be cached). The returned level is floor(width/2^level) x
+    // floor(height/2^level) pixels.
+    doc::ImageRef getLevel(const doc::Image* image, const int level);
+
+    void clear();
+
+    // Bytes used by all cached levels.
+    std::size_t memSize() const;
+
+  private:
+    struct Entry {
+      doc::ObjectVersion version;
+      std::vector<doc::ImageRef> levels; // levels[i] = level i+1
+      std::size_t size = 0;
+      uint64_t lastUse = 0;
+    };
+
+    void discard(std::unordered_map<doc::ObjectId, Entry>::iterator it);
+    void trim(const doc::ObjectId keep);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<doc::ObjectId, Entry> m_entries;
+    std::size_t m_memSize;
+    uint64_t m_useCounter;
+  };
+
+} // namespace render
+
+#endif
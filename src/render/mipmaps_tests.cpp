@@ -0,0 +1,79 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "render/mipmaps.h"
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+using namespace render;
+
+static ImageRef create_big_image(const int w, const int h)
+{
+  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(image.get(), x, y, rgba(x & 255, y & 255, (x^y) & 255, 255));
+  return image;
+}
+
+TEST(Mipmaps, SmallImagesAreIgnored)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 64, 64));
+  EXPECT_EQ(nullptr, Mipmaps::instance()->getLevel(image.get(), 1));
+}
+
+TEST(Mipmaps, LevelsSampleTopLeftPixels)
+{
+  Mipmaps::instance()->clear();
+  ImageRef image = create_big_image(1031, 1029);
+
+  for (int level=1; level<=3; ++level) {
+    ImageRef mip = Mipmaps::instance()->getLevel(image.get(), level);
+    ASSERT_NE(nullptr, mip);
+    ASSERT_EQ(1031 >> level, mip->width());
+    ASSERT_EQ(1029 >> level, mip->height());
+
+    const int step = (1 << level);
+    for (int y=0; y<mip->height(); ++y)
+      for (int x=0; x<mip->width(); ++x)
+        ASSERT_EQ(get_pixel(image.get(), x*step, y*step),
+                  get_pixel(mip.get(), x, y));
+  }
+  EXPECT_LT(0, Mipmaps::instance()->memSize());
+}
+
+TEST(Mipmaps, NewVersionDiscardsLevels)
+{
+  Mipmaps::instance()->clear();
+  ImageRef image = create_big_image(1024, 1024);
+
+  ImageRef mip = Mipmaps::instance()->getLevel(image.get(), 1);
+  ASSERT_NE(nullptr, mip);
+  EXPECT_EQ(mip, Mipmaps::instance()->getLevel(image.get(), 1));
+
+  put_pixel(image.get(), 0, 0, rgba(1, 2, 3, 4));
+  image->incrementVersion();
+
+  ImageRef mip2 = Mipmaps::instance()->getLevel(image.get(), 1);
+  ASSERT_NE(nullptr, mip2);
+  EXPECT_NE(mip, mip2);
+  EXPECT_EQ(rgba(1, 2, 3, 4), get_pixel(mip2.get(), 0, 0));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
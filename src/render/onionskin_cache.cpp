@@ -0,0 +1,151 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/onionskin_cache.h"
+
+#include "doc/image.h"
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+// Max memory used by all cached ghosts (a ghost of a 2048x2048
+// sprite uses 16 MB, so we can keep around 16 ghosts of that size).
+const std::size_t kMaxMemSize = 256*1024*1024;
+
+std::size_t ghost_size(const int width, const int height)
+{
+  return std::size_t(width) * std::size_t(height) * 4;
+}
+
+} // anonymous namespace
+
+// static
+OnionskinCache* OnionskinCache::instance()
+{
+  static OnionskinCache cache;
+  return &cache;
+}
+
+OnionskinCache::OnionskinCache()
+  : m_memSize(0)
+  , m_useCounter(0)
+{
+}
+
+ImageRef OnionskinCache::get(const ObjectId spriteId,
+                             const frame_t frame,
+                             const gfx::Size& size,
+                             const Key& key)
+{
+  std::lock_guard lock(m_mutex);
+  auto it = m_entries.find(Slot(spriteId, frame, size.w, size.h));
+  if (it == m_entries.end())
+    return nullptr;
+
+  if (it->second.key != key) {
+    // The frame was modified (or it's rendered with other options)
+    discard(it);
+    return nullptr;
+  }
+
+  it->second.lastUse = ++m_useCounter;
+  return it->second.ghost;
+}
+
+bool OnionskinCache::set(const ObjectId spriteId,
+                         const frame_t frame,
+                         const Key& key,
+                         const ImageRef& ghost)
+{
+  ASSERT(ghost);
+  ASSERT(ghost->pixelFormat() == IMAGE_RGB);
+
+  if (!canCache(ghost->width(), ghost->height()))
+    return false;
+
+  std::lock_guard lock(m_mutex);
+  const Slot slot(spriteId, frame, ghost->width(), ghost->height());
+  auto it = m_entries.find(slot);
+  if (it != m_entries.end())
+    discard(it);
+
+  Entry& entry = m_entries[slot];
+  entry.key = key;
+  entry.ghost = ghost;
+  entry.size = ghost_size(ghost->width(), ghost->height());
+  entry.lastUse = ++m_useCounter;
+  m_memSize += entry.size;
+  trim(slot);
+  return true;
+}
+
+void OnionskinCache::remove(const ObjectId spriteId)
+{
+  std::lock_guard lock(m_mutex);
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    auto next = it;
+    ++next;
+    if (std::get<0>(it->first) == spriteId)
+      discard(it);
+    it = next;
+  }
+}
+
+void OnionskinCache::clear()
+{
+  std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  m_memSize = 0;
+}
+
+std::size_t OnionskinCache::memSize() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_memSize;
+}
+
+// static
+bool OnionskinCache::canCache(const int width, const int height)
+{
+  // Ghosts that are too big are not cached (we'd discard all the
+  // other ghosts to keep it)
+  return (width > 0 && height > 0 &&
+          ghost_size(width, height) <= kMaxMemSize/4);
+}
+
+void OnionskinCache::discard(std::map<Slot, Entry>::iterator it)
+{
+  ASSERT(m_memSize >= it->second.size);
+  m_memSize -= it->second.size;
+  m_entries.erase(it);
+}
+
+// Discards the least recently used ghosts (except the "keep" one)
+// until we are below the memory limit.
+void OnionskinCache::trim(const Slot& keep)
+{
+  while (m_memSize > kMaxMemSize) {
+    auto lru = m_entries.end();
+    for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+      if (it->first != keep &&
+          (lru == m_entries.end() ||
+           it->second.lastUse < lru->second.lastUse))
+        lru = it;
+    }
+    if (lru == m_entries.end())
+      break;
+    discard(lru);
+  }
+}
+
+} // namespace render
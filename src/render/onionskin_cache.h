@@ -0,0 +1,96 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#define RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "gfx/size.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace render {
+
+  // Cache of composited onionskin frames ("ghosts"). A ghost is a
+  // frame of the sprite rendered in a transparent RGB image, so it
+  // can be reused in each repaint (or scroll) of the editor, and
+  // composited with the onionskin opacity/position of that frame.
+  //
+  // Each ghost is stored with a key that identifies its content
+  // (ids/versions of the rendered layers/cels/images, and the
+  // render options), so a ghost is rendered again only when the
+  // key of its frame changes.
+  //
+  // There is only one cache (shared by all render::Render instances)
+  // so the memory used by all ghosts is bounded. Ghosts of each
+  // sprite frame are stored by size, so editors with different zoom
+  // levels don't replace the ghosts of each other.
+  class OnionskinCache {
+  public:
+    using Key = std::vector<uint64_t>;
+
+    static OnionskinCache* instance();
+
+    OnionskinCache();
+
+    // Returns the ghost of the given sprite frame and size if it was
+    // cached with the same key, or nullptr.
+    doc::ImageRef get(const doc::ObjectId spriteId,
+                      const doc::frame_t frame,
+                      const gfx::Size& size,
+                      const Key& key);
+
+    // Caches the ghost of the given sprite frame (replacing the
+    // previous one of the same frame and size). Returns false if the
+    // ghost is too big to be cached.
+    bool set(const doc::ObjectId spriteId,
+             const doc::frame_t frame,
+             const Key& key,
+             const doc::ImageRef& ghost);
+
+    // Removes all the ghosts of the given sprite (e.g. when the
+    // sprite is destroyed).
+    void remove(const doc::ObjectId spriteId);
+
+    void clear();
+
+    // Bytes used by all cached ghosts.
+    std::size_t memSize() const;
+
+    // Returns true if a ghost of the given size can be cached.
+    static bool canCache(const int width, const int height);
+
+  private:
+    // Sprite, frame, ghost width, and ghost height
+    using Slot = std::tuple<doc::ObjectId, doc::frame_t, int, int>;
+
+    struct Entry {
+      Key key;
+      doc::ImageRef ghost;
+      std::size_t size = 0;
+      uint64_t lastUse = 0;
+    };
+
+    void discard(std::map<Slot, Entry>::iterator it);
+    void trim(const Slot& keep);
+
+    mutable std::mutex m_mutex;
+    std::map<Slot, Entry> m_entries;
+    std::size_t m_memSize;
+    uint64_t m_useCounter;
+  };
+
+} // namespace render
+
+#endif
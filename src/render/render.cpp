@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -18,12 +18,18 @@
 #include "doc/layer_tilemap.h"
 #include "doc/playback.h"
 #include "doc/render_plan.h"
+#include "doc/selected_layers.h"
 #include "doc/tileset.h"
 #include "doc/tilesets.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
+#include "prof/prof.h"
+#include "render/mipmaps.h"
 
+#include <algorithm>
 #include <cmath>
+#include <iterator>
+#include <vector>
 
 #define TRACE_RENDER_CEL(...) // TRACE
 
@@ -203,6 +209,56 @@ void composite_image_without_scale(
   }
 }
 
+// Expands each pixel of "src" to N pixels in "dst". N is known at
+// compile time for the most common zoom levels, so the compiler can
+// unroll and vectorize the inner loop.
+template<int N, typename Pixel>
+inline Pixel* expand_pixels(const Pixel* src, const int n, Pixel* dst)
+{
+  for (int i=0; i<n; ++i, dst+=N)
+    for (int j=0; j<N; ++j)
+      dst[j] = src[i];
+  return dst;
+}
+
+template<typename Pixel>
+inline Pixel* expand_pixels(const Pixel* src, const int n, const int px_w, Pixel* dst)
+{
+  switch (px_w) {
+    case 2:  return expand_pixels<2>(src, n, dst);
+    case 3:  return expand_pixels<3>(src, n, dst);
+    case 4:  return expand_pixels<4>(src, n, dst);
+    case 6:  return expand_pixels<6>(src, n, dst);
+    case 8:  return expand_pixels<8>(src, n, dst);
+    case 16: return expand_pixels<16>(src, n, dst);
+    default:
+      for (int i=0; i<n; ++i)
+        dst = std::fill_n(dst, px_w, src[i]);
+      return dst;
+  }
+}
+
+// Draws the "scanline" pixels in "dst" scaled "px_w" times (where
+// the first pixel is "first_px_w" pixels width as it can be partially
+// visible).
+template<typename Pixel>
+void expand_scanline(const Pixel* scanline, const int scanline_w,
+                     const int first_px_w, const int px_w,
+                     Pixel* dst, const int dst_w)
+{
+  Pixel* const dst_end = dst + dst_w;
+
+  dst = std::fill_n(dst, std::min(first_px_w, dst_w), scanline[0]);
+
+  // Pixels that are completely visible
+  const int n = std::min(scanline_w-1, int(dst_end - dst) / px_w);
+  dst = expand_pixels(scanline+1, n, px_w, dst);
+
+  // Last pixel (partially visible)
+  if (dst < dst_end && n+1 < scanline_w)
+    std::fill(dst, dst_end, scanline[n+1]);
+}
+
 template<class DstTraits, class SrcTraits>
 void composite_image_scale_up(
   Image* dst, const Image* src, const Palette* pal,
@@ -225,7 +281,6 @@ void composite_image_scale_up(
     return;
 
   BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blendMode, newBlend);
-  int px_x, px_y;
   int px_w = int(sx);
   int px_h = int(sy);
 
@@ -253,106 +308,38 @@ void composite_image_scale_up(
   if (srcBounds.isEmpty())
     return;
 
-  gfx::Rect dstBounds = area.dstBounds();
-  int bottom = dstBounds.y2()-1;
-  int line_h;
-
-  // the scanline variable is used to blend src/dst pixels one time for each pixel
-  typedef std::vector<typename DstTraits::pixel_t> Scanline;
-  Scanline scanline(srcBounds.w);
-  typename Scanline::iterator scanline_it;
-#ifdef _DEBUG
-  typename Scanline::iterator scanline_end = scanline.end();
-#endif
+  const gfx::Rect dstBounds = area.dstBounds();
+  const int dst_w = dstBounds.w;
+  const int dst_y2 = dstBounds.y2();
 
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-#ifdef _DEBUG
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-#endif
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+  // The scanline is used to blend src/dst pixels one time for each
+  // source pixel, then it's expanded in the first line of "dst" and
+  // that line is copied to the other "px_h-1" lines.
+  std::vector<typename DstTraits::pixel_t> scanline(srcBounds.w);
 
-  // For each line to draw of the source image...
-  dstBounds.h = 1;
-  for (int y=0; y<srcBounds.h; ++y) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
+  int dst_y = dstBounds.y;
+  for (int y=0; y<srcBounds.h && dst_y<dst_y2; ++y) {
+    auto src_ptr = get_pixel_address_fast<SrcTraits>(src, srcBounds.x, srcBounds.y+y);
+    auto dst_ptr = get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dst_y);
 
-    // Read 'src' and 'dst' and blend them, put the result in `scanline'
-    scanline_it = scanline.begin();
-    for (int x=0; x<srcBounds.w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
-      ASSERT(scanline_it >= scanline.begin() && scanline_it < scanline_end);
-
-      *scanline_it = blender(*dst_it, *src_it, opacity);
-      ++src_it;
-
-      int delta;
-      if (x == 0)
-        delta = first_px_w;
-      else
-        delta = px_w;
-
-      while (dst_it != dst_end && delta-- > 0)
-        ++dst_it;
-
-      ++scanline_it;
+    // Blend each source pixel with the first "dst" pixel that it covers
+    for (int x=0, dst_x=0; x<srcBounds.w; ++x) {
+      scanline[x] = blender(dst_ptr[std::min(dst_x, dst_w-1)], src_ptr[x], opacity);
+      dst_x += (x == 0 ? first_px_w: px_w);
     }
 
-    // Get the 'height' of the line to be painted in 'dst'
-    if ((y == 0) && (first_px_h > 0))
-      line_h = first_px_h;
-    else
-      line_h = px_h;
-
-    // Draw the line in 'dst'
-    for (px_y=0; px_y<line_h; ++px_y) {
-      dst_it = dstBits.begin_area(dstBounds);
-      dst_end = dstBits.end_area(dstBounds);
-      scanline_it = scanline.begin();
-
-      int x = 0;
-
-      // first pixel
-      for (px_x=0; px_x<first_px_w; ++px_x) {
-        ASSERT(scanline_it != scanline_end);
-        ASSERT(dst_it != dst_end);
-
-        *dst_it = *scanline_it;
-
-        ++dst_it;
-        if (dst_it == dst_end)
-          goto done_with_line;
-      }
-
-      ++scanline_it;
-      ++x;
+    expand_scanline(scanline.data(), srcBounds.w,
+                    first_px_w, px_w, dst_ptr, dst_w);
 
-      // the rest of the line
-      for (; x<srcBounds.w; ++x) {
-        for (px_x=0; px_x<px_w; ++px_x) {
-          ASSERT(dst_it !=  dst_end);
-
-          *dst_it = *scanline_it;
-
-          ++dst_it;
-          if (dst_it == dst_end)
-            goto done_with_line;
-        }
-
-        ++scanline_it;
-      }
-
-done_with_line:;
-      if (++dstBounds.y > bottom)
-        goto done_with_blit;
+    // Get the 'height' of the line to be painted in 'dst'
+    const int line_h = std::min(y == 0 ? first_px_h: px_h,
+                                dst_y2 - dst_y);
+    for (int i=1; i<line_h; ++i) {
+      std::copy(dst_ptr, dst_ptr+dst_w,
+                get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dst_y+i));
     }
+    dst_y += line_h;
   }
-
-done_with_blit:;
 }
 
 template<class DstTraits, class SrcTraits>
@@ -390,36 +377,18 @@ void composite_image_scale_down(
   if (srcBounds.isEmpty())
     return;
 
-  gfx::Rect dstBounds = area.dstBounds();
-
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  auto src_it = srcBits.begin();
-  auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-  auto src_end = srcBits.end();
-  auto dst_end = dstBits.end();
-#endif
-
-  // Adjust to src_it for each line
-  int adjust_per_line = (dstBounds.w*step_w)*(step_h-1);
+  const gfx::Rect dstBounds = area.dstBounds();
 
   // For each line to draw of the source image...
   for (int y=0; y<dstBounds.h; ++y) {
-    for (int x=0; x<dstBounds.w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
+    auto src_ptr = get_pixel_address_fast<SrcTraits>(src, srcBounds.x, srcBounds.y+y*step_h);
+    auto dst_ptr = get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstBounds.y+y);
 
-      *dst_it = blender(*dst_it, *src_it, opacity);
-
-      // Skip columns
-      src_it += step_w;
-      ++dst_it;
+    // Skip columns
+    for (int x=0; x<dstBounds.w; ++x, src_ptr+=step_w, ++dst_ptr) {
+      ASSERT(srcBounds.x+x*step_w < src->width());
+      *dst_ptr = blender(*dst_ptr, *src_ptr, opacity);
     }
-
-    // Skip rows
-    src_it += adjust_per_line;
   }
 }
 
@@ -520,17 +489,39 @@ CompositeImageFunc get_fastest_composition_path(const Projection& proj,
   }
 }
 
-bool has_visible_reference_layers(const LayerGroup* group)
+// Returns true if "func" is one of the composite_image_scale_down()
+// functions, which read 1 pixel of each step_w x step_h block of the
+// source image (so they can read the same pixels from a mip level).
+bool is_scale_down_composition(const CompositeImageFunc func)
+{
+  static const CompositeImageFunc funcs[] = {
+    composite_image_scale_down<RgbTraits, RgbTraits>,
+    composite_image_scale_down<GrayscaleTraits, RgbTraits>,
+    composite_image_scale_down<IndexedTraits, RgbTraits>,
+    composite_image_scale_down<RgbTraits, GrayscaleTraits>,
+    composite_image_scale_down<GrayscaleTraits, GrayscaleTraits>,
+    composite_image_scale_down<IndexedTraits, GrayscaleTraits>,
+    composite_image_scale_down<RgbTraits, IndexedTraits>,
+    composite_image_scale_down<GrayscaleTraits, IndexedTraits>,
+    composite_image_scale_down<IndexedTraits, IndexedTraits>,
+  };
+  return (std::find(std::begin(funcs), std::end(funcs), func) != std::end(funcs));
+}
+
+bool has_visible_reference_layers(const LayerGroup* group,
+                                  const SelectedLayers* visibleLayers)
 {
   for (const Layer* child : group->layers()) {
-    if (!child->isVisible())
+    if (visibleLayers ? !visibleLayers->contains(child):
+                        !child->isVisible())
       continue;
 
     if (child->isReference())
       return true;
 
     if (child->isGroup() &&
-        has_visible_reference_layers(static_cast<const LayerGroup*>(child)))
+        has_visible_reference_layers(static_cast<const LayerGroup*>(child),
+                                     visibleLayers))
       return true;
   }
   return false;
@@ -552,6 +543,7 @@ Render::Render()
   , m_selectedLayerForOpacity(nullptr)
   , m_selectedLayer(nullptr)
   , m_selectedFrame(-1)
+  , m_visibleLayers(nullptr)
   , m_previewImage(nullptr)
   , m_previewTileset(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
@@ -577,6 +569,14 @@ void Render::setNewBlend(const bool newBlend)
   m_newBlendMethod = newBlend;
 }
 
+void Render::setMipmaps(const bool state)
+{
+  if (state)
+    m_flags |= Flags::UseMipmaps;
+  else
+    m_flags &= ~Flags::UseMipmaps;
+}
+
 void Render::setProjection(const Projection& projection)
 {
   m_proj = projection;
@@ -592,6 +592,11 @@ void Render::setSelectedLayer(const Layer* layer)
   m_selectedLayerForOpacity = layer;
 }
 
+void Render::setVisibleLayers(const SelectedLayers* layers)
+{
+  m_visibleLayers = layers;
+}
+
 void Render::setPreviewImage(const Layer* layer,
                              const frame_t frame,
                              const Image* image,
@@ -669,6 +674,8 @@ void Render::renderLayer(
   const gfx::Clip& area,
   BlendMode blendMode)
 {
+  PROF_ZONE("render", "Render::renderLayer");
+
   m_sprite = layer->sprite();
 
   CompositeImageFunc compositeImage =
@@ -681,7 +688,7 @@ void Render::renderLayer(
 
   m_globalOpacity = 255;
 
-  doc::RenderPlan plan;
+  doc::RenderPlan plan(m_visibleLayers);
   plan.addLayer(layer, frame);
   renderPlan(
     plan, dstImage, area,
@@ -695,6 +702,8 @@ void Render::renderSprite(
   frame_t frame,
   const gfx::ClipF& area)
 {
+  PROF_ZONE("render", "Render::renderSprite");
+
   m_sprite = sprite;
 
   CompositeImageFunc compositeImage =
@@ -710,7 +719,7 @@ void Render::renderSprite(
     switch (dstImage->pixelFormat()) {
       case IMAGE_RGB:
       case IMAGE_GRAYSCALE:
-        if (bgLayer && bgLayer->isVisible())
+        if (bgLayer && isLayerVisible(bgLayer))
           bg_color = m_sprite->palette(frame)->getEntry(m_sprite->transparentColor());
         break;
       case IMAGE_INDEXED:
@@ -780,7 +789,7 @@ void Render::renderSpriteLayers(Image* dstImage,
                                 frame_t frame,
                                 CompositeImageFunc compositeImage)
 {
-  doc::RenderPlan plan;
+  doc::RenderPlan plan(m_visibleLayers);
   plan.addLayer(m_sprite->root(), frame);
 
   // Draw the background layer.
@@ -816,7 +825,7 @@ void Render::renderBackground(Image* image,
     switch (m_bg.type) {
       case BgType::CHECKERED:
         renderCheckeredBackground(image, area);
-        if (bgLayer && bgLayer->isVisible() &&
+        if (bgLayer && isLayerVisible(bgLayer) &&
             // TODO Review this: bg_color can be an index (not an rgba())
             //      when sprite and dstImage are indexed
             rgba_geta(bg_color) > 0) {
@@ -842,7 +851,7 @@ bool Render::isSolidBackground(
 {
   return
     ((m_bg.type != BgType::CHECKERED) ||
-     (bgLayer && bgLayer->isVisible() &&
+     (bgLayer && isLayerVisible(bgLayer) &&
       // TODO Review this: bg_color can be an index (not an rgba())
       //      when sprite and dstImage are indexed
       rgba_geta(bg_color) == 255));
@@ -896,21 +905,213 @@ void Render::renderOnionskin(
         else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
           blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
 
-        doc::RenderPlan plan;
-        plan.addLayer(onionLayer, frameIn);
-        renderPlan(
-          plan, dstImage,
-          area, frameIn, compositeImage,
-          // Render background only for "in-front" onion skinning and
-          // when opacity is < 255
+        // Render background only for "in-front" onion skinning and
+        // when opacity is < 255
+        const bool render_background =
           (m_globalOpacity < 255 &&
-           m_onionskin.position() == OnionskinPosition::INFRONT),
-          true, blendMode);
+           m_onionskin.position() == OnionskinPosition::INFRONT);
+
+        if (dstImage->pixelFormat() == IMAGE_RGB) {
+          renderOnionskinGhost(
+            dstImage, area, onionLayer, frameIn,
+            blendMode, render_background);
+        }
+        else {
+          doc::RenderPlan plan(m_visibleLayers);
+          plan.addLayer(onionLayer, frameIn);
+          renderPlan(
+            plan, dstImage,
+            area, frameIn, compositeImage,
+            render_background,
+            true, blendMode);
+        }
       }
     }
   }
 }
 
+// Renders the given frame in a transparent image (the "ghost") and
+// composites it in dstImage with the m_globalOpacity. Ghosts are
+// cached (when we can trust image versions), so in each repaint we
+// only render the frames that were modified.
+void Render::renderOnionskinGhost(
+  Image* dstImage,
+  const gfx::Clip& area,
+  const Layer* onionLayer,
+  const frame_t frame,
+  const BlendMode blendMode,
+  const bool render_background)
+{
+  const int opacity = m_globalOpacity;
+  const Projection proj = m_proj;
+
+  // When we zoom in, the ghost is rendered with the sprite size and
+  // scaled when it's composited. When we zoom out, the ghost is
+  // rendered with the current projection (so we don't need a full
+  // resolution ghost of a big sprite).
+  const bool zoomIn = (proj.scaleX() >= 1.0 && proj.scaleY() >= 1.0);
+  const Projection ghostProj = (zoomIn ? Projection(): proj);
+  const gfx::Rect ghostBounds(0, 0,
+                              ghostProj.applyX(m_sprite->width()),
+                              ghostProj.applyY(m_sprite->height()));
+
+  doc::RenderPlan plan(m_visibleLayers);
+  plan.addLayer(onionLayer, frame);
+
+  OnionskinCache::Key key;
+  const bool useCache =
+    ((m_flags & Flags::UseMipmaps) &&
+     OnionskinCache::canCache(ghostBounds.w, ghostBounds.h) &&
+     getOnionskinGhostKey(plan, onionLayer, frame, blendMode,
+                          render_background, ghostProj, key));
+
+  // Area of the ghost that we need: the whole ghost when it's cached,
+  // or just the area that we are going to paint in other case.
+  gfx::Rect ghostArea = ghostBounds;
+  if (!useCache) {
+    if (zoomIn) {
+      const gfx::Rect rc = area.srcBounds();
+      const int x = proj.removeX(rc.x);
+      const int y = proj.removeY(rc.y);
+      ghostArea &= gfx::Rect(x, y,
+                             proj.removeXCeiling(rc.x2()) - x,
+                             proj.removeYCeiling(rc.y2()) - y);
+    }
+    else
+      ghostArea &= area.srcBounds();
+    if (ghostArea.isEmpty())
+      return;
+  }
+
+  ImageRef ghost;
+  if (useCache)
+    ghost = OnionskinCache::instance()->get(m_sprite->id(), frame,
+                                            ghostArea.size(), key);
+
+  if (!ghost) {
+    // New images are transparent (cleared with zeros)
+    ghost.reset(Image::create(IMAGE_RGB, ghostArea.w, ghostArea.h));
+
+    m_proj = ghostProj;
+    m_globalOpacity = 255;
+
+    CompositeImageFunc ghostComposite =
+      getImageComposition(IMAGE_RGB, m_sprite->pixelFormat(),
+                          m_sprite->root());
+    if (ghostComposite) {
+      renderPlan(
+        plan, ghost.get(),
+        gfx::Clip(0, 0, ghostArea),
+        frame, ghostComposite,
+        render_background, true, blendMode);
+    }
+
+    m_proj = proj;
+    m_globalOpacity = opacity;
+
+    if (useCache)
+      OnionskinCache::instance()->set(m_sprite->id(), frame, key, ghost);
+  }
+
+  // Composite the ghost in the destination image. A ghost rendered
+  // with the current projection is composited 1:1.
+  if (!zoomIn)
+    m_proj = Projection();
+
+  CompositeImageFunc compositeGhost =
+    getImageComposition(IMAGE_RGB, IMAGE_RGB, nullptr);
+  if (compositeGhost) {
+    renderImage(
+      dstImage, ghost.get(), m_sprite->palette(frame),
+      gfx::RectF(ghostArea), area, compositeGhost,
+      opacity, BlendMode::NORMAL);
+  }
+
+  m_proj = proj;
+}
+
+// Fills the "key" with all the values that can change the rendered
+// ghost of the given frame. Returns false if the ghost cannot be
+// cached (e.g. it depends on the preview/extra images that are
+// modified without new versions, or it contains tilemaps).
+bool Render::getOnionskinGhostKey(
+  const doc::RenderPlan& plan,
+  const Layer* onionLayer,
+  const frame_t frame,
+  const BlendMode blendMode,
+  const bool render_background,
+  const Projection& ghostProj,
+  OnionskinCache::Key& key) const
+{
+  auto scaleBits = [](const double scale) -> uint64_t {
+    return uint64_t(std::llround(scale * 65536.0));
+  };
+
+  key.clear();
+  key.push_back(onionLayer->id());
+  key.push_back(uint64_t(blendMode));
+  key.push_back(render_background ? 1: 0);
+  key.push_back(scaleBits(ghostProj.scaleX()));
+  key.push_back(scaleBits(ghostProj.scaleY()));
+  key.push_back(m_flags & Flags::ShowRefLayers);
+  key.push_back(m_newBlendMethod ? 1: 0);
+  key.push_back(m_nonactiveLayersOpacity);
+  key.push_back(m_nonactiveLayersOpacity != 255 &&
+                m_selectedLayerForOpacity ?
+                m_selectedLayerForOpacity->id(): 0);
+  key.push_back(m_sprite->width());
+  key.push_back(m_sprite->height());
+  key.push_back(m_sprite->pixelFormat());
+  key.push_back(m_sprite->transparentColor());
+  if (m_sprite->pixelFormat() == IMAGE_INDEXED) {
+    const Palette* pal = m_sprite->palette(frame);
+    key.push_back(pal->id());
+    key.push_back(pal->version());
+  }
+
+  for (const auto& item : plan.items()) {
+    const Layer* layer = item.layer;
+    const Cel* cel = item.cel;
+
+    if (layer->isTilemap())
+      return false;
+
+    // The current layer can be modified with a preview image or an
+    // extra cel
+    if (cel &&
+        ((m_previewImage && checkIfWeShouldUsePreview(cel)) ||
+         (m_extraCel && layer == m_currentLayer)))
+      return false;
+
+    const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
+    key.push_back(layer->id());
+    key.push_back(layer->version());
+    key.push_back(uint64_t(imgLayer->blendMode()));
+    key.push_back(imgLayer->opacity());
+    key.push_back((layer->isBackground() ? 1: 0) |
+                  (layer->isReference() ? 2: 0));
+
+    if (cel && cel->image()) {
+      const Image* image = cel->image();
+      const gfx::RectF bounds =
+        (layer->isReference() ? cel->boundsF():
+                                gfx::RectF(cel->bounds()));
+      key.push_back(cel->id());
+      key.push_back(cel->opacity());
+      key.push_back(cel->zIndex());
+      key.push_back(scaleBits(bounds.x));
+      key.push_back(scaleBits(bounds.y));
+      key.push_back(scaleBits(bounds.w));
+      key.push_back(scaleBits(bounds.h));
+      key.push_back(image->id());
+      key.push_back(image->version());
+    }
+    else
+      key.push_back(0);
+  }
+  return true;
+}
+
 void Render::renderCheckeredBackground(
   Image* image,
   const gfx::Clip& area)
@@ -1008,7 +1209,7 @@ void Render::renderPlan(
     const Cel* cel = item.cel;
     const Layer* layer = item.layer;
 
-    ASSERT(layer->isVisible()); // Hidden layers shouldn't be in the plan
+    ASSERT(isLayerVisible(layer)); // Hidden layers shouldn't be in the plan
 
     const bool isSelected = (m_selectedLayerForOpacity == layer);
     gfx::Rect extraArea;
@@ -1324,6 +1525,33 @@ void Render::renderImage(
   if (srcBounds.isEmpty())
     return;
 
+  double sx = m_proj.scaleX() * celBounds.w / double(cel_image->width());
+  double sy = m_proj.scaleY() * celBounds.h / double(cel_image->height());
+
+  // Use a mip level when we are going to read only 1 pixel of each
+  // 2^level x 2^level block of the cel image.
+  ImageRef mipmap;
+  if ((m_flags & Flags::UseMipmaps) &&
+      cel_image != m_previewImage &&
+      cel_image != m_extraImage &&
+      sx < 1.0 && sy < 1.0 &&
+      is_scale_down_composition(compositeImage)) {
+    const int step_w = int(1.0 / sx);
+    const int step_h = int(1.0 / sy);
+    if (step_w * sx == 1.0 && step_h * sy == 1.0) {
+      int level = 0;
+      while (((step_w | step_h) & ((2 << level) - 1)) == 0)
+        ++level;
+      if (level > 0)
+        mipmap = Mipmaps::instance()->getLevel(cel_image, level);
+      if (mipmap) {
+        cel_image = mipmap.get();
+        sx *= (1 << level);
+        sy *= (1 << level);
+      }
+    }
+  }
+
   compositeImage(
     dst_image, cel_image, pal,
     gfx::ClipF(
@@ -1335,8 +1563,7 @@ void Render::renderImage(
       srcBounds.h),
     opacity,
     blendMode,
-    m_proj.scaleX() * celBounds.w / double(cel_image->width()),
-    m_proj.scaleY() * celBounds.h / double(cel_image->height()),
+    sx, sy,
     m_newBlendMethod);
 }
 
@@ -1356,7 +1583,8 @@ CompositeImageFunc Render::getImageComposition(
                     std::modf(double(m_bg.stripeSize.h) / m_proj.applyY(1.0), &intpart) != 0.0)) ||
     (layer &&
      layer->isGroup() &&
-     has_visible_reference_layers(static_cast<const LayerGroup*>(layer)));
+     has_visible_reference_layers(static_cast<const LayerGroup*>(layer),
+                                  m_visibleLayers));
 
   switch (srcFormat) {
 
@@ -1414,6 +1642,14 @@ bool Render::checkIfWeShouldUsePreview(const Cel* cel) const
   return false;
 }
 
+bool Render::isLayerVisible(const Layer* layer) const
+{
+  if (m_visibleLayers && layer->parent())
+    return m_visibleLayers->contains(layer);
+  else
+    return layer->isVisible();
+}
+
 void composite_image(Image* dst,
                      const Image* src,
                      const Palette* pal,
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -20,6 +20,7 @@
 #include "gfx/size.h"
 #include "render/bg_options.h"
 #include "render/extra_type.h"
+#include "render/onionskin_cache.h"
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
@@ -29,6 +30,7 @@ namespace doc {
   class Layer;
   class Palette;
   class RenderPlan;
+  class SelectedLayers;
   class Sprite;
   class Tileset;
 }
@@ -50,6 +52,7 @@ namespace render {
   class Render {
     enum Flags {
       ShowRefLayers = 1,
+      UseMipmaps = 2,
     };
 
   public:
@@ -58,10 +61,25 @@ namespace render {
     void setRefLayersVisiblity(const bool visible);
     void setNonactiveLayersOpacity(const int opacity);
     void setNewBlend(const bool newBlend);
+
+    // Uses cached mip levels (see render::Mipmaps) to render cels
+    // when the projection scale is 1/2^N (or a multiple of it), and
+    // cached onionskin frames (see render::OnionskinCache). This
+    // must be disabled when images can be modified without changing
+    // their version (e.g. when we're drawing with a tool).
+    void setMipmaps(const bool state);
+
     void setProjection(const Projection& projection);
     void setBgOptions(const BgOptions& bg);
     void setSelectedLayer(const Layer* layer);
 
+    // Renders only the given layers, as if they were the only
+    // visible layers of the sprite (without modifying the layers,
+    // so the sprite can be rendered from a background thread). The
+    // set must include the parents of each layer (see
+    // SelectedLayers::propagateSelection()).
+    void setVisibleLayers(const SelectedLayers* layers);
+
     // Sets the preview image. This preview image is an alternative
     // image to be used for the given layer/frame.
     void setPreviewImage(const Layer* layer,
@@ -159,6 +177,23 @@ namespace render {
       const frame_t frame,
       const CompositeImageFunc compositeImage);
 
+    void renderOnionskinGhost(
+      Image* dstImage,
+      const gfx::Clip& area,
+      const Layer* onionLayer,
+      const frame_t frame,
+      const BlendMode blendMode,
+      const bool render_background);
+
+    bool getOnionskinGhostKey(
+      const doc::RenderPlan& plan,
+      const Layer* onionLayer,
+      const frame_t frame,
+      const BlendMode blendMode,
+      const bool render_background,
+      const Projection& ghostProj,
+      OnionskinCache::Key& key) const;
+
     void renderPlan(
       doc::RenderPlan& plan,
       Image* image,
@@ -197,6 +232,7 @@ namespace render {
       const Layer* layer);
 
     bool checkIfWeShouldUsePreview(const Cel* cel) const;
+    bool isLayerVisible(const Layer* layer) const;
 
     int m_flags;
     int m_nonactiveLayersOpacity;
@@ -214,6 +250,7 @@ namespace render {
     const Layer* m_selectedLayerForOpacity;
     const Layer* m_selectedLayer;
     frame_t m_selectedFrame;
+    const SelectedLayers* m_visibleLayers;
     const Image* m_previewImage;
     const Tileset* m_previewTileset;
     gfx::Point m_previewPos;
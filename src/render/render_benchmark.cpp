@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -17,6 +17,8 @@
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 
+#include <memory>
+
 #include <benchmark/benchmark.h>
 
 using namespace doc;
@@ -79,4 +81,69 @@ BENCHMARK(Bm_Render)
   ->Args({ 4096, 4096 })
   ->Unit(benchmark::kMicrosecond);
 
+// Renders a 1024x1024 sprite in a 1920x1080 viewport with the given
+// zoom level (num/den) and color mode.
+static void Bm_RenderZoom(benchmark::State& state)
+{
+  const int zoomNum = state.range(0);
+  const int zoomDen = state.range(1);
+  const auto colorMode = (ColorMode)state.range(2);
+  const int w = 1024;
+  const int h = 1024;
+  const int viewW = 1920;
+  const int viewH = 1080;
+
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(colorMode, w, h)));
+  Image* img = static_cast<LayerImage*>(spr->root()->firstLayer())->cel(0)->image();
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      switch (colorMode) {
+        case ColorMode::RGB:
+          put_pixel(img, x, y, rgba(x & 0xff, y & 0xff, (x^y) & 0xff, (x+y) & 0xff));
+          break;
+        case ColorMode::GRAYSCALE:
+          put_pixel(img, x, y, graya((x^y) & 0xff, (x+y) & 0xff));
+          break;
+        case ColorMode::INDEXED:
+          put_pixel(img, x, y, (x^y) & 0xff);
+          break;
+      }
+    }
+  }
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, viewW, viewH));
+  clear_image(dst.get(), 0);
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = false;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(16, 16);
+  render.setBgOptions(bg);
+  render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoomNum, zoomDen)));
+
+  while (state.KeepRunning()) {
+    render.renderSprite(
+      dst.get(), spr.get(), frame_t(0),
+      gfx::Clip(0, 0, 0, 0, viewW, viewH));
+  }
+
+  state.SetItemsProcessed(state.iterations() * viewW * viewH);
+}
+
+BENCHMARK(Bm_RenderZoom)
+  ->Args({ 1, 1, int(ColorMode::RGB) })
+  ->Args({ 2, 1, int(ColorMode::RGB) })
+  ->Args({ 3, 1, int(ColorMode::RGB) })
+  ->Args({ 4, 1, int(ColorMode::RGB) })
+  ->Args({ 8, 1, int(ColorMode::RGB) })
+  ->Args({ 1, 2, int(ColorMode::RGB) })
+  ->Args({ 1, 4, int(ColorMode::RGB) })
+  ->Args({ 4, 1, int(ColorMode::GRAYSCALE) })
+  ->Args({ 4, 1, int(ColorMode::INDEXED) })
+  ->Args({ 1, 2, int(ColorMode::INDEXED) })
+  ->Unit(benchmark::kMicrosecond);
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,6 +19,7 @@
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/selected_layers.h"
 
 #include <memory>
 
@@ -277,6 +278,189 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TEST(Render, ZoomInWithOffsetAndZoomOut)
+{
+  // Create this image:
+  // 1 2 3 4
+  // 5 6 7 8
+  // 1 2 3 4
+  // 5 6 7 8
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::INDEXED, 4, 4)));
+  Image* src = doc->sprite()->root()->firstLayer()->cel(0)->image();
+  for (int y=0; y<4; ++y)
+    for (int x=0; x<4; ++x)
+      put_pixel(src, x, y, 1 + x + 4*(y & 1));
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_INDEXED, 4, 4));
+  clear_image(dst.get(), 0);
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::NONE;
+  render.setBgOptions(bg);
+
+  // Zoom 300% with the first pixel partially visible
+  render.setProjection(Projection(PixelRatio(1, 1), Zoom(3, 1)));
+  render.renderSprite(
+    dst.get(), doc->sprite(), frame_t(0),
+    gfx::Clip(0, 0, 2, 2, 4, 4));
+  EXPECT_4X4_PIXELS(dst.get(),
+    1, 2, 2, 2,
+    5, 6, 6, 6,
+    5, 6, 6, 6,
+    5, 6, 6, 6);
+
+  // Zoom 50%
+  clear_image(dst.get(), 0);
+  render.setProjection(Projection(PixelRatio(1, 1), Zoom(1, 2)));
+  render.renderSprite(
+    dst.get(), doc->sprite(), frame_t(0),
+    gfx::Clip(0, 0, 0, 0, 2, 2));
+  EXPECT_4X4_PIXELS(dst.get(),
+    1, 3, 0, 0,
+    1, 3, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0, 0);
+}
+
+TEST(Render, OnionskinIsUpdatedWithNewImageVersions)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 2, 2)));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(frame_t(2));
+
+  auto layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  Image* src0 = layer->cel(0)->image();
+  put_pixel(src0, 0, 0, rgba(255, 0, 0, 255));
+
+  ImageRef src1(Image::create(IMAGE_RGB, 2, 2));
+  put_pixel(src1.get(), 1, 1, rgba(0, 0, 255, 255));
+  layer->addCel(new Cel(frame_t(1), src1));
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::NONE;
+  render.setBgOptions(bg);
+  render.setMipmaps(true);
+
+  OnionskinOptions opts(OnionskinType::MERGE);
+  opts.prevFrames(1);
+  opts.opacityBase(255);
+  render.setOnionskin(opts);
+
+  render.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(255, 0, 0, 255), 0,
+                    0, rgba(0, 0, 255, 255));
+
+  // Modify the previous frame, the cached ghost must be discarded
+  put_pixel(src0, 0, 1, rgba(0, 255, 0, 255));
+  src0->incrementVersion();
+
+  render.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(255, 0, 0, 255), 0,
+                    rgba(0, 255, 0, 255), rgba(0, 0, 255, 255));
+}
+
+TEST(Render, OnionskinIsUpdatedWhenTheCanvasIsResized)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 2, 2)));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(frame_t(2));
+
+  auto layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  put_pixel(layer->cel(0)->image(), 0, 0, rgba(255, 0, 0, 255));
+
+  ImageRef src1(Image::create(IMAGE_RGB, 2, 2));
+  put_pixel(src1.get(), 1, 1, rgba(0, 0, 255, 255));
+  layer->addCel(new Cel(frame_t(1), src1));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::NONE;
+  render.setBgOptions(bg);
+  render.setMipmaps(true);
+
+  OnionskinOptions opts(OnionskinType::MERGE);
+  opts.prevFrames(1);
+  opts.opacityBase(255);
+  render.setOnionskin(opts);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+  render.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(dst.get(), 0, 0));
+
+  // Resize the canvas without modifying cels/images, the ghost of
+  // the old size must not be reused (it'd be stretched)
+  sprite->setSize(4, 2);
+
+  dst.reset(Image::create(IMAGE_RGB, 4, 2));
+  render.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(dst.get(), 0, 0));
+  EXPECT_EQ(0, get_pixel(dst.get(), 1, 0));
+  EXPECT_EQ(rgba(0, 0, 255, 255), get_pixel(dst.get(), 1, 1));
+  EXPECT_EQ(0, get_pixel(dst.get(), 2, 0));
+  EXPECT_EQ(0, get_pixel(dst.get(), 3, 1));
+
+  // Remove the ghosts of the sprite (as when it's destroyed)
+  const std::size_t memSize = OnionskinCache::instance()->memSize();
+  EXPECT_GT(memSize, 0u);
+  OnionskinCache::instance()->remove(sprite->id());
+  EXPECT_LT(OnionskinCache::instance()->memSize(), memSize);
+}
+
+TEST(Render, VisibleLayers)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 2, 2)));
+  Sprite* sprite = doc->sprite();
+
+  Layer* layer1 = sprite->root()->firstLayer();
+  put_pixel(layer1->cel(0)->image(), 0, 0, rgba(255, 0, 0, 255));
+
+  auto layer2 = new LayerImage(sprite);
+  sprite->root()->addLayer(layer2);
+  ImageRef src2(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(src2.get(), 0);
+  put_pixel(src2.get(), 1, 1, rgba(0, 0, 255, 255));
+  layer2->addCel(new Cel(frame_t(0), src2));
+  layer2->setVisible(false);
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::NONE;
+  render.setBgOptions(bg);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+  render.renderSprite(dst.get(), sprite, frame_t(0));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(255, 0, 0, 255), 0,
+                    0, 0);
+
+  // Render only the hidden layer without changing its visibility
+  SelectedLayers visibleLayers;
+  visibleLayers.insert(layer2);
+  render.setVisibleLayers(&visibleLayers);
+  render.renderSprite(dst.get(), sprite, frame_t(0));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    0, 0,
+                    0, rgba(0, 0, 255, 255));
+  EXPECT_TRUE(layer1->isVisible());
+  EXPECT_FALSE(layer2->isVisible());
+
+  render.setVisibleLayers(nullptr);
+  render.renderSprite(dst.get(), sprite, frame_t(0));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(255, 0, 0, 255), 0,
+                    0, 0);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
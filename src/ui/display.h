@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -55,6 +55,11 @@ namespace ui {
 
     void addInvalidRegion(const gfx::Region& b) {
       m_invalidRegion |= b;
+      // Areas invalidated after they were painted must not be
+      // subtracted by subtractPaintedRegion() (they will be painted
+      // again with new PaintMessages).
+      if (!m_paintedRegion.isEmpty())
+        m_paintedRegion -= b;
     }
 
     void subtractInvalidRegion(const gfx::Region& b) {
@@ -63,6 +68,23 @@ namespace ui {
 
     void setInvalidRegion(const gfx::Region& b) {
       m_invalidRegion = b;
+      m_paintedRegion.clear();
+    }
+
+    // Areas updated with PaintMessages are accumulated here and
+    // subtracted from the invalid region in one step with
+    // subtractPaintedRegion() (instead of one subtraction for each
+    // painted rectangle). Only the areas that weren't invalidated
+    // again after being painted are subtracted.
+    void addPaintedRect(const gfx::Rect& rect) {
+      m_paintedRegion |= gfx::Region(rect);
+    }
+
+    void subtractPaintedRegion() {
+      if (!m_paintedRegion.isEmpty()) {
+        m_invalidRegion -= m_paintedRegion;
+        m_paintedRegion.clear();
+      }
     }
 
     void invalidateRect(const gfx::Rect& rect);
@@ -89,6 +111,7 @@ namespace ui {
     std::vector<Window*> m_windows; // Sub-windows in this display
     gfx::Region m_invalidRegion;    // Invalid region (we didn't receive paint messages yet for this).
     gfx::Region m_dirtyRegion;      // Region to flip to the os::Display
+    gfx::Region m_paintedRegion;    // Painted region to subtract from m_invalidRegion
     gfx::Point m_lastMousePos;
   };
 
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -28,7 +28,9 @@
 #include "os/system.h"
 #include "os/window.h"
 #include "os/window_spec.h"
+#include "prof/prof.h"
 #include "ui/intern.h"
+#include "ui/theme.h"
 #include "ui/ui.h"
 
 #if defined(DEBUG_PAINT_EVENTS) || defined(DEBUG_UI_THREADS)
@@ -36,9 +38,11 @@
 #endif
 
 #include <algorithm>
+#include <cstdio>
 #include <limits>
 #include <list>
 #include <memory>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -93,6 +97,21 @@ static base::concurrent_queue<Message*> concurrent_msg_queue;
 static Filters msg_filters[NFILTERS]; // Filters for every enqueued message
 static int filter_locks = 0;
 
+// Indexes of the messages in msg_queue and used_msg_queue, so we
+// don't need to iterate the whole queue to remove the messages of a
+// specific widget/timer (something that is done each time a widget
+// is destroyed or a timer is stopped).
+static std::unordered_multimap<Widget*, Message*> msgs_by_recipient;
+static std::unordered_multimap<Timer*, Message*> msgs_by_timer;
+static int msgs_by_type[NFILTERS]; // Number of queued messages of each type
+
+// Displays with painted areas that weren't subtracted from their
+// invalid region yet (see Display::addPaintedRect()).
+static std::vector<Display*> painted_displays;
+
+// Overlay with the frame-time graph (see Manager::setShowFrameTimes()).
+static OverlayRef frame_times_overlay;
+
 // Current display with the mouse, used to avoid processing a
 // os::Event::MouseLeave of the non-current display/window as when we
 // move the mouse between two windows we can receive:
@@ -124,6 +143,67 @@ inline bool does_accept_focus(Widget* widget)
           ((widget)->isVisible()));
 }
 
+static void index_message(Message* msg)
+{
+  ++msgs_by_type[std::min(msg->type(), kFirstRegisteredMessage)];
+
+  if (Widget* widget = msg->recipient())
+    msgs_by_recipient.emplace(widget, msg);
+
+  if (msg->type() == kTimerMessage) {
+    if (Timer* timer = static_cast<TimerMessage*>(msg)->timer())
+      msgs_by_timer.emplace(timer, msg);
+  }
+}
+
+template<typename Key>
+static void erase_from_index(std::unordered_multimap<Key*, Message*>& index,
+                             Key* key, Message* msg)
+{
+  auto range = index.equal_range(key);
+  for (auto it=range.first; it!=range.second; ++it) {
+    if (it->second == msg) {
+      index.erase(it);
+      break;
+    }
+  }
+}
+
+static void unindex_message(Message* msg)
+{
+  --msgs_by_type[std::min(msg->type(), kFirstRegisteredMessage)];
+
+  if (Widget* widget = msg->recipient())
+    erase_from_index(msgs_by_recipient, widget, msg);
+
+  if (msg->type() == kTimerMessage) {
+    if (Timer* timer = static_cast<TimerMessage*>(msg)->timer())
+      erase_from_index(msgs_by_timer, timer, msg);
+  }
+}
+
+static void enqueue_message(Message* msg)
+{
+  msg_queue.push_back(msg);
+  index_message(msg);
+}
+
+// Removes the recipient of a message that is in the queue.
+static void remove_recipient(Message* msg)
+{
+  if (Widget* widget = msg->recipient()) {
+    erase_from_index(msgs_by_recipient, widget, msg);
+    msg->removeRecipient(widget);
+  }
+}
+
+static void subtract_painted_regions()
+{
+  for (Display* display : painted_displays)
+    display->subtractPaintedRegion();
+  painted_displays.clear();
+}
+
 static int count_widgets_accept_focus(Widget* widget);
 static bool child_accept_focus(Widget* widget, bool first);
 static Widget* next_widget(Widget* widget);
@@ -260,6 +340,8 @@ Manager::~Manager()
     ASSERT(msg_queue.empty());
 #endif
 
+    setShowFrameTimes(false);
+
     // No more default manager
     m_defaultManager = nullptr;
 
@@ -294,9 +376,12 @@ void Manager::run()
 
 void Manager::flipAllDisplays()
 {
+  PROF_ZONE("ui", "Manager::flipAllDisplays");
+
   OverlayManager* overlays = OverlayManager::instance();
 
   update_cursor_overlay();
+  updateFrameTimesOverlay();
 
   // Draw overlays.
   overlays->drawOverlays();
@@ -311,6 +396,88 @@ void Manager::flipAllDisplays()
   }
 }
 
+void Manager::setShowFrameTimes(bool state)
+{
+  if (state == showFrameTimes())
+    return;
+
+  if (state) {
+    const int scale = guiscale();
+    frame_times_overlay = base::make_ref<Overlay>(
+      &m_display,
+      os::instance()->makeRgbaSurface(128*scale, 48*scale),
+      gfx::Point(),
+      (Overlay::ZOrder)(Overlay::MouseZOrder-1));
+    OverlayManager::instance()->addOverlay(frame_times_overlay);
+    prof::set_enabled(true);
+  }
+  else {
+    OverlayManager::instance()->removeOverlay(frame_times_overlay);
+    frame_times_overlay->setSurface(nullptr);
+    frame_times_overlay.reset();
+    prof::set_enabled(false);
+  }
+  m_display.invalidate();
+}
+
+bool Manager::showFrameTimes() const
+{
+  return (frame_times_overlay != nullptr);
+}
+
+// Draws the duration of the last frames as vertical bars (green
+// below 16.7ms/60fps, yellow below 33.3ms/30fps, and red above).
+void Manager::updateFrameTimesOverlay()
+{
+  if (!frame_times_overlay)
+    return;
+
+  // Restore the overlapped area as we're going to change the content
+  // of the overlay surface.
+  frame_times_overlay->restoreOverlappedArea(gfx::Rect());
+
+  const os::SurfaceRef& surface = frame_times_overlay->surface();
+  const int scale = guiscale();
+  const int w = surface->width();
+  const int h = surface->height();
+  const double maxMs = 50.0;
+  auto msToY = [h, maxMs](double ms) {
+    return h - int(h * std::min(ms, maxMs) / maxMs);
+  };
+
+  const std::vector<double> times = prof::frame_times();
+  {
+    os::SurfaceLock lock(surface.get());
+    Graphics g(nullptr, surface, 0, 0);
+    g.fillRect(gfx::rgba(0, 0, 0, 160), gfx::Rect(0, 0, w, h));
+
+    int x = w;
+    for (auto it=times.rbegin(); it!=times.rend() && x > 0; ++it) {
+      const double ms = *it;
+      const gfx::Color color =
+        (ms < 1000.0/60.0 ? gfx::rgba(0, 200, 0):
+         ms < 1000.0/30.0 ? gfx::rgba(230, 200, 0):
+                            gfx::rgba(230, 0, 0));
+      const int y = msToY(ms);
+      x -= scale;
+      g.fillRect(color, gfx::Rect(x, y, scale, h-y));
+    }
+
+    g.drawHLine(gfx::rgba(255, 255, 255, 128), 0, msToY(1000.0/60.0), w);
+
+    if (!times.empty()) {
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%.1f ms", times.back());
+      g.setFont(AddRef(get_theme()->getDefaultFont()));
+      g.drawText(buf, gfx::rgba(255, 255, 255), gfx::ColorNone,
+                 gfx::Point(2*scale, 2*scale));
+    }
+  }
+
+  frame_times_overlay->moveOverlay(
+    gfx::Point(m_display.size().w - w, 0));
+}
+
 void Manager::updateAllDisplaysWithNewScale(int scale)
 {
   os::Window* nativeWindow = m_display.nativeWindow();
@@ -344,7 +511,7 @@ bool Manager::generateMessages()
   if (!concurrent_msg_queue.empty()) {
     Message* msg = nullptr;
     while (concurrent_msg_queue.try_pop(msg))
-      msg_queue.push_back(msg);
+      enqueue_message(msg);
   }
 
   // Generate messages from OS input
@@ -857,6 +1024,12 @@ void Manager::updateMouseWidgets(const gfx::Point& mousePos,
 
 void Manager::dispatchMessages()
 {
+  PROF_ZONE("ui", "Manager::dispatchMessages");
+
+  // Start of the frame work (to measure the frame time until the
+  // displays are flipped, without the time waiting for events).
+  const int64_t frameBegin = (prof::is_enabled() ? prof::now(): -1);
+
   // Send messages in the queue (mouse/key/timer/etc. events) This
   // might change the state of widgets, etc. In case pumpQueue()
   // returns a number greater than 0, it means that we've processed
@@ -882,6 +1055,7 @@ void Manager::dispatchMessages()
 
       // Flip back-buffers to real displays.
       flipAllDisplays();
+      prof::frame_mark(frameBegin);
     }
   }
 }
@@ -897,7 +1071,7 @@ void Manager::enqueueMessage(Message* msg)
   ASSERT(msg);
 
   if (is_ui_thread())
-    msg_queue.push_back(msg);
+    enqueue_message(msg);
   else
     concurrent_msg_queue.push(msg);
 }
@@ -1163,11 +1337,10 @@ void Manager::removeMessagesFor(Widget* widget)
   ASSERT(manager_thread == std::this_thread::get_id());
 #endif
 
-  for (Message* msg : msg_queue)
-    msg->removeRecipient(widget);
-
-  for (Message* msg : used_msg_queue)
-    msg->removeRecipient(widget);
+  auto range = msgs_by_recipient.equal_range(widget);
+  for (auto it=range.first; it!=range.second; ++it)
+    it->second->removeRecipient(widget);
+  msgs_by_recipient.erase(range.first, range.second);
 }
 
 void Manager::removeMessagesFor(Widget* widget, MessageType type)
@@ -1176,13 +1349,19 @@ void Manager::removeMessagesFor(Widget* widget, MessageType type)
   ASSERT(manager_thread == std::this_thread::get_id());
 #endif
 
-  for (Message* msg : msg_queue)
-    if (msg->type() == type)
-      msg->removeRecipient(widget);
+  if (msgs_by_type[std::min(type, kFirstRegisteredMessage)] == 0)
+    return;
 
-  for (Message* msg : used_msg_queue)
-    if (msg->type() == type)
+  auto range = msgs_by_recipient.equal_range(widget);
+  for (auto it=range.first; it!=range.second; ) {
+    Message* msg = it->second;
+    if (msg->type() == type) {
       msg->removeRecipient(widget);
+      it = msgs_by_recipient.erase(it);
+    }
+    else
+      ++it;
+  }
 }
 
 void Manager::removeMessagesForTimer(Timer* timer)
@@ -1191,21 +1370,13 @@ void Manager::removeMessagesForTimer(Timer* timer)
   ASSERT(manager_thread == std::this_thread::get_id());
 #endif
 
-  for (Message* msg : msg_queue) {
-    if (msg->type() == kTimerMessage &&
-        static_cast<TimerMessage*>(msg)->timer() == timer) {
-      msg->removeRecipient(msg->recipient());
-      static_cast<TimerMessage*>(msg)->_resetTimer();
-    }
-  }
-
-  for (Message* msg : used_msg_queue) {
-    if (msg->type() == kTimerMessage &&
-        static_cast<TimerMessage*>(msg)->timer() == timer) {
-      msg->removeRecipient(msg->recipient());
-      static_cast<TimerMessage*>(msg)->_resetTimer();
-    }
+  auto range = msgs_by_timer.equal_range(timer);
+  for (auto it=range.first; it!=range.second; ++it) {
+    Message* msg = it->second;
+    remove_recipient(msg);
+    static_cast<TimerMessage*>(msg)->_resetTimer();
   }
+  msgs_by_timer.erase(range.first, range.second);
 }
 
 void Manager::removeMessagesForDisplay(Display* display)
@@ -1216,17 +1387,23 @@ void Manager::removeMessagesForDisplay(Display* display)
 
   for (Message* msg : msg_queue) {
     if (msg->display() == display) {
-      msg->removeRecipient(msg->recipient());
+      remove_recipient(msg);
       msg->setDisplay(nullptr);
     }
   }
 
   for (Message* msg : used_msg_queue) {
     if (msg->display() == display) {
-      msg->removeRecipient(msg->recipient());
+      remove_recipient(msg);
       msg->setDisplay(nullptr);
     }
   }
+
+  auto it = std::find(painted_displays.begin(), painted_displays.end(), display);
+  if (it != painted_displays.end()) {
+    display->subtractPaintedRegion();
+    painted_displays.erase(it);
+  }
 }
 
 void Manager::removePaintMessagesForDisplay(Display* display)
@@ -1235,10 +1412,14 @@ void Manager::removePaintMessagesForDisplay(Display* display)
   ASSERT(manager_thread == std::this_thread::get_id());
 #endif
 
+  if (msgs_by_type[kPaintMessage] == 0)
+    return;
+
   for (auto it=msg_queue.begin(); it != msg_queue.end(); ) {
     Message* msg = *it;
     if (msg->type() == kPaintMessage &&
         msg->display() == display) {
+      unindex_message(msg);
       delete msg;
       it = msg_queue.erase(it);
     }
@@ -1840,6 +2021,8 @@ int Manager::pumpQueue()
   ASSERT(manager_thread == std::this_thread::get_id());
 #endif
 
+  PROF_ZONE("ui", "Manager::pumpQueue");
+
 #ifdef LIMIT_DISPATCH_TIME
   base::tick_t t = base::current_tick();
 #endif
@@ -1860,6 +2043,11 @@ int Manager::pumpQueue()
     msg_queue.erase(it);
     auto eraseIt = used_msg_queue.insert(used_msg_queue.end(), msg);
 
+    // Update the invalid regions before other kind of messages can
+    // use them.
+    if (msg->type() != kPaintMessage && !painted_displays.empty())
+      subtract_painted_regions();
+
     // Call Timer::tick() if this is a tick message.
     if (msg->type() == kTimerMessage) {
       // The timer can be nullptr if it was removed with removeMessagesForTimer()
@@ -1901,10 +2089,13 @@ int Manager::pumpQueue()
     used_msg_queue.erase(eraseIt);
 
     // Destroy the message
+    unindex_message(msg);
     delete msg;
     ++count;
   }
 
+  subtract_painted_regions();
+
   return count;
 }
 
@@ -2014,9 +2205,13 @@ bool Manager::sendMessageToWidget(Message* msg, Widget* widget)
     // Restore clip region for paint messages.
     surface->restoreClip();
 
-    // As this kPaintMessage's rectangle was updated, we can
-    // remove it from "m_invalidRegion".
-    display->subtractInvalidRegion(gfx::Region(paintMsg->rect()));
+    // As this kPaintMessage's rectangle was updated, we can remove
+    // it from "m_invalidRegion" (all the painted rectangles are
+    // subtracted at once by subtract_painted_regions()).
+    if (std::find(painted_displays.begin(),
+                  painted_displays.end(), display) == painted_displays.end())
+      painted_displays.push_back(display);
+    display->addPaintedRect(paintMsg->rect());
   }
   else {
     // Call the message handler
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -48,6 +48,12 @@ namespace ui {
 
     void updateAllDisplaysWithNewScale(int scale);
 
+    // Shows a graph with the duration of the last frames in the
+    // top-right corner of the main display. It enables the profiler
+    // to record frame times (see prof::frame_mark()).
+    void setShowFrameTimes(bool state);
+    bool showFrameTimes() const;
+
     // Adds the given "msg" message to the queue of messages to be
     // dispached. "msg" cannot be used after this function, it'll be
     // automatically deleted.
@@ -114,6 +120,7 @@ namespace ui {
     virtual void onNewDisplayConfiguration(Display* display);
 
   private:
+    void updateFrameTimesOverlay();
     void generateSetCursorMessage(Display* display,
                                   const gfx::Point& mousePos,
                                   KeyModifiers modifiers,
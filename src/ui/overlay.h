@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -38,6 +38,7 @@ namespace ui {
             ZOrder zorder = NormalZOrder);
     ~Overlay();
 
+    const os::SurfaceRef& surface() const { return m_surface; }
     os::SurfaceRef setSurface(const os::SurfaceRef& newSurface);
 
     const gfx::Point& position() const { return m_pos; }
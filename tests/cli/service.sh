@@ -0,0 +1,37 @@
+#! /bin/bash
+# Copyright (C) 2024 Igara Studio S.A.
+
+# --service
+
+d=$t/service
+mkdir -p $d
+cp sprites/abcd.aseprite $d/sprite.aseprite
+
+function wait_replies() {
+    while [[ $(cat $d/replies.txt 2>/dev/null | wc -l) -lt $1 ]] ; do
+	sleep 0.1
+    done
+}
+
+# One reply per job. The same file is listed two times (the second
+# time the loaded document is reused), and then the file is modified
+# on disk so it must be loaded again.
+(
+    echo '{ "id": 1, "args": [ "--list-layers", "'$d/sprite.aseprite'" ] }'
+    echo '{ "id": 2, "args": [ "--list-layers", "'$d/sprite.aseprite'" ] }'
+    echo 'invalid job'
+    echo '{ "id": 4, "args": [ 4 ] }'
+    echo '{ "id": 5, "args": [ "--shell" ] }'
+    wait_replies 5
+    sleep 1
+    cp sprites/1empty3.aseprite $d/sprite.aseprite
+    echo '{ "id": 6, "args": [ "--list-layers", "'$d/sprite.aseprite'" ] }'
+) | $ASEPRITE --service > $d/replies.txt || exit 1
+
+[[ $(cat $d/replies.txt | wc -l) -eq 6 ]] || fail "expected 6 replies"
+expect '{"code": 0, "id": 1, "output": "a\nb\nc\nd\n"}
+{"code": 0, "id": 2, "output": "a\nb\nc\nd\n"}' "sed -n 1,2p $d/replies.txt"
+grep -q '^{"error": "invalid JSON job' <(sed -n 3p $d/replies.txt) || fail
+expect '{"error": "all \"args\" must be strings", "id": 4}' "sed -n 4p $d/replies.txt"
+expect '{"code": -1, "error": "--shell and --service cannot be used in jobs", "id": 5, "output": ""}' "sed -n 5p $d/replies.txt"
+expect '{"code": 0, "id": 6, "output": "bg\nfg\n"}' "sed -n 6p $d/replies.txt"
@@ -0,0 +1,71 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+local pc = app.pixelColor
+
+-- Count opaque pixels of each image in parallel
+do
+  local images = {}
+  for i=1,8 do
+    local img = Image(8, 4)
+    for x=0,i-1 do
+      img:drawPixel(x, 0, pc.rgba(255, 0, 0, 255))
+    end
+    images[i] = img
+  end
+
+  local results = app.parallel(
+    images,
+    function(buf, i)
+      local n = 0
+      for j=1,#buf do
+        if app.pixelColor.rgbaA(buf[j]) > 0 then
+          n = n+1
+        end
+      end
+      return { index=i, count=n, size={ buf.width, buf.height } }
+    end)
+
+  assert(#results == 8)
+  for i=1,8 do
+    assert(results[i].index == i)
+    assert(results[i].count == i)
+    assert(results[i].size[1] == 8)
+    assert(results[i].size[2] == 4)
+  end
+end
+
+-- Buffers are read-only in the parallel function
+do
+  local img = Image(2, 2)
+  assert(not pcall(app.parallel, { img }, function(buf) buf[1] = 0 end))
+end
+
+-- The function cannot use local variables of the script
+do
+  local img = Image(2, 2)
+  local k = 2
+  assert(not pcall(app.parallel, { img }, function(buf) return k end))
+end
+
+-- Frames and merge function
+do
+  local spr = Sprite(4, 4)
+  spr:newEmptyFrame()
+  spr.cels[1].image:drawPixel(0, 0, pc.rgba(255, 255, 255, 255))
+
+  local merged = {}
+  app.parallel(
+    { spr.frames[1], spr.frames[2] },
+    function(buf, i)
+      return buf:get(0, 0)
+    end,
+    function(result, i)
+      merged[i] = result
+    end)
+
+  assert(merged[1] == pc.rgba(255, 255, 255, 255))
+  assert(merged[2] == 0)
+end
@@ -0,0 +1,93 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+local pc = app.pixelColor
+
+-- Read/write pixels
+do
+  local img = Image(3, 2)
+  local buf = img:buffer()
+  assert(buf.width == 3)
+  assert(buf.height == 2)
+  assert(#buf == 6)
+  assert(buf.bounds == Rectangle(0, 0, 3, 2))
+
+  local v = img.version
+  buf[1] = pc.rgba(255, 0, 0, 255)
+  buf:set(2, 1, pc.rgba(0, 0, 255, 255))
+  assert(img.version > v)
+  assert(img:getPixel(0, 0) == pc.rgba(255, 0, 0, 255))
+  assert(img:getPixel(2, 1) == pc.rgba(0, 0, 255, 255))
+  assert(buf[6] == pc.rgba(0, 0, 255, 255))
+  assert(buf:get(0, 0) == pc.rgba(255, 0, 0, 255))
+  assert(buf[0] == nil)
+  assert(buf[7] == nil)
+
+  -- Out of bounds access
+  assert(not pcall(function() buf[7] = 0 end))
+  assert(not pcall(function() buf:get(3, 0) end))
+  assert(not pcall(function() buf:set(0, -1, 0) end))
+end
+
+-- Views of a rectangle and rows
+do
+  local img = Image(4, 4, ColorMode.INDEXED)
+  for y=0,3 do
+    for x=0,3 do
+      img:drawPixel(x, y, x + 4*y)
+    end
+  end
+
+  local buf = img:buffer(Rectangle(1, 1, 2, 3))
+  assert(#buf == 6)
+  assert(buf:get(0, 0) == 5)
+  assert(buf[2] == 6)
+  assert(buf[3] == 9)
+
+  local row = buf:row(2)
+  assert(row.bounds == Rectangle(1, 3, 2, 1))
+  assert(row[1] == 13)
+  assert(row.bytes == string.char(13, 14))
+  row.bytes = string.char(20, 21)
+  assert(img:getPixel(1, 3) == 20)
+  assert(img:getPixel(2, 3) == 21)
+  assert(buf.bytes == string.char(5, 6, 9, 10, 20, 21))
+
+  -- Apply a function to each row
+  local rows = {}
+  buf:forEachRow(
+    function(row, y)
+      rows[#rows+1] = y
+      row[1] = 30+y
+    end)
+  assert(#rows == 3)
+  assert(img:getPixel(1, 1) == 30)
+  assert(img:getPixel(1, 2) == 31)
+  assert(img:getPixel(1, 3) == 32)
+
+  -- Stop the iteration returning false
+  local n = 0
+  buf:forEachRow(function(row, y) n = n+1; return false end)
+  assert(n == 1)
+end
+
+-- The buffer keeps the image alive
+do
+  local buf = Image(2, 2):buffer()
+  collectgarbage()
+  buf[1] = 1
+  assert(buf[1] == 1)
+end
+
+-- The image of a closed sprite cannot be accessed
+do
+  local spr = Sprite(2, 2)
+  local buf = spr.cels[1].image:buffer()
+  buf[1] = 1
+  assert(buf[1] == 1)
+  spr:close()
+  assert(not pcall(function() return buf[1] end))
+  assert(not pcall(function() buf[1] = 2 end))
+end
@@ -58,15 +58,19 @@ do
      assert(false)
    end
 
+   local version = image.version
    c = 1
    for it in image:pixels() do
       it(pc.rgba(255, 32*c, 0, 255))
       c = c+1
    end
+   -- The version is incremented once when pixels are modified
+   assert(image.version == version+1)
 
    c = 1
    for it in image:pixels() do
       assert(pc.rgba(255, 32*c, 0, 255) == it())
       c = c+1
    end
+   assert(image.version == version+1)
 end